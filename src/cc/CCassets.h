@@ -46,6 +46,13 @@ int64_t AssetValidateBuyvin(struct CCcontract_info *cp,Eval* eval,int64_t &tmppr
 int64_t AssetValidateSellvin(struct CCcontract_info *cp,Eval* eval,int64_t &tmpprice,std::vector<uint8_t> &tmporigpubkey,char *CCaddr,char *origaddr,const CTransaction &tx,uint256 assetid);
 bool AssetExactAmounts(struct CCcontract_info *cp,int64_t &inputs,int32_t starti,int64_t &outputs,Eval* eval,const CTransaction &tx,uint256 assetid);
 
+// CCassetsbook
+void AssetsBookConnectBlock(const CBlock &block,int32_t height);
+void AssetsBookDisconnectBlock(const CBlock &block);
+UniValue AssetBookOrders(uint256 refassetid);
+UniValue AssetBookDepth(uint256 tokenid,int32_t side,int32_t start,int32_t count);
+UniValue AssetBestPrice(uint256 tokenid);
+
 // CCassetstx
 int64_t GetAssetBalance(CPubKey pk,uint256 tokenid);
 int64_t AddAssetInputs(CMutableTransaction &mtx,CPubKey pk,uint256 assetid,int64_t total,int32_t maxinputs);
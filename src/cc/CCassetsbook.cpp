@@ -0,0 +1,421 @@
+/******************************************************************************
+ * Copyright © 2014-2018 The SuperNET Developers.                             *
+ *                                                                            *
+ * See the AUTHORS, DEVELOPER-AGREEMENT and LICENSE files at                  *
+ * the top-level directory of this distribution for the individual copyright  *
+ * holder information and the developer policies on copyright and licensing.  *
+ *                                                                            *
+ * Unless otherwise agreed in a custom licensing agreement, no part of the    *
+ * SuperNET software, including this file may be copied, modified, propagated *
+ * or distributed except according to the terms contained in the LICENSE file *
+ *                                                                            *
+ * Removal or modification of this copyright notice is prohibited.            *
+ *                                                                            *
+ ******************************************************************************/
+
+#include "CCassets.h"
+#include "txmempool.h"
+
+/*
+ CCassetsbook keeps the open EVAL_ASSETS orders in memory, sorted by unit price per tokenid, so that the rpc calls dont need to rescan the assets CC address and load every order tx on each request.
+
+ The confirmed book is loaded once from the address index on first use and afterwards follows ConnectBlock/DisconnectBlock. The mempool part is an overlay that is rebuilt only when the mempool has changed since the last query: orders created by mempool txs are added and confirmed orders spent by mempool txs are hidden.
+
+ Unit prices are in satoshis per token: a bid locks nValue coins for price tokens, an ask locks nValue tokens for price coins. Swaps (e/E) are not coin denominated, so they are listed by tokenorders but are not part of either side of the book.
+ */
+
+struct CAssetOrder
+{
+    uint256 txid,assetid,assetid2; int64_t nValue,price; double unitprice; int32_t vout,height; uint8_t funcid; std::vector<uint8_t> origpubkey;
+};
+
+struct CAssetBookKey
+{
+    double unitprice; uint256 txid; int32_t vout;
+    CAssetBookKey(const CAssetOrder &order) : unitprice(order.unitprice), txid(order.txid), vout(order.vout) {}
+};
+
+struct CAssetAskCompare // lowest price first
+{
+    bool operator()(const CAssetBookKey &a,const CAssetBookKey &b) const
+    {
+        if ( a.unitprice != b.unitprice )
+            return(a.unitprice < b.unitprice);
+        if ( a.txid != b.txid )
+            return(a.txid < b.txid);
+        return(a.vout < b.vout);
+    }
+};
+
+struct CAssetBidCompare // highest price first
+{
+    bool operator()(const CAssetBookKey &a,const CAssetBookKey &b) const
+    {
+        if ( a.unitprice != b.unitprice )
+            return(a.unitprice > b.unitprice);
+        if ( a.txid != b.txid )
+            return(a.txid < b.txid);
+        return(a.vout < b.vout);
+    }
+};
+
+struct CAssetBook
+{
+    std::set<CAssetBookKey,CAssetBidCompare> bids;
+    std::set<CAssetBookKey,CAssetAskCompare> asks;
+    std::set<COutPoint> swaps;
+};
+
+struct CAssetBookState
+{
+    std::map<COutPoint,CAssetOrder> orders;
+    std::map<uint256,CAssetBook> books;
+    void clear() { orders.clear(); books.clear(); }
+};
+
+// all book state is protected by cs_main, which is held by ConnectBlock/DisconnectBlock
+static CAssetBookState ASSETS_BOOK,ASSETS_MEMPOOLBOOK;
+static std::set<COutPoint> ASSETS_MEMPOOLSPENT;
+static bool ASSETS_BOOKINIT;
+static unsigned int ASSETS_MEMPOOLUPDATED;
+static char ASSETS_UNSPENDABLE[64];
+
+static const char *AssetsBookAddress()
+{
+    struct CCcontract_info *cp,C;
+    if ( ASSETS_UNSPENDABLE[0] == 0 )
+    {
+        cp = CCinit(&C,EVAL_ASSETS);
+        strcpy(ASSETS_UNSPENDABLE,cp->unspendableCCaddr);
+    }
+    return(ASSETS_UNSPENDABLE);
+}
+
+static bool AssetsBookIsOrder(CAssetOrder &order,const CTransaction &tx,int32_t v,int32_t height)
+{
+    char destaddr[64]; int64_t price; uint256 assetid,assetid2; std::vector<uint8_t> origpubkey; uint8_t funcid;
+    if ( v >= (int32_t)tx.vout.size()-1 || tx.vout[v].nValue <= 0 || tx.vout[v].scriptPubKey.IsPayToCryptoCondition() == 0 )
+        return(false);
+    funcid = DecodeAssetOpRet(tx.vout[tx.vout.size()-1].scriptPubKey,assetid,assetid2,price,origpubkey);
+    if ( funcid != 'b' && funcid != 'B' && funcid != 's' && funcid != 'S' && funcid != 'e' && funcid != 'E' )
+        return(false);
+    if ( Getscriptaddress(destaddr,tx.vout[v].scriptPubKey) == 0 || strcmp(destaddr,AssetsBookAddress()) != 0 )
+        return(false);
+    order.txid = tx.GetHash();
+    order.vout = v;
+    order.height = height;
+    order.funcid = funcid;
+    order.assetid = assetid;
+    order.assetid2 = assetid2;
+    order.nValue = tx.vout[v].nValue;
+    order.price = price;
+    order.origpubkey = origpubkey;
+    order.unitprice = 0.;
+    if ( price > 0 )
+    {
+        if ( funcid == 'b' || funcid == 'B' )
+            order.unitprice = (double)order.nValue / price;
+        else if ( funcid == 's' || funcid == 'S' )
+            order.unitprice = (double)price / order.nValue;
+    }
+    return(true);
+}
+
+static void AssetsBookAdd(CAssetBookState &state,const CAssetOrder &order)
+{
+    COutPoint outpoint(order.txid,order.vout);
+    if ( state.orders.count(outpoint) != 0 )
+        return;
+    state.orders[outpoint] = order;
+    CAssetBook &book = state.books[order.assetid];
+    if ( order.funcid == 'e' || order.funcid == 'E' )
+        book.swaps.insert(outpoint);
+    else if ( order.funcid == 'b' || order.funcid == 'B' )
+        book.bids.insert(CAssetBookKey(order));
+    else book.asks.insert(CAssetBookKey(order));
+}
+
+static void AssetsBookRemove(CAssetBookState &state,const COutPoint &outpoint)
+{
+    std::map<COutPoint,CAssetOrder>::iterator it; std::map<uint256,CAssetBook>::iterator bi;
+    if ( (it= state.orders.find(outpoint)) == state.orders.end() )
+        return;
+    const CAssetOrder &order = it->second;
+    if ( (bi= state.books.find(order.assetid)) != state.books.end() )
+    {
+        bi->second.swaps.erase(outpoint);
+        bi->second.bids.erase(CAssetBookKey(order));
+        bi->second.asks.erase(CAssetBookKey(order));
+        if ( bi->second.bids.empty() != 0 && bi->second.asks.empty() != 0 && bi->second.swaps.empty() != 0 )
+            state.books.erase(bi);
+    }
+    state.orders.erase(it);
+}
+
+static void AssetsBookAddTx(CAssetBookState &state,const CTransaction &tx,int32_t height)
+{
+    CAssetOrder order; int32_t v;
+    for (v=0; v<(int32_t)tx.vout.size()-1; v++)
+        if ( AssetsBookIsOrder(order,tx,v,height) != 0 )
+            AssetsBookAdd(state,order);
+}
+
+// loads the confirmed book from the address index, the incremental updates take over from there
+static void AssetsBookInit()
+{
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs; CTransaction tx; CAssetOrder order; uint256 hashBlock;
+    AssertLockHeld(cs_main);
+    if ( ASSETS_BOOKINIT != 0 )
+        return;
+    ASSETS_BOOK.clear();
+    SetCCunspents(unspentOutputs,(char *)AssetsBookAddress());
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
+    {
+        if ( GetTransaction(it->first.txhash,tx,hashBlock,false) != 0 && AssetsBookIsOrder(order,tx,(int32_t)it->first.index,it->second.blockHeight) != 0 )
+            AssetsBookAdd(ASSETS_BOOK,order);
+    }
+    ASSETS_BOOKINIT = true;
+    ASSETS_MEMPOOLUPDATED = mempool.GetTransactionsUpdated() - 1;
+    LogPrint("cc","assets book loaded %d orders for %d tokens\n",(int32_t)ASSETS_BOOK.orders.size(),(int32_t)ASSETS_BOOK.books.size());
+}
+
+static void AssetsBookSyncMempool()
+{
+    std::vector<uint256> vtxid; CTransaction tx; unsigned int updated;
+    AssertLockHeld(mempool.cs);
+    if ( (updated= mempool.GetTransactionsUpdated()) == ASSETS_MEMPOOLUPDATED )
+        return;
+    ASSETS_MEMPOOLBOOK.clear();
+    ASSETS_MEMPOOLSPENT.clear();
+    mempool.queryHashes(vtxid);
+    BOOST_FOREACH(const uint256 &txid,vtxid)
+    {
+        if ( mempool.lookup(txid,tx) == 0 )
+            continue;
+        BOOST_FOREACH(const CTxIn &txin,tx.vin)
+        {
+            if ( ASSETS_BOOK.orders.count(txin.prevout) != 0 )
+                ASSETS_MEMPOOLSPENT.insert(txin.prevout);
+        }
+        AssetsBookAddTx(ASSETS_MEMPOOLBOOK,tx,0);
+    }
+    // chained mempool txs can spend orders created in the mempool
+    BOOST_FOREACH(const uint256 &txid,vtxid)
+    {
+        if ( mempool.lookup(txid,tx) == 0 )
+            continue;
+        BOOST_FOREACH(const CTxIn &txin,tx.vin)
+            AssetsBookRemove(ASSETS_MEMPOOLBOOK,txin.prevout);
+    }
+    ASSETS_MEMPOOLUPDATED = updated;
+}
+
+void AssetsBookConnectBlock(const CBlock &block,int32_t height)
+{
+    AssertLockHeld(cs_main);
+    if ( ASSETS_BOOKINIT == 0 )
+        return;
+    BOOST_FOREACH(const CTransaction &tx,block.vtx)
+    {
+        if ( tx.IsCoinBase() == 0 )
+        {
+            BOOST_FOREACH(const CTxIn &txin,tx.vin)
+                AssetsBookRemove(ASSETS_BOOK,txin.prevout);
+        }
+        AssetsBookAddTx(ASSETS_BOOK,tx,height);
+    }
+}
+
+void AssetsBookDisconnectBlock(const CBlock &block)
+{
+    CTransaction vintx; CAssetOrder order; uint256 hashBlock; int32_t i;
+    AssertLockHeld(cs_main);
+    if ( ASSETS_BOOKINIT == 0 )
+        return;
+    for (i=(int32_t)block.vtx.size()-1; i>=0; i--)
+    {
+        const CTransaction &tx = block.vtx[i];
+        for (int32_t v=0; v<(int32_t)tx.vout.size(); v++)
+            AssetsBookRemove(ASSETS_BOOK,COutPoint(tx.GetHash(),v));
+        if ( tx.IsCoinBase() != 0 )
+            continue;
+        BOOST_FOREACH(const CTxIn &txin,tx.vin)
+        {
+            // spent orders are restored from their tx, which the txindex still has
+            if ( GetTransaction(txin.prevout.hash,vintx,hashBlock,false) != 0 && AssetsBookIsOrder(order,vintx,(int32_t)txin.prevout.n,0) != 0 )
+            {
+                if ( mapBlockIndex.count(hashBlock) != 0 && mapBlockIndex[hashBlock] != 0 )
+                    order.height = mapBlockIndex[hashBlock]->nHeight;
+                AssetsBookAdd(ASSETS_BOOK,order);
+            }
+        }
+    }
+}
+
+static UniValue AssetsBookOrderJson(const CAssetOrder &order,bool mempoolflag)
+{
+    UniValue item(UniValue::VOBJ); char numstr[32],funcidstr[16],origaddr[64],str[65]; struct CCcontract_info *cp,C;
+    funcidstr[0] = order.funcid;
+    funcidstr[1] = 0;
+    item.push_back(Pair("funcid", funcidstr));
+    item.push_back(Pair("txid", uint256_str(str,order.txid)));
+    item.push_back(Pair("vout", (int64_t)order.vout));
+    if ( order.funcid == 'b' || order.funcid == 'B' )
+    {
+        sprintf(numstr,"%.8f",(double)order.nValue/COIN);
+        item.push_back(Pair("amount",numstr));
+        item.push_back(Pair("bidamount",numstr));
+    }
+    else
+    {
+        sprintf(numstr,"%llu",(long long)order.nValue);
+        item.push_back(Pair("amount",numstr));
+        item.push_back(Pair("askamount",numstr));
+    }
+    if ( order.origpubkey.size() == 33 )
+    {
+        cp = CCinit(&C,EVAL_ASSETS);
+        GetCCaddress(cp,origaddr,pubkey2pk(order.origpubkey));
+        item.push_back(Pair("origaddress",origaddr));
+    }
+    if ( order.assetid != zeroid )
+        item.push_back(Pair("tokenid",uint256_str(str,order.assetid)));
+    if ( order.assetid2 != zeroid )
+        item.push_back(Pair("otherid",uint256_str(str,order.assetid2)));
+    if ( order.price > 0 )
+    {
+        if ( order.funcid == 's' || order.funcid == 'S' || order.funcid == 'e' || order.funcid == 'E' )
+        {
+            sprintf(numstr,"%.8f",(double)order.price / COIN);
+            item.push_back(Pair("totalrequired", numstr));
+            sprintf(numstr,"%.8f",(double)order.price / (COIN * order.nValue));
+            item.push_back(Pair("price", numstr));
+        }
+        else
+        {
+            item.push_back(Pair("totalrequired", (int64_t)order.price));
+            sprintf(numstr,"%.8f",(double)order.nValue / (order.price * COIN));
+            item.push_back(Pair("price",numstr));
+        }
+    }
+    if ( mempoolflag != 0 )
+        item.push_back(Pair("mempool",true));
+    else item.push_back(Pair("height",(int64_t)order.height));
+    return(item);
+}
+
+UniValue AssetBookOrders(uint256 refassetid)
+{
+    UniValue result(UniValue::VARR); std::map<uint256,CAssetBook>::const_iterator bi;
+    LOCK(cs_main);
+    AssetsBookInit();
+    if ( refassetid == zeroid )
+    {
+        for (std::map<COutPoint,CAssetOrder>::const_iterator it=ASSETS_BOOK.orders.begin(); it!=ASSETS_BOOK.orders.end(); it++)
+            result.push_back(AssetsBookOrderJson(it->second,false));
+    }
+    else if ( (bi= ASSETS_BOOK.books.find(refassetid)) != ASSETS_BOOK.books.end() )
+    {
+        const CAssetBook &book = bi->second;
+        for (std::set<CAssetBookKey,CAssetBidCompare>::const_iterator it=book.bids.begin(); it!=book.bids.end(); it++)
+            result.push_back(AssetsBookOrderJson(ASSETS_BOOK.orders[COutPoint(it->txid,it->vout)],false));
+        for (std::set<CAssetBookKey,CAssetAskCompare>::const_iterator it=book.asks.begin(); it!=book.asks.end(); it++)
+            result.push_back(AssetsBookOrderJson(ASSETS_BOOK.orders[COutPoint(it->txid,it->vout)],false));
+        for (std::set<COutPoint>::const_iterator it=book.swaps.begin(); it!=book.swaps.end(); it++)
+            result.push_back(AssetsBookOrderJson(ASSETS_BOOK.orders[*it],false));
+    }
+    return(result);
+}
+
+/*
+ Walks one side of the confirmed book and the mempool overlay in price order, skipping the confirmed orders that are already spent in the mempool. The best price is the first entry, found in O(log n) plus the number of mempool-spent orders at the top of the book.
+ */
+template <typename Compare>
+static void AssetsBookSide(UniValue &result,const std::set<CAssetBookKey,Compare> *confirmed,const std::set<CAssetBookKey,Compare> *pending,int32_t start,int32_t count)
+{
+    typename std::set<CAssetBookKey,Compare>::const_iterator ci,pi; Compare cmp; int32_t n = 0; bool mempoolflag;
+    if ( confirmed != 0 )
+        ci = confirmed->begin();
+    if ( pending != 0 )
+        pi = pending->begin();
+    while ( n < start+count )
+    {
+        if ( confirmed != 0 )
+        {
+            while ( ci != confirmed->end() && ASSETS_MEMPOOLSPENT.count(COutPoint(ci->txid,ci->vout)) != 0 )
+                ci++;
+        }
+        bool haveconfirmed = (confirmed != 0 && ci != confirmed->end());
+        bool havepending = (pending != 0 && pi != pending->end());
+        if ( haveconfirmed == 0 && havepending == 0 )
+            break;
+        mempoolflag = (haveconfirmed == 0 || (havepending != 0 && cmp(*pi,*ci) != 0));
+        const CAssetBookKey &key = (mempoolflag != 0) ? *pi : *ci;
+        if ( n++ >= start )
+        {
+            CAssetBookState &state = (mempoolflag != 0) ? ASSETS_MEMPOOLBOOK : ASSETS_BOOK;
+            result.push_back(AssetsBookOrderJson(state.orders[COutPoint(key.txid,key.vout)],mempoolflag));
+        }
+        if ( mempoolflag != 0 )
+            pi++;
+        else ci++;
+    }
+}
+
+UniValue AssetBookDepth(uint256 tokenid,int32_t side,int32_t start,int32_t count)
+{
+    UniValue result(UniValue::VOBJ),bids(UniValue::VARR),asks(UniValue::VARR); const CAssetBook *book=0,*pending=0; char str[65];
+    std::map<uint256,CAssetBook>::const_iterator bi;
+    LOCK2(cs_main,mempool.cs);
+    AssetsBookInit();
+    AssetsBookSyncMempool();
+    if ( (bi= ASSETS_BOOK.books.find(tokenid)) != ASSETS_BOOK.books.end() )
+        book = &bi->second;
+    if ( (bi= ASSETS_MEMPOOLBOOK.books.find(tokenid)) != ASSETS_MEMPOOLBOOK.books.end() )
+        pending = &bi->second;
+    result.push_back(Pair("result","success"));
+    result.push_back(Pair("tokenid",uint256_str(str,tokenid)));
+    result.push_back(Pair("height",(int64_t)chainActive.Height()));
+    if ( side >= 0 )
+    {
+        AssetsBookSide(bids,book != 0 ? &book->bids : 0,pending != 0 ? &pending->bids : 0,start,count);
+        result.push_back(Pair("bids",bids));
+        result.push_back(Pair("numbids",(int64_t)((book != 0 ? book->bids.size() : 0) + (pending != 0 ? pending->bids.size() : 0))));
+    }
+    if ( side <= 0 )
+    {
+        AssetsBookSide(asks,book != 0 ? &book->asks : 0,pending != 0 ? &pending->asks : 0,start,count);
+        result.push_back(Pair("asks",asks));
+        result.push_back(Pair("numasks",(int64_t)((book != 0 ? book->asks.size() : 0) + (pending != 0 ? pending->asks.size() : 0))));
+    }
+    result.push_back(Pair("start",(int64_t)start));
+    result.push_back(Pair("count",(int64_t)count));
+    return(result);
+}
+
+UniValue AssetBestPrice(uint256 tokenid)
+{
+    UniValue result(UniValue::VOBJ),bids(UniValue::VARR),asks(UniValue::VARR),depth; double bid=0.,ask=0.; char numstr[32];
+    depth = AssetBookDepth(tokenid,0,0,1);
+    result.push_back(Pair("result","success"));
+    result.push_back(Pair("tokenid",find_value(depth,"tokenid")));
+    result.push_back(Pair("height",find_value(depth,"height")));
+    bids = find_value(depth,"bids").get_array();
+    asks = find_value(depth,"asks").get_array();
+    if ( bids.size() > 0 )
+    {
+        result.push_back(Pair("bestbid",bids[0]));
+        bid = atof(find_value(bids[0],"price").get_str().c_str());
+    }
+    if ( asks.size() > 0 )
+    {
+        result.push_back(Pair("bestask",asks[0]));
+        ask = atof(find_value(asks[0],"price").get_str().c_str());
+    }
+    if ( bid > 0. && ask > 0. )
+    {
+        sprintf(numstr,"%.8f",ask - bid);
+        result.push_back(Pair("spread",numstr));
+    }
+    return(result);
+}
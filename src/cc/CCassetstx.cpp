@@ -105,81 +105,8 @@ UniValue AssetList()
 
 UniValue AssetOrders(uint256 refassetid)
 {
-    static uint256 zero;
-    int64_t price; uint256 txid,hashBlock,assetid,assetid2; std::vector<uint8_t> origpubkey; CTransaction vintx; UniValue result(UniValue::VARR);  std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs; uint8_t funcid; char numstr[32],funcidstr[16],origaddr[64],assetidstr[65]; struct CCcontract_info *cp,C;
-    cp = CCinit(&C,EVAL_ASSETS);
-    SetCCunspents(unspentOutputs,(char *)cp->unspendableCCaddr);
-    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
-    {
-        txid = it->first.txhash;
-        if ( GetTransaction(txid,vintx,hashBlock,false) != 0 )
-        {
-            if ( vintx.vout.size() > 0 && (funcid= DecodeAssetOpRet(vintx.vout[vintx.vout.size()-1].scriptPubKey,assetid,assetid2,price,origpubkey)) != 0 )
-            {
-                if ( refassetid != zero && assetid != refassetid )
-                {
-                    //int32_t z;
-                    //for (z=31; z>=0; z--) fprintf(stderr,"%02x",((uint8_t *)&txid)[z]);
-                    //fprintf(stderr," txid\n");
-                    //for (z=31; z>=0; z--) fprintf(stderr,"%02x",((uint8_t *)&assetid)[z]);
-                    //fprintf(stderr," assetid\n");
-                    //for (z=31; z>=0; z--) fprintf(stderr,"%02x",((uint8_t *)&refassetid)[z]);
-                    //fprintf(stderr," refassetid\n");
-                    continue;
-                }
-                if ( vintx.vout[it->first.index].nValue == 0 )
-                    continue;
-                UniValue item(UniValue::VOBJ);
-                funcidstr[0] = funcid;
-                funcidstr[1] = 0;
-                item.push_back(Pair("funcid", funcidstr));
-                item.push_back(Pair("txid", uint256_str(assetidstr,txid)));
-                item.push_back(Pair("vout", (int64_t)it->first.index));
-                if ( funcid == 'b' || funcid == 'B' )
-                {
-                    sprintf(numstr,"%.8f",(double)vintx.vout[it->first.index].nValue/COIN);
-                    item.push_back(Pair("amount",numstr));
-                    sprintf(numstr,"%.8f",(double)vintx.vout[0].nValue/COIN);
-                    item.push_back(Pair("bidamount",numstr));
-                }
-                else
-                {
-                    sprintf(numstr,"%llu",(long long)vintx.vout[it->first.index].nValue);
-                    item.push_back(Pair("amount",numstr));
-                    sprintf(numstr,"%llu",(long long)vintx.vout[0].nValue);
-                    item.push_back(Pair("askamount",numstr));
-                }
-                if ( origpubkey.size() == 33 )
-                {
-                    GetCCaddress(cp,origaddr,pubkey2pk(origpubkey));
-                    item.push_back(Pair("origaddress",origaddr));
-                }
-                if ( assetid != zeroid )
-                    item.push_back(Pair("tokenid",uint256_str(assetidstr,assetid)));
-                if ( assetid2 != zeroid )
-                    item.push_back(Pair("otherid",uint256_str(assetidstr,assetid2)));
-                if ( price > 0 )
-                {
-                    if ( funcid == 's' || funcid == 'S' || funcid == 'e' || funcid == 'e' )
-                    {
-                        sprintf(numstr,"%.8f",(double)price / COIN);
-                        item.push_back(Pair("totalrequired", numstr));
-                        sprintf(numstr,"%.8f",(double)price / (COIN * vintx.vout[0].nValue));
-                        item.push_back(Pair("price", numstr));
-                    }
-                    else
-                    {
-                        item.push_back(Pair("totalrequired", (int64_t)price));
-                        sprintf(numstr,"%.8f",(double)vintx.vout[0].nValue / (price * COIN));
-                        item.push_back(Pair("price",numstr));
-                    }
-                }
-                result.push_back(item);
-                //fprintf(stderr,"func.(%c) %s/v%d %.8f\n",funcid,uint256_str(assetidstr,txid),(int32_t)it->first.index,(double)vintx.vout[it->first.index].nValue/COIN);
-            }
-        }
-    }
-    return(result);
+    // served from the in-memory order book, see CCassetsbook.cpp
+    return(AssetBookOrders(refassetid));
 }
 
 std::string CreateAsset(int64_t txfee,int64_t assetsupply,std::string name,std::string description)
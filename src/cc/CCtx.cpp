@@ -192,6 +192,31 @@ void SetCCunspents(std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValu
     }
 }
 
+void SetCCunspentsRef(std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,char *coinaddr,uint8_t evalcode,uint256 reftxid)
+{
+    int32_t type=0,i,n; char *ptr; std::string addrstr; uint160 hashBytes; std::vector<std::pair<CCCIndexKey, CCCIndexValue> > ccOutputs;
+    if ( GetCCIndexUnspent(evalcode,reftxid,0,ccOutputs) == 0 ) // -ccindex not enabled, scan the whole address
+    {
+        SetCCunspents(unspentOutputs,coinaddr);
+        return;
+    }
+    n = (int32_t)strlen(coinaddr);
+    addrstr.resize(n+1);
+    ptr = (char *)addrstr.data();
+    for (i=0; i<=n; i++)
+        ptr[i] = coinaddr[i];
+    CBitcoinAddress address(addrstr);
+    if ( address.GetIndexKey(hashBytes, type) == 0 )
+        return;
+    for (std::vector<std::pair<CCCIndexKey, CCCIndexValue> >::const_iterator it=ccOutputs.begin(); it!=ccOutputs.end(); it++)
+    {
+        const CScript &script = it->second.script;
+        if ( Hash160(std::vector<unsigned char>(script.begin(),script.end())) != hashBytes )
+            continue;
+        unspentOutputs.push_back(std::make_pair(CAddressUnspentKey(type,hashBytes,it->first.txhash,it->first.index),CAddressUnspentValue(it->second.satoshis,script,it->second.blockHeight)));
+    }
+}
+
 void SetCCtxids(std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,char *coinaddr)
 {
     int32_t type=0,i,n; char *ptr; std::string addrstr; uint160 hashBytes; std::vector<std::pair<uint160, int> > addresses;
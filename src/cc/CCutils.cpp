@@ -410,3 +410,49 @@ int64_t CCduration(int32_t &numblocks,uint256 txid)
     return(duration);
 }
 
+
+uint8_t CCindexDecodeOpRet(uint256 txid,const CScript &scriptPubKey,uint8_t &evalcode,uint256 &reftxid)
+{
+    // maps a contract opreturn to the txid that ties its outputs together for -ccindex
+    std::vector<uint8_t> vopret; uint8_t funcid = 0; uint64_t sbits; std::string coin;
+    evalcode = 0;
+    reftxid = txid;
+    GetOpReturnData(scriptPubKey,vopret);
+    if ( vopret.size() < 2 )
+        return(0);
+    evalcode = vopret[0];
+    funcid = vopret[1];
+    try
+    {
+        CDataStream ss(std::vector<uint8_t>(vopret.begin()+2,vopret.end()),SER_NETWORK,PROTOCOL_VERSION);
+        switch ( evalcode )
+        {
+            case EVAL_ASSETS:
+                if ( funcid != 'c' )
+                {
+                    ss >> reftxid;
+                    reftxid = revuint256(reftxid);
+                }
+                break;
+            case EVAL_DICE: case EVAL_REWARDS:
+                if ( funcid != 'F' )
+                    ss >> sbits >> reftxid;
+                break;
+            case EVAL_ORACLES:
+                if ( funcid != 'C' )
+                    ss >> reftxid;
+                break;
+            case EVAL_GATEWAYS:
+                if ( funcid != 'B' )
+                    ss >> coin >> reftxid;
+                break;
+        }
+    }
+    catch (const std::exception &e)
+    {
+        reftxid = txid;
+    }
+    if ( reftxid == zeroid )
+        reftxid = txid;
+    return(funcid);
+}
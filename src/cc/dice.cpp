@@ -90,6 +90,7 @@ WARNING: there is an attack vector that precludes betting any large amounts, it
 #include "../compat/endian.h"
 
 static uint256 bettxids[128];
+static pthread_mutex_t bettxids_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 struct dicefinish_info
 {
@@ -123,6 +124,7 @@ void *dicefinish(void *_ptr)
     char str[65],str2[65],name[32]; std::string res; int32_t i,result,duplicate=0; struct dicefinish_info *ptr;
     ptr = (struct dicefinish_info *)_ptr;
     sleep(3); // wait for bettxid to be in mempool
+    pthread_mutex_lock(&bettxids_mutex);
     for (i=0; i<sizeof(bettxids)/sizeof(*bettxids); i++)
         if ( bettxids[i] == ptr->bettxid )
         {
@@ -140,6 +142,7 @@ void *dicefinish(void *_ptr)
         if ( i == sizeof(bettxids)/sizeof(*bettxids) )
             bettxids[rand() % i] = ptr->bettxid;
     }
+    pthread_mutex_unlock(&bettxids_mutex);
     unstringbits(name,ptr->sbits);
     //fprintf(stderr,"duplicate.%d dicefinish.%d %s funding.%s bet.%s\n",duplicate,ptr->iswin,name,uint256_str(str,ptr->fundingtxid),uint256_str(str2,ptr->bettxid));
     if ( duplicate == 0 )
@@ -670,7 +673,7 @@ int64_t DicePlanFunds(uint64_t &entropyval,uint256 &entropytxid,uint64_t refsbit
         fundingPubKey = tx.vout[1].scriptPubKey;
     } else return(0);
     GetCCaddress(cp,coinaddr,dicepk);
-    SetCCunspents(unspentOutputs,coinaddr);
+    SetCCunspentsRef(unspentOutputs,coinaddr,EVAL_DICE,reffundingtxid);
     entropyval = 0;
     for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
     {
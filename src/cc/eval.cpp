@@ -30,14 +30,16 @@
 
 Eval* EVAL_TEST = 0;
 struct CCcontract_info CCinfos[0x100];
-extern pthread_mutex_t KOMODO_CC_mutex;
+static pthread_mutex_t CCinfos_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+/*
+ * Eval has no shared state, so this can run concurrently from the mempool
+ * and from the script check threads
+ */
 bool RunCCEval(const CC *cond, const CTransaction &tx, unsigned int nIn)
 {
     EvalRef eval;
-    pthread_mutex_lock(&KOMODO_CC_mutex);
     bool out = eval->Dispatch(cond, tx, nIn);
-    pthread_mutex_unlock(&KOMODO_CC_mutex);
     //fprintf(stderr,"out %d vs %d isValid\n",(int32_t)out,(int32_t)eval->state.IsValid());
     assert(eval->state.IsValid() == out);
 
@@ -59,17 +61,25 @@ bool RunCCEval(const CC *cond, const CTransaction &tx, unsigned int nIn)
  */
 bool Eval::Dispatch(const CC *cond, const CTransaction &txTo, unsigned int nIn)
 {
-    struct CCcontract_info *cp;
+    struct CCcontract_info *cp,C;
     if (cond->codeLength == 0)
         return Invalid("empty-eval");
 
     uint8_t ecode = cond->code[0];
     cp = &CCinfos[(int32_t)ecode];
-    if ( cp->didinit == 0 )
+    if ( __atomic_load_n(&cp->didinit,__ATOMIC_ACQUIRE) == 0 )
     {
-        CCinit(cp,ecode);
-        cp->didinit = 1;
+        pthread_mutex_lock(&CCinfos_mutex);
+        if ( cp->didinit == 0 )
+        {
+            CCinit(cp,ecode);
+            __atomic_store_n(&cp->didinit,1,__ATOMIC_RELEASE);
+        }
+        pthread_mutex_unlock(&CCinfos_mutex);
     }
+    // validators set evalcode2/unspendableaddr2 etc, so every Eval works on its own copy
+    C = *cp;
+    cp = &C;
     std::vector<uint8_t> vparams(cond->code+1, cond->code+cond->codeLength);
     switch ( ecode )
     {
@@ -818,6 +818,7 @@ UniValue GatewaysPendingWithdraws(uint256 bindtxid,std::string refcoin)
             break;
         }
     Getscriptaddress(withmarker,CScript() << ParseHex(HexStr(gatewayspk)) << OP_CHECKSIG);
+    // withdraw markers are plain pay-to-pubkey outputs, which -ccindex does not cover
     SetCCunspents(unspentOutputs,withmarker);
     numqueued = 0;
     for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
@@ -163,11 +163,13 @@ uint8_t DecodeOraclesData(const CScript &scriptPubKey,uint256 &oracletxid,uint25
 
 CPubKey OracleBatonPk(char *batonaddr,struct CCcontract_info *cp)
 {
-    static secp256k1_context *ctx;
+    static secp256k1_context *ctx; static pthread_mutex_t ctx_mutex = PTHREAD_MUTEX_INITIALIZER;
     size_t clen = CPubKey::PUBLIC_KEY_SIZE;
     secp256k1_pubkey pubkey; CPubKey batonpk; uint8_t priv[32]; int32_t i;
+    pthread_mutex_lock(&ctx_mutex);
     if ( ctx == 0 )
         ctx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN);
+    pthread_mutex_unlock(&ctx_mutex);
     Myprivkey(priv);
     cp->evalcode2 = EVAL_ORACLES;
     for (i=0; i<32; i++)
@@ -254,7 +256,7 @@ uint256 OracleBatonUtxo(uint64_t txfee,struct CCcontract_info *cp,uint256 refora
 {
     uint256 txid,oracletxid,hashBlock,btxid,batontxid = zeroid; int64_t dfee; int32_t dheight=0,vout,height,numvouts; CTransaction tx; CPubKey pk; uint8_t *ptr; std::vector<uint8_t> vopret,data;
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
-    SetCCunspents(unspentOutputs,batonaddr);
+    SetCCunspentsRef(unspentOutputs,batonaddr,EVAL_ORACLES,reforacletxid);
     for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
     {
         txid = it->first.txhash;
@@ -489,6 +491,7 @@ int64_t OraclePrice(int32_t height,uint256 reforacletxid,char *markeraddr,char *
     if ( format[0] != 'L' )
         return(0);
     cp = CCinit(&C,EVAL_ORACLES);
+    // registration markers are plain pay-to-pubkey outputs, which -ccindex does not cover; the per-publisher baton lookup below uses it
     SetCCunspents(unspentOutputs,markeraddr);
     for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
     {
@@ -4,6 +4,8 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "chain.h"
+#include "main.h"
+#include "txdb.h"
 
 using namespace std;
 
@@ -111,3 +113,32 @@ void CBlockIndex::BuildSkip()
     if (pprev)
         pskip = pprev->GetAncestor(GetSkipHeight(nHeight));
 }
+
+void CBlockIndex::TrimSolution()
+{
+    std::vector<unsigned char>().swap(nSolution);
+}
+
+CBlockHeader CBlockIndex::GetBlockHeader() const
+{
+    CBlockHeader block;
+    block.nVersion       = nVersion;
+    if (pprev)
+        block.hashPrevBlock = pprev->GetBlockHash();
+    block.hashMerkleRoot = hashMerkleRoot;
+    block.hashReserved   = hashReserved;
+    block.nTime          = nTime;
+    block.nBits          = nBits;
+    block.nNonce         = nNonce;
+    if (HasSolution()) {
+        block.nSolution  = nSolution;
+    } else {
+        CDiskBlockIndex dbindex;
+        if (!pblocktree->ReadDiskBlockIndex(GetBlockHash(), dbindex)) {
+            LogPrintf("%s: failed to read index entry of block %s\n", __func__, GetBlockHash().ToString());
+            throw std::runtime_error("Failed to read block index entry");
+        }
+        block.nSolution  = dbindex.nSolution;
+    }
+    return block;
+}
@@ -96,6 +96,8 @@ enum BlockStatus: uint32_t {
     BLOCK_FAILED_MASK        =   BLOCK_FAILED_VALID | BLOCK_FAILED_CHILD,
 
     BLOCK_ACTIVATES_UPGRADE  =   128, //! block activates a network upgrade
+    BLOCK_HAVE_PRODUCER      =   256, //! pubkey33 and notaryid of the coinbase are cached
+    BLOCK_HAVE_SEGID         =   512, //! stakesegid of the staking tx is cached
 };
 
 //! Short-hand for the highest consensus validity we implement.
@@ -121,7 +123,13 @@ public:
 
     //! height of the entry in the chain. The genesis block has height 0
     int nHeight;
-    int64_t newcoins,zfunds; int8_t segid; // jl777 fields
+
+    //! Verification status of this block. See enum BlockStatus
+    unsigned int nStatus;
+
+    //! (memory only) Total amount of work (expected number of hashes) in the chain up to and including this block
+    arith_uint256 nChainWork;
+
     //! Which # file this block is stored in (blk?????.dat)
     int nFile;
 
@@ -131,9 +139,6 @@ public:
     //! Byte offset within rev?????.dat where this block's undo data is stored
     unsigned int nUndoPos;
 
-    //! (memory only) Total amount of work (expected number of hashes) in the chain up to and including this block
-    arith_uint256 nChainWork;
-
     //! Number of transactions in this block.
     //! Note: in a potential headers-first mode, this number cannot be relied upon
     unsigned int nTx;
@@ -143,8 +148,14 @@ public:
     //! Change to 64-bit type when necessary; won't happen before 2030
     unsigned int nChainTx;
 
-    //! Verification status of this block. See enum BlockStatus
-    unsigned int nStatus;
+    //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
+    uint32_t nSequenceId;
+
+    int64_t newcoins,zfunds; int8_t segid; // jl777 fields
+    //! komodo_segid of the staking tx regardless of PoS validation (-1 not a stake), valid with BLOCK_HAVE_SEGID
+    int8_t stakesegid;
+    //! Coinbase P2PK pubkey and its notary id at this height (-1 not a notary, -2 no P2PK coinbase), valid with BLOCK_HAVE_PRODUCER
+    int8_t notaryid; uint8_t pubkey33[33];
 
     //! Branch ID corresponding to the consensus rules used to validate this block.
     //! Only cached if block validity is BLOCK_VALID_CONSENSUS.
@@ -168,21 +179,22 @@ public:
 
     //! block header
     int nVersion;
-    uint256 hashMerkleRoot;
-    uint256 hashReserved;
     unsigned int nTime;
     unsigned int nBits;
+    uint256 hashMerkleRoot;
+    uint256 hashReserved;
     uint256 nNonce;
+    //! Empty once the entry has been written to the block tree db in -compactblockindex mode, see GetBlockHeader
     std::vector<unsigned char> nSolution;
 
-    //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
-    uint32_t nSequenceId;
-    
     void SetNull()
     {
         phashBlock = NULL;
         newcoins = zfunds = 0;
         segid = -2;
+        memset(pubkey33,0,sizeof(pubkey33));
+        notaryid = -1;
+        stakesegid = -2;
         pprev = NULL;
         pskip = NULL;
         nHeight = 0;
@@ -245,21 +257,17 @@ public:
         return ret;
     }
 
-    CBlockHeader GetBlockHeader() const
+    bool HasSolution() const
     {
-        CBlockHeader block;
-        block.nVersion       = nVersion;
-        if (pprev)
-            block.hashPrevBlock = pprev->GetBlockHash();
-        block.hashMerkleRoot = hashMerkleRoot;
-        block.hashReserved   = hashReserved;
-        block.nTime          = nTime;
-        block.nBits          = nBits;
-        block.nNonce         = nNonce;
-        block.nSolution      = nSolution;
-        return block;
+        return !nSolution.empty();
     }
 
+    //! Drop the in-memory Equihash solution, it is read back from the block tree db when needed.
+    //! Called under cs_main, so GetBlockHeader() must be called with cs_main held too.
+    void TrimSolution();
+
+    CBlockHeader GetBlockHeader() const;
+
     uint256 GetBlockHash() const
     {
         return *phashBlock;
@@ -385,6 +393,15 @@ public:
         if ((nType & SER_DISK) && (nVersion >= SPROUT_VALUE_VERSION)) {
             READWRITE(nSproutValue);
         }
+
+        if (nStatus & BLOCK_HAVE_PRODUCER) {
+            READWRITE(FLATDATA(pubkey33));
+            READWRITE(notaryid);
+        }
+
+        if (nStatus & BLOCK_HAVE_SEGID) {
+            READWRITE(stakesegid);
+        }
     }
 
     uint256 GetBlockHash() const
@@ -157,6 +157,14 @@ public:
             condWorker.notify_all();
     }
 
+    //! Let the worker threads exit once the queue has drained
+    void Quit()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fQuit = true;
+        condWorker.notify_all();
+    }
+
     ~CCheckQueue()
     {
     }
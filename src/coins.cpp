@@ -11,7 +11,9 @@
 #include "komodo_defs.h"
 #include "importcoin.h"
 
+#include <algorithm>
 #include <assert.h>
+#include <iterator>
 
 /**
  * calculate number of bytes for the bitmask, and its number of non-zero bytes
@@ -44,9 +46,52 @@ bool CCoins::Spend(uint32_t nPos)
     Cleanup();
     return true;
 }
+const CTxOut* CCoinsCacheEntry::GetOutput(uint32_t nPos) const
+{
+    if (!(flags & PARTIAL))
+        return coins.IsAvailable(nPos) ? &coins.vout[nPos] : NULL;
+    if (!IsAvailable(nPos))
+        return NULL;
+    std::map<uint32_t, CTxOut>::const_iterator it = mapOutputs.find(nPos);
+    return it == mapOutputs.end() ? NULL : &it->second;
+}
+
+void CCoinsCacheEntry::Spend(uint32_t nPos)
+{
+    if (flags & PARTIAL) {
+        if (nPos < vAvail.size())
+            vAvail[nPos] = false;
+        mapOutputs.erase(nPos);
+    } else {
+        coins.Spend(nPos);
+    }
+}
+
+void CCoinsCacheEntry::MarkOutputDirty(uint32_t nPos)
+{
+    if (vDirtyOutputs.empty() || vDirtyOutputs.back() < nPos) {
+        vDirtyOutputs.push_back(nPos);
+        return;
+    }
+    std::vector<uint32_t>::iterator it = std::lower_bound(vDirtyOutputs.begin(), vDirtyOutputs.end(), nPos);
+    if (*it != nPos)
+        vDirtyOutputs.insert(it, nPos);
+}
+
+void CCoinsCacheEntry::MergeDirtyOutputs(const std::vector<uint32_t> &vOther)
+{
+    if (vOther.empty())
+        return;
+    std::vector<uint32_t> vMerged;
+    vMerged.reserve(vDirtyOutputs.size() + vOther.size());
+    std::set_union(vDirtyOutputs.begin(), vDirtyOutputs.end(), vOther.begin(), vOther.end(), std::back_inserter(vMerged));
+    vDirtyOutputs.swap(vMerged);
+}
+
 bool CCoinsView::GetAnchorAt(const uint256 &rt, ZCIncrementalMerkleTree &tree) const { return false; }
 bool CCoinsView::GetNullifier(const uint256 &nullifier) const { return false; }
 bool CCoinsView::GetCoins(const uint256 &txid, CCoins &coins) const { return false; }
+bool CCoinsView::GetCoinsOutput(const COutPoint &outpoint, CCoinsCacheEntry &entry) const { return GetCoins(outpoint.hash, entry.coins); }
 bool CCoinsView::HaveCoins(const uint256 &txid) const { return false; }
 uint256 CCoinsView::GetBestBlock() const { return uint256(); }
 uint256 CCoinsView::GetBestAnchor() const { return uint256(); };
@@ -63,6 +108,7 @@ CCoinsViewBacked::CCoinsViewBacked(CCoinsView *viewIn) : base(viewIn) { }
 bool CCoinsViewBacked::GetAnchorAt(const uint256 &rt, ZCIncrementalMerkleTree &tree) const { return base->GetAnchorAt(rt, tree); }
 bool CCoinsViewBacked::GetNullifier(const uint256 &nullifier) const { return base->GetNullifier(nullifier); }
 bool CCoinsViewBacked::GetCoins(const uint256 &txid, CCoins &coins) const { return base->GetCoins(txid, coins); }
+bool CCoinsViewBacked::GetCoinsOutput(const COutPoint &outpoint, CCoinsCacheEntry &entry) const { return base->GetCoinsOutput(outpoint, entry); }
 bool CCoinsViewBacked::HaveCoins(const uint256 &txid) const { return base->HaveCoins(txid); }
 uint256 CCoinsViewBacked::GetBestBlock() const { return base->GetBestBlock(); }
 uint256 CCoinsViewBacked::GetBestAnchor() const { return base->GetBestAnchor(); }
@@ -92,8 +138,10 @@ size_t CCoinsViewCache::DynamicMemoryUsage() const {
 
 CCoinsMap::const_iterator CCoinsViewCache::FetchCoins(const uint256 &txid) const {
     CCoinsMap::iterator it = cacheCoins.find(txid);
-    if (it != cacheCoins.end())
+    if (it != cacheCoins.end()) {
+        CompleteCoins(it);
         return it;
+    }
     CCoins tmp;
     if (!base->GetCoins(txid, tmp))
         return cacheCoins.end();
@@ -104,10 +152,59 @@ CCoinsMap::const_iterator CCoinsViewCache::FetchCoins(const uint256 &txid) const
         // version as fresh.
         ret->second.flags = CCoinsCacheEntry::FRESH;
     }
-    cachedCoinsUsage += ret->second.coins.DynamicMemoryUsage();
+    cachedCoinsUsage += ret->second.DynamicMemoryUsage();
     return ret;
 }
 
+CCoinsMap::iterator CCoinsViewCache::FetchOutput(const COutPoint &outpoint) const {
+    CCoinsMap::iterator it = cacheCoins.find(outpoint.hash);
+    if (it == cacheCoins.end()) {
+        it = cacheCoins.insert(std::make_pair(outpoint.hash, CCoinsCacheEntry())).first;
+        if (!base->GetCoinsOutput(outpoint, it->second)) {
+            cacheCoins.erase(it);
+            return cacheCoins.end();
+        }
+        if (!(it->second.flags & CCoinsCacheEntry::PARTIAL) && it->second.coins.IsPruned()) {
+            // The parent only has an empty entry for this txid; we can consider our
+            // version as fresh.
+            it->second.flags = CCoinsCacheEntry::FRESH;
+        }
+        cachedCoinsUsage += it->second.DynamicMemoryUsage();
+    } else if (it->second.IsAvailable(outpoint.n) && !it->second.GetOutput(outpoint.n)) {
+        // An unspent output of a PARTIAL entry that was not loaded yet
+        CCoinsCacheEntry entry;
+        const CTxOut *txout = base->GetCoinsOutput(outpoint, entry) ? entry.GetOutput(outpoint.n) : NULL;
+        assert(txout);
+        cachedCoinsUsage -= it->second.DynamicMemoryUsage();
+        it->second.mapOutputs[outpoint.n] = *txout;
+        cachedCoinsUsage += it->second.DynamicMemoryUsage();
+    }
+    return it;
+}
+
+void CCoinsViewCache::CompleteCoins(CCoinsMap::iterator it) const {
+    CCoinsCacheEntry &entry = it->second;
+    if (!(entry.flags & CCoinsCacheEntry::PARTIAL))
+        return;
+    CCoins coins;
+    if (!base->GetCoins(it->first, coins)) {
+        // Only a pruned entry may be gone from the base
+        assert(entry.IsPruned());
+        coins = entry.coins;
+    }
+    // The base still has the outputs this view spent
+    for (unsigned int n = 0; n < coins.vout.size(); n++)
+        if (!entry.IsAvailable(n))
+            coins.vout[n].SetNull();
+    coins.Cleanup();
+    cachedCoinsUsage -= entry.DynamicMemoryUsage();
+    entry.coins.swap(coins);
+    std::vector<bool>().swap(entry.vAvail);
+    entry.mapOutputs.clear();
+    entry.flags &= ~CCoinsCacheEntry::PARTIAL;
+    cachedCoinsUsage += entry.DynamicMemoryUsage();
+}
+
 
 bool CCoinsViewCache::GetAnchorAt(const uint256 &rt, ZCIncrementalMerkleTree &tree) const {
     CAnchorsMap::const_iterator it = cacheAnchors.find(rt);
@@ -213,6 +310,21 @@ bool CCoinsViewCache::GetCoins(const uint256 &txid, CCoins &coins) const {
     return false;
 }
 
+bool CCoinsViewCache::GetCoinsOutput(const COutPoint &outpoint, CCoinsCacheEntry &entry) const {
+    CCoinsMap::const_iterator it = FetchOutput(outpoint);
+    if (it == cacheCoins.end())
+        return false;
+    entry.coins = it->second.coins;
+    if (it->second.flags & CCoinsCacheEntry::PARTIAL) {
+        entry.vAvail = it->second.vAvail;
+        const CTxOut *txout = it->second.GetOutput(outpoint.n);
+        if (txout)
+            entry.mapOutputs[outpoint.n] = *txout;
+        entry.flags = CCoinsCacheEntry::PARTIAL;
+    }
+    return true;
+}
+
 CCoinsModifier CCoinsViewCache::ModifyCoins(const uint256 &txid) {
     assert(!hasModifier);
     std::pair<CCoinsMap::iterator, bool> ret = cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry()));
@@ -227,7 +339,8 @@ CCoinsModifier CCoinsViewCache::ModifyCoins(const uint256 &txid) {
             ret.first->second.flags = CCoinsCacheEntry::FRESH;
         }
     } else {
-        cachedCoinUsage = ret.first->second.coins.DynamicMemoryUsage();
+        CompleteCoins(ret.first);
+        cachedCoinUsage = ret.first->second.DynamicMemoryUsage();
     }
     // Assume that whenever ModifyCoins is called, the entry will be modified.
     ret.first->second.flags |= CCoinsCacheEntry::DIRTY;
@@ -243,8 +356,52 @@ const CCoins* CCoinsViewCache::AccessCoins(const uint256 &txid) const {
     }
 }
 
+const CTxOut* CCoinsViewCache::AccessOutput(const COutPoint &outpoint, int *pnHeight, bool *pfCoinBase) const {
+    CCoinsMap::const_iterator it = FetchOutput(outpoint);
+    if (it == cacheCoins.end())
+        return NULL;
+    const CTxOut *txout = it->second.GetOutput(outpoint.n);
+    if (txout) {
+        if (pnHeight)
+            *pnHeight = it->second.coins.nHeight;
+        if (pfCoinBase)
+            *pfCoinBase = it->second.coins.fCoinBase;
+    }
+    return txout;
+}
+
+bool CCoinsViewCache::SpendOutput(const COutPoint &outpoint, CTxInUndo *undo) {
+    assert(!hasModifier);
+    CCoinsMap::iterator it = FetchOutput(outpoint);
+    if (it == cacheCoins.end() || !it->second.IsAvailable(outpoint.n))
+        return false;
+    CCoinsCacheEntry &entry = it->second;
+    cachedCoinsUsage -= entry.DynamicMemoryUsage();
+    if (undo)
+        *undo = CTxInUndo(*entry.GetOutput(outpoint.n));
+    entry.Spend(outpoint.n);
+    if (entry.IsPruned()) {
+        if (undo) {
+            undo->nHeight = entry.coins.nHeight;
+            undo->fCoinBase = entry.coins.fCoinBase;
+            undo->nVersion = entry.coins.nVersion;
+        }
+        if (entry.flags & CCoinsCacheEntry::FRESH) {
+            cacheCoins.erase(it);
+            return true;
+        }
+    }
+    entry.MarkOutputDirty(outpoint.n);
+    entry.flags |= CCoinsCacheEntry::DIRTY;
+    cachedCoinsUsage += entry.DynamicMemoryUsage();
+    return true;
+}
+
 bool CCoinsViewCache::HaveCoins(const uint256 &txid) const {
-    CCoinsMap::const_iterator it = FetchCoins(txid);
+    CCoinsMap::const_iterator it = cacheCoins.find(txid);
+    if (it != cacheCoins.end() && (it->second.flags & CCoinsCacheEntry::PARTIAL))
+        return !it->second.IsPruned();
+    it = FetchCoins(txid);
     // We're using vtx.empty() instead of IsPruned here for performance reasons,
     // as we only care about the case where a transaction was replaced entirely
     // in a reorganization (which wipes vout entirely, as opposed to spending
@@ -278,7 +435,29 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins,
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) { // Ignore non-dirty entries (optimization).
             CCoinsMap::iterator itUs = cacheCoins.find(it->first);
-            if (itUs == cacheCoins.end()) {
+            if (it->second.flags & CCoinsCacheEntry::PARTIAL) {
+                // The child only spent outputs of an entry it read through us.
+                if (itUs == cacheCoins.end()) {
+                    CCoinsCacheEntry& entry = cacheCoins[it->first];
+                    entry.coins.swap(it->second.coins);
+                    entry.vAvail.swap(it->second.vAvail);
+                    entry.mapOutputs.swap(it->second.mapOutputs);
+                    entry.vDirtyOutputs.swap(it->second.vDirtyOutputs);
+                    cachedCoinsUsage += entry.DynamicMemoryUsage();
+                    entry.flags = CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::PARTIAL;
+                } else {
+                    cachedCoinsUsage -= itUs->second.DynamicMemoryUsage();
+                    BOOST_FOREACH(uint32_t n, it->second.vDirtyOutputs)
+                        itUs->second.Spend(n);
+                    if ((itUs->second.flags & CCoinsCacheEntry::FRESH) && itUs->second.IsPruned()) {
+                        cacheCoins.erase(itUs);
+                    } else {
+                        itUs->second.MergeDirtyOutputs(it->second.vDirtyOutputs);
+                        cachedCoinsUsage += itUs->second.DynamicMemoryUsage();
+                        itUs->second.flags |= CCoinsCacheEntry::DIRTY;
+                    }
+                }
+            } else if (itUs == cacheCoins.end()) {
                 if (!it->second.coins.IsPruned()) {
                     // The parent cache does not have an entry, while the child
                     // cache does have (a non-pruned) one. Move the data up, and
@@ -287,7 +466,8 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins,
                     assert(it->second.flags & CCoinsCacheEntry::FRESH);
                     CCoinsCacheEntry& entry = cacheCoins[it->first];
                     entry.coins.swap(it->second.coins);
-                    cachedCoinsUsage += entry.coins.DynamicMemoryUsage();
+                    entry.vDirtyOutputs.swap(it->second.vDirtyOutputs);
+                    cachedCoinsUsage += entry.DynamicMemoryUsage();
                     entry.flags = CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::FRESH;
                 }
             } else {
@@ -295,13 +475,20 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins,
                     // The grandparent does not have an entry, and the child is
                     // modified and being pruned. This means we can just delete
                     // it from the parent.
-                    cachedCoinsUsage -= itUs->second.coins.DynamicMemoryUsage();
+                    cachedCoinsUsage -= itUs->second.DynamicMemoryUsage();
                     cacheCoins.erase(itUs);
                 } else {
-                    // A normal modification.
-                    cachedCoinsUsage -= itUs->second.coins.DynamicMemoryUsage();
+                    // A normal modification. The outputs that differ from the
+                    // grandparent are those we changed plus those the child changed.
+                    cachedCoinsUsage -= itUs->second.DynamicMemoryUsage();
                     itUs->second.coins.swap(it->second.coins);
-                    cachedCoinsUsage += itUs->second.coins.DynamicMemoryUsage();
+                    if (itUs->second.flags & CCoinsCacheEntry::PARTIAL) {
+                        std::vector<bool>().swap(itUs->second.vAvail);
+                        itUs->second.mapOutputs.clear();
+                        itUs->second.flags &= ~CCoinsCacheEntry::PARTIAL;
+                    }
+                    itUs->second.MergeDirtyOutputs(it->second.vDirtyOutputs);
+                    cachedCoinsUsage += itUs->second.DynamicMemoryUsage();
                     itUs->second.flags |= CCoinsCacheEntry::DIRTY;
                 }
             }
@@ -375,9 +562,9 @@ unsigned int CCoinsViewCache::GetCacheSize() const {
 
 const CTxOut &CCoinsViewCache::GetOutputFor(const CTxIn& input) const
 {
-    const CCoins* coins = AccessCoins(input.prevout.hash);
-    assert(coins && coins->IsAvailable(input.prevout.n));
-    return coins->vout[input.prevout.n];
+    const CTxOut* txout = AccessOutput(input.prevout);
+    assert(txout);
+    return *txout;
 }
 
 const CScript &CCoinsViewCache::GetSpendFor(const CTxIn& input) const
@@ -464,8 +651,7 @@ bool CCoinsViewCache::HaveInputs(const CTransaction& tx) const
     if (!tx.IsMint()) {
         for (unsigned int i = 0; i < tx.vin.size(); i++) {
             const COutPoint &prevout = tx.vin[i].prevout;
-            const CCoins* coins = AccessCoins(prevout.hash);
-            if (!coins || !coins->IsAvailable(prevout.n)) {
+            if (!AccessOutput(prevout)) {
                 //fprintf(stderr,"HaveInputs missing input %s/v%d\n",prevout.hash.ToString().c_str(),prevout.n);
                 return false;
             }
@@ -494,11 +680,11 @@ double CCoinsViewCache::GetPriority(const CTransaction &tx, int nHeight) const
     double dResult = 0.0;
     BOOST_FOREACH(const CTxIn& txin, tx.vin)
     {
-        const CCoins* coins = AccessCoins(txin.prevout.hash);
-        assert(coins);
-        if (!coins->IsAvailable(txin.prevout.n)) continue;
-        if (coins->nHeight < nHeight) {
-            dResult += coins->vout[txin.prevout.n].nValue * (nHeight-coins->nHeight);
+        int nPrevHeight;
+        const CTxOut* txout = AccessOutput(txin.prevout, &nPrevHeight);
+        if (!txout) continue;
+        if (nPrevHeight < nHeight) {
+            dResult += txout->nValue * (nHeight-nPrevHeight);
         }
     }
 
@@ -508,6 +694,13 @@ double CCoinsViewCache::GetPriority(const CTransaction &tx, int nHeight) const
 CCoinsModifier::CCoinsModifier(CCoinsViewCache& cache_, CCoinsMap::iterator it_, size_t usage) : cache(cache_), it(it_), cachedCoinUsage(usage) {
     assert(!cache.hasModifier);
     cache.hasModifier = true;
+    const CCoins &coins = it->second.coins;
+    vWasAvailable.resize(coins.vout.size());
+    for (unsigned int i = 0; i < coins.vout.size(); i++)
+        vWasAvailable[i] = !coins.vout[i].IsNull();
+    nHeightBefore = coins.nHeight;
+    nVersionBefore = coins.nVersion;
+    fCoinBaseBefore = coins.fCoinBase;
 }
 
 CCoinsModifier::~CCoinsModifier()
@@ -519,7 +712,18 @@ CCoinsModifier::~CCoinsModifier()
     if ((it->second.flags & CCoinsCacheEntry::FRESH) && it->second.coins.IsPruned()) {
         cache.cacheCoins.erase(it);
     } else {
+        // Record the outputs that were added or spent, or all the remaining
+        // ones if the transaction metadata changed, so the header is rewritten.
+        const CCoins &coins = it->second.coins;
+        bool fMetaChanged = coins.nHeight != nHeightBefore || coins.nVersion != nVersionBefore || coins.fCoinBase != fCoinBaseBefore;
+        size_t nOutputs = std::max(vWasAvailable.size(), coins.vout.size());
+        for (size_t i = 0; i < nOutputs; i++) {
+            bool fWasAvailable = i < vWasAvailable.size() && vWasAvailable[i];
+            bool fIsAvailable = coins.IsAvailable(i);
+            if (fWasAvailable != fIsAvailable || (fMetaChanged && fIsAvailable))
+                it->second.MarkOutputDirty(i);
+        }
         // If the coin still exists after the modification, add the new usage
-        cache.cachedCoinsUsage += it->second.coins.DynamicMemoryUsage();
+        cache.cachedCoinsUsage += it->second.DynamicMemoryUsage();
     }
 }
@@ -13,7 +13,9 @@
 #include "memusage.h"
 #include "serialize.h"
 #include "uint256.h"
+#include "undo.h"
 
+#include <algorithm>
 #include <assert.h>
 #include <stdint.h>
 
@@ -291,13 +293,47 @@ struct CCoinsCacheEntry
 {
     CCoins coins; // The actual cached data.
     unsigned char flags;
+    std::vector<uint32_t> vDirtyOutputs; // Sorted indices of the outputs that potentially differ from the parent view.
+    // Only for PARTIAL entries, which leave coins.vout empty:
+    std::vector<bool> vAvail; // Which outputs are unspent in this view.
+    std::map<uint32_t, CTxOut> mapOutputs; // The unspent outputs loaded so far.
 
     enum Flags {
         DIRTY = (1 << 0), // This cache entry is potentially different from the version in the parent view.
         FRESH = (1 << 1), // The parent view does not have this entry (or it is pruned).
+        PARTIAL = (1 << 2), // Only some outputs of the transaction are loaded; the only changes are spends.
     };
 
     CCoinsCacheEntry() : coins(), flags(0) {}
+
+    bool IsAvailable(uint32_t nPos) const {
+        if (flags & PARTIAL)
+            return nPos < vAvail.size() && vAvail[nPos];
+        return coins.IsAvailable(nPos);
+    }
+
+    bool IsPruned() const {
+        if (flags & PARTIAL)
+            return std::find(vAvail.begin(), vAvail.end(), true) == vAvail.end();
+        return coins.IsPruned();
+    }
+
+    //! Return the output if it is unspent and loaded, NULL otherwise
+    const CTxOut* GetOutput(uint32_t nPos) const;
+
+    //! Mark an output spent, without tracking it as dirty
+    void Spend(uint32_t nPos);
+
+    void MarkOutputDirty(uint32_t nPos);
+    void MergeDirtyOutputs(const std::vector<uint32_t> &vOther);
+
+    size_t DynamicMemoryUsage() const {
+        size_t ret = coins.DynamicMemoryUsage() + memusage::DynamicUsage(vDirtyOutputs) +
+                     memusage::DynamicUsage(vAvail) + memusage::DynamicUsage(mapOutputs);
+        for (std::map<uint32_t, CTxOut>::const_iterator it = mapOutputs.begin(); it != mapOutputs.end(); it++)
+            ret += RecursiveDynamicUsage(it->second.scriptPubKey);
+        return ret;
+    }
 };
 
 struct CAnchorsCacheEntry
@@ -356,6 +392,10 @@ public:
     //! Retrieve the CCoins (unspent transaction outputs) for a given txid
     virtual bool GetCoins(const uint256 &txid, CCoins &coins) const;
 
+    //! Retrieve the metadata of a txid's coins and the given output, if unspent,
+    //! into an empty entry: either the whole CCoins or a PARTIAL entry
+    virtual bool GetCoinsOutput(const COutPoint &outpoint, CCoinsCacheEntry &entry) const;
+
     //! Just check whether we have data for a given txid.
     //! This may (but cannot always) return true for fully spent transactions
     virtual bool HaveCoins(const uint256 &txid) const;
@@ -367,6 +407,7 @@ public:
     virtual uint256 GetBestAnchor() const;
 
     //! Do a bulk modification (multiple CCoins changes + BestBlock change).
+    //! Only the outputs listed in an entry's vDirtyOutputs need to be written.
     //! The passed mapCoins can be modified.
     virtual bool BatchWrite(CCoinsMap &mapCoins,
                             const uint256 &hashBlock,
@@ -393,6 +434,7 @@ public:
     bool GetAnchorAt(const uint256 &rt, ZCIncrementalMerkleTree &tree) const;
     bool GetNullifier(const uint256 &nullifier) const;
     bool GetCoins(const uint256 &txid, CCoins &coins) const;
+    bool GetCoinsOutput(const COutPoint &outpoint, CCoinsCacheEntry &entry) const;
     bool HaveCoins(const uint256 &txid) const;
     uint256 GetBestBlock() const;
     uint256 GetBestAnchor() const;
@@ -418,7 +460,12 @@ class CCoinsModifier
 private:
     CCoinsViewCache& cache;
     CCoinsMap::iterator it;
-    size_t cachedCoinUsage; // Cached memory usage of the CCoins object before modification
+    size_t cachedCoinUsage; // Cached memory usage of the cache entry before modification
+    // State before modification, to find the outputs that changed
+    std::vector<bool> vWasAvailable;
+    int nHeightBefore;
+    int nVersionBefore;
+    bool fCoinBaseBefore;
     CCoinsModifier(CCoinsViewCache& cache_, CCoinsMap::iterator it_, size_t usage);
 
 public:
@@ -457,6 +504,7 @@ public:
     bool GetAnchorAt(const uint256 &rt, ZCIncrementalMerkleTree &tree) const;
     bool GetNullifier(const uint256 &nullifier) const;
     bool GetCoins(const uint256 &txid, CCoins &coins) const;
+    bool GetCoinsOutput(const COutPoint &outpoint, CCoinsCacheEntry &entry) const;
     bool HaveCoins(const uint256 &txid) const;
     uint256 GetBestBlock() const;
     uint256 GetBestAnchor() const;
@@ -493,6 +541,20 @@ public:
      */
     CCoinsModifier ModifyCoins(const uint256 &txid);
 
+    /**
+     * Return a pointer to an unspent output in the cache, or NULL if it is
+     * spent or unknown. Unlike AccessCoins, this only loads the requested
+     * output of a transaction whose outputs are stored apart in the base.
+     */
+    const CTxOut* AccessOutput(const COutPoint &outpoint, int *pnHeight = NULL, bool *pfCoinBase = NULL) const;
+
+    /**
+     * Mark an unspent output spent, returning false if it is not available.
+     * If undo is given, it receives the output, and the transaction metadata
+     * when this was its last unspent output.
+     */
+    bool SpendOutput(const COutPoint &outpoint, CTxInUndo *undo = NULL);
+
     /**
      * Push the modifications applied to this cache to its base.
      * Failure to call this method before destruction will cause the changes to be forgotten.
@@ -533,6 +595,9 @@ public:
 private:
     CCoinsMap::iterator FetchCoins(const uint256 &txid);
     CCoinsMap::const_iterator FetchCoins(const uint256 &txid) const;
+    CCoinsMap::iterator FetchOutput(const COutPoint &outpoint) const;
+    //! Load the remaining outputs of a PARTIAL entry from the base
+    void CompleteCoins(CCoinsMap::iterator it) const;
 
     /**
      * By making the copy constructor private, we prevent accidentally using it when one intends to create a cache on top of a base cache.
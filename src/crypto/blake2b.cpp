@@ -0,0 +1,250 @@
+// Copyright (c) 2018 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypto/blake2b.h"
+
+#include "crypto/common.h"
+
+#include <algorithm>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define BLAKE2B_USE_AVX2 1
+#include <immintrin.h>
+#endif
+
+// Internal implementation code.
+namespace
+{
+/// Internal BLAKE2b implementation.
+namespace blake2b
+{
+const uint64_t IV[8] = {
+    0x6a09e667f3bcc908ull, 0xbb67ae8584caa73bull,
+    0x3c6ef372fe94f82bull, 0xa54ff53a5f1d36f1ull,
+    0x510e527fade682d1ull, 0x9b05688c2b3e6c1full,
+    0x1f83d9abfb41bd6bull, 0x5be0cd19137e2179ull
+};
+
+const uint8_t SIGMA[12][16] = {
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 },
+    { 11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4 },
+    {  7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8 },
+    {  9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13 },
+    {  2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9 },
+    { 12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11 },
+    { 13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10 },
+    {  6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5 },
+    { 10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13,  0 },
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 }
+};
+
+uint64_t inline Rotr(uint64_t x, int n) { return (x >> n) | (x << (64 - n)); }
+
+/** The BLAKE2b mixing function. */
+void inline G(uint64_t& a, uint64_t& b, uint64_t& c, uint64_t& d, uint64_t x, uint64_t y)
+{
+    a = a + b + x;
+    d = Rotr(d ^ a, 32);
+    c = c + d;
+    b = Rotr(b ^ c, 24);
+    a = a + b + y;
+    d = Rotr(d ^ a, 16);
+    c = c + d;
+    b = Rotr(b ^ c, 63);
+}
+
+/** Compress one block; t is the number of message bytes up to and including it. */
+void Compress(uint64_t* h, const unsigned char* block, uint64_t t, bool fLast)
+{
+    uint64_t m[16];
+    uint64_t v[16];
+    for (int i = 0; i < 16; i++)
+        m[i] = ReadLE64(block + 8 * i);
+    for (int i = 0; i < 8; i++) {
+        v[i] = h[i];
+        v[i + 8] = IV[i];
+    }
+    v[12] ^= t;
+    if (fLast)
+        v[14] = ~v[14];
+
+    for (int r = 0; r < 12; r++) {
+        const uint8_t* s = SIGMA[r];
+        G(v[0], v[4], v[8],  v[12], m[s[0]],  m[s[1]]);
+        G(v[1], v[5], v[9],  v[13], m[s[2]],  m[s[3]]);
+        G(v[2], v[6], v[10], v[14], m[s[4]],  m[s[5]]);
+        G(v[3], v[7], v[11], v[15], m[s[6]],  m[s[7]]);
+        G(v[0], v[5], v[10], v[15], m[s[8]],  m[s[9]]);
+        G(v[1], v[6], v[11], v[12], m[s[10]], m[s[11]]);
+        G(v[2], v[7], v[8],  v[13], m[s[12]], m[s[13]]);
+        G(v[3], v[4], v[9],  v[14], m[s[14]], m[s[15]]);
+    }
+
+    for (int i = 0; i < 8; i++)
+        h[i] ^= v[i] ^ v[i + 8];
+}
+
+void inline Output(const uint64_t* h, unsigned char* out, size_t outlen)
+{
+    unsigned char full[64];
+    for (int i = 0; i < 8; i++)
+        WriteLE64(full + 8 * i, h[i]);
+    memcpy(out, full, outlen);
+}
+
+#ifdef BLAKE2B_USE_AVX2
+#define ROTR4(x, n) _mm256_or_si256(_mm256_srli_epi64((x), (n)), _mm256_slli_epi64((x), 64 - (n)))
+#define G4(a, b, c, d, x, y) do { \
+    a = _mm256_add_epi64(_mm256_add_epi64(a, b), x); \
+    d = ROTR4(_mm256_xor_si256(d, a), 32); \
+    c = _mm256_add_epi64(c, d); \
+    b = ROTR4(_mm256_xor_si256(b, c), 24); \
+    a = _mm256_add_epi64(_mm256_add_epi64(a, b), y); \
+    d = ROTR4(_mm256_xor_si256(d, a), 16); \
+    c = _mm256_add_epi64(c, d); \
+    b = ROTR4(_mm256_xor_si256(b, c), 63); \
+} while (0)
+
+/**
+ * Compress the final blocks of four messages that share the chaining value
+ * h, one message per 64-bit lane.  hOut receives the four chaining values.
+ */
+__attribute__((target("avx2")))
+void CompressFinal4AVX2(const uint64_t* h, const unsigned char* const block[4], uint64_t t, uint64_t hOut[4][8])
+{
+    __m256i m[16];
+    __m256i v[16];
+    for (int i = 0; i < 16; i++)
+        m[i] = _mm256_set_epi64x(ReadLE64(block[3] + 8 * i), ReadLE64(block[2] + 8 * i),
+                                 ReadLE64(block[1] + 8 * i), ReadLE64(block[0] + 8 * i));
+    for (int i = 0; i < 8; i++) {
+        v[i] = _mm256_set1_epi64x(h[i]);
+        v[i + 8] = _mm256_set1_epi64x(IV[i]);
+    }
+    v[12] = _mm256_set1_epi64x(IV[4] ^ t);
+    v[14] = _mm256_set1_epi64x(~IV[6]);
+
+    for (int r = 0; r < 12; r++) {
+        const uint8_t* s = SIGMA[r];
+        G4(v[0], v[4], v[8],  v[12], m[s[0]],  m[s[1]]);
+        G4(v[1], v[5], v[9],  v[13], m[s[2]],  m[s[3]]);
+        G4(v[2], v[6], v[10], v[14], m[s[4]],  m[s[5]]);
+        G4(v[3], v[7], v[11], v[15], m[s[6]],  m[s[7]]);
+        G4(v[0], v[5], v[10], v[15], m[s[8]],  m[s[9]]);
+        G4(v[1], v[6], v[11], v[12], m[s[10]], m[s[11]]);
+        G4(v[2], v[7], v[8],  v[13], m[s[12]], m[s[13]]);
+        G4(v[3], v[4], v[9],  v[14], m[s[14]], m[s[15]]);
+    }
+
+    for (int i = 0; i < 8; i++) {
+        uint64_t lanes[4];
+        __m256i x = _mm256_xor_si256(_mm256_set1_epi64x(h[i]), _mm256_xor_si256(v[i], v[i + 8]));
+        _mm256_storeu_si256((__m256i*)lanes, x);
+        for (int j = 0; j < 4; j++)
+            hOut[j][i] = lanes[j];
+    }
+}
+
+#undef G4
+#undef ROTR4
+
+bool DetectAVX2()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+#endif
+
+} // namespace blake2b
+
+} // namespace
+
+bool Blake2bHaveAVX2()
+{
+#ifdef BLAKE2B_USE_AVX2
+    static const bool fHaveAVX2 = blake2b::DetectAVX2();
+    return fHaveAVX2;
+#else
+    return false;
+#endif
+}
+
+////// CBlake2bIndexHasher
+
+CBlake2bIndexHasher::CBlake2bIndexHasher(size_t outlenIn, const unsigned char personal[PERSONAL_SIZE]) : buflen(0), bytes(0), outlen(outlenIn)
+{
+    assert(outlen > 0 && outlen <= MAX_OUTPUT_SIZE);
+    // Parameter block: digest length, no key, fanout 1, depth 1, no salt
+    for (int i = 0; i < 8; i++)
+        h[i] = blake2b::IV[i];
+    h[0] ^= 0x01010000ull | outlen;
+    h[6] ^= ReadLE64(personal);
+    h[7] ^= ReadLE64(personal + 8);
+}
+
+CBlake2bIndexHasher& CBlake2bIndexHasher::Write(const unsigned char* data, size_t len)
+{
+    // An index always follows the prefix, so a full buffer is never the
+    // final block and can be compressed straight away.
+    while (len > 0) {
+        size_t n = std::min(len, BLOCK_SIZE - buflen);
+        memcpy(buf + buflen, data, n);
+        buflen += n;
+        data += n;
+        len -= n;
+        if (buflen == BLOCK_SIZE) {
+            bytes += BLOCK_SIZE;
+            blake2b::Compress(h, buf, bytes, false);
+            buflen = 0;
+        }
+    }
+    return *this;
+}
+
+void CBlake2bIndexHasher::Finalize(uint32_t index, unsigned char* out) const
+{
+    uint64_t s[8];
+    memcpy(s, h, sizeof(s));
+    unsigned char block[BLOCK_SIZE] = {};
+    unsigned char le[4];
+    WriteLE32(le, index);
+    memcpy(block, buf, buflen);
+    size_t n = std::min((size_t)4, BLOCK_SIZE - buflen);
+    memcpy(block + buflen, le, n);
+    uint64_t t = bytes + buflen + n;
+    if (n < 4) {
+        // The index straddles two blocks
+        blake2b::Compress(s, block, t, false);
+        memset(block, 0, sizeof(block));
+        memcpy(block, le + n, 4 - n);
+        t += 4 - n;
+    }
+    blake2b::Compress(s, block, t, true);
+    blake2b::Output(s, out, outlen);
+}
+
+void CBlake2bIndexHasher::Finalize4(const uint32_t index[4], unsigned char* const out[4]) const
+{
+#ifdef BLAKE2B_USE_AVX2
+    if (buflen + 4 <= BLOCK_SIZE && Blake2bHaveAVX2()) {
+        unsigned char blocks[4][BLOCK_SIZE] = {};
+        const unsigned char* pblocks[4];
+        for (int i = 0; i < 4; i++) {
+            memcpy(blocks[i], buf, buflen);
+            WriteLE32(blocks[i] + buflen, index[i]);
+            pblocks[i] = blocks[i];
+        }
+        uint64_t s[4][8];
+        blake2b::CompressFinal4AVX2(h, pblocks, bytes + buflen + 4, s);
+        for (int i = 0; i < 4; i++)
+            blake2b::Output(s[i], out[i], outlen);
+        return;
+    }
+#endif
+    for (int i = 0; i < 4; i++)
+        Finalize(index[i], out[i]);
+}
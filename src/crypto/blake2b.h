@@ -0,0 +1,42 @@
+// Copyright (c) 2018 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_BLAKE2B_H
+#define BITCOIN_CRYPTO_BLAKE2B_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * A personalised BLAKE2b hasher for many messages that share a prefix and
+ * differ only in a trailing little-endian 32-bit index, as Equihash hashes
+ * I||V||index.  The prefix is absorbed once; the final blocks of four
+ * indices are then compressed together, with AVX2 when the CPU has it.
+ */
+class CBlake2bIndexHasher
+{
+private:
+    uint64_t h[8];
+    unsigned char buf[128];
+    size_t buflen;
+    uint64_t bytes;
+    size_t outlen;
+
+public:
+    static const size_t BLOCK_SIZE = 128;
+    static const size_t PERSONAL_SIZE = 16;
+    static const size_t MAX_OUTPUT_SIZE = 64;
+
+    CBlake2bIndexHasher(size_t outlenIn, const unsigned char personal[PERSONAL_SIZE]);
+    CBlake2bIndexHasher& Write(const unsigned char* data, size_t len);
+    /** Hash prefix||index into out, which takes outlen bytes */
+    void Finalize(uint32_t index, unsigned char* out) const;
+    /** Same as Finalize for four indices at once */
+    void Finalize4(const uint32_t index[4], unsigned char* const out[4]) const;
+};
+
+/** Whether Finalize4 uses the AVX2 code path on this CPU */
+bool Blake2bHaveAVX2();
+
+#endif // BITCOIN_CRYPTO_BLAKE2B_H
@@ -17,6 +17,7 @@
 #endif
 
 #include "compat/endian.h"
+#include "crypto/blake2b.h"
 #include "crypto/equihash.h"
 #include "util.h"
 #ifndef __linux__
@@ -57,14 +58,21 @@
 EhSolverCancelledException solver_cancelled;
 
 template<unsigned int N, unsigned int K>
-int Equihash<N,K>::InitialiseState(eh_HashState& base_state)
+void Equihash<N,K>::GetPersonalization(unsigned char* personalization)
 {
     uint32_t le_N = htole32(N);
     uint32_t le_K = htole32(K);
-    unsigned char personalization[crypto_generichash_blake2b_PERSONALBYTES] = {};
+    memset(personalization, 0, crypto_generichash_blake2b_PERSONALBYTES);
     memcpy(personalization, "ZcashPoW", 8);
     memcpy(personalization+8,  &le_N, 4);
     memcpy(personalization+12, &le_K, 4);
+}
+
+template<unsigned int N, unsigned int K>
+int Equihash<N,K>::InitialiseState(eh_HashState& base_state)
+{
+    unsigned char personalization[crypto_generichash_blake2b_PERSONALBYTES];
+    GetPersonalization(personalization);
     return crypto_generichash_blake2b_init_salt_personal(&base_state,
                                                          NULL, 0, // No key.
                                                          (512/N)*N/8,
@@ -748,7 +756,7 @@ invalidsolution:
 #endif // ENABLE_MINING
 
 template<unsigned int N, unsigned int K>
-bool Equihash<N,K>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln)
+bool Equihash<N,K>::GetSolutionIndices(const std::vector<unsigned char>& soln, eh_index* indices)
 {
     if (soln.size() != SolutionWidth) {
         LogPrint("pow", "Invalid solution length: %d (expected %d)\n",
@@ -756,43 +764,108 @@ bool Equihash<N,K>::IsValidSolution(const eh_HashState& base_state, std::vector<
         return false;
     }
 
-    std::vector<FullStepRow<FinalFullWidth>> X;
-    X.reserve(1 << K);
-    unsigned char tmpHash[HashOutput];
-    for (eh_index i : GetIndicesFromMinimal(soln, CollisionBitLength)) {
-        GenerateHash(base_state, i/IndicesPerHashOutput, tmpHash, HashOutput);
-        X.emplace_back(tmpHash+((i % IndicesPerHashOutput) * N/8),
-                       N/8, HashLength, CollisionBitLength, i);
+    unsigned char array[(1 << K)*sizeof(eh_index)];
+    ExpandArray(soln.data(), soln.size(), array, sizeof(array),
+                CollisionBitLength+1, sizeof(eh_index) - ((CollisionBitLength+1)+7)/8);
+    for (size_t i = 0; i < (1 << K); i++) {
+        indices[i] = ArrayToEhIndex(array+(i*sizeof(eh_index)));
     }
 
-    size_t hashLen = HashLength;
-    size_t lenIndices = sizeof(eh_index);
-    while (X.size() > 1) {
-        std::vector<FullStepRow<FinalFullWidth>> Xc;
-        for (int i = 0; i < X.size(); i += 2) {
-            if (!HasCollision(X[i], X[i+1], CollisionByteLength)) {
+    // Every pair of subtrees must have distinct indices, which is the same
+    // as all of the indices being distinct.
+    eh_index sorted[1 << K];
+    std::copy(indices, indices+(1 << K), sorted);
+    std::sort(sorted, sorted+(1 << K));
+    if (std::adjacent_find(sorted, sorted+(1 << K)) != sorted+(1 << K)) {
+        LogPrint("pow", "Invalid solution: duplicate indices\n");
+        return false;
+    }
+    return true;
+}
+
+template<unsigned int N, unsigned int K>
+bool Equihash<N,K>::IsValidSolutionTree(const eh_index* indices, unsigned char* rows)
+{
+    // rows holds the expanded hash of each index, HashLength bytes apart.
+    // Each round collides rows 2j and 2j+1 into row j in place; bytes that
+    // earlier rounds collided are skipped rather than shifted out.  Indices
+    // are not copied around either: while the tree is ordered, the indices
+    // under row j of round r are indices[j << r] onwards.
+    size_t nRows = 1 << K;
+    for (size_t r = 0; r < K; r++, nRows /= 2) {
+        size_t off = r*CollisionByteLength;
+        size_t nLeaves = 1 << r;
+        for (size_t j = 0; j < nRows/2; j++) {
+            const unsigned char* a = rows+(2*j*HashLength);
+            const unsigned char* b = a+HashLength;
+            if (memcmp(a+off, b+off, CollisionByteLength) != 0) {
                 LogPrint("pow", "Invalid solution: invalid collision length between StepRows\n");
-                LogPrint("pow", "X[i]   = %s\n", X[i].GetHex(hashLen));
-                LogPrint("pow", "X[i+1] = %s\n", X[i+1].GetHex(hashLen));
+                LogPrint("pow", "X[i]   = %s\n", HexStr(a+off, a+HashLength));
+                LogPrint("pow", "X[i+1] = %s\n", HexStr(b+off, b+HashLength));
                 return false;
             }
-            if (X[i+1].IndicesBefore(X[i], hashLen, lenIndices)) {
+            const eh_index* left = indices+(2*j*nLeaves);
+            if (std::lexicographical_compare(left+nLeaves, left+2*nLeaves, left, left+nLeaves)) {
                 LogPrint("pow", "Invalid solution: Index tree incorrectly ordered\n");
                 return false;
             }
-            if (!DistinctIndices(X[i], X[i+1], hashLen, lenIndices)) {
-                LogPrint("pow", "Invalid solution: duplicate indices\n");
-                return false;
-            }
-            Xc.emplace_back(X[i], X[i+1], hashLen, lenIndices, CollisionByteLength);
+            unsigned char* c = rows+(j*HashLength);
+            for (size_t i = off+CollisionByteLength; i < HashLength; i++)
+                c[i] = a[i] ^ b[i];
         }
-        X = Xc;
-        hashLen -= CollisionByteLength;
-        lenIndices *= 2;
     }
 
-    assert(X.size() == 1);
-    return X[0].IsZero(hashLen);
+    for (size_t i = K*CollisionByteLength; i < HashLength; i++) {
+        if (rows[i] != 0)
+            return false;
+    }
+    return true;
+}
+
+template<unsigned int N, unsigned int K>
+bool Equihash<N,K>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln)
+{
+    eh_index indices[1 << K];
+    if (!GetSolutionIndices(soln, indices))
+        return false;
+
+    unsigned char rows[(1 << K)*HashLength];
+    unsigned char tmpHash[HashOutput];
+    for (size_t i = 0; i < (1 << K); i++) {
+        GenerateHash(base_state, indices[i]/IndicesPerHashOutput, tmpHash, HashOutput);
+        ExpandArray(tmpHash+((indices[i] % IndicesPerHashOutput) * N/8), N/8,
+                    rows+(i*HashLength), HashLength, CollisionBitLength);
+    }
+    return IsValidSolutionTree(indices, rows);
+}
+
+template<unsigned int N, unsigned int K>
+bool Equihash<N,K>::IsValidSolution(const unsigned char* input, size_t inputLen, const std::vector<unsigned char>& soln)
+{
+    BOOST_STATIC_ASSERT((1 << K) % 4 == 0);
+    eh_index indices[1 << K];
+    if (!GetSolutionIndices(soln, indices))
+        return false;
+
+    unsigned char personalization[crypto_generichash_blake2b_PERSONALBYTES];
+    GetPersonalization(personalization);
+    CBlake2bIndexHasher hasher(HashOutput, personalization);
+    hasher.Write(input, inputLen);
+
+    unsigned char rows[(1 << K)*HashLength];
+    unsigned char tmpHash[4][HashOutput];
+    unsigned char* const hashes[4] = {tmpHash[0], tmpHash[1], tmpHash[2], tmpHash[3]};
+    for (size_t i = 0; i < (1 << K); i += 4) {
+        uint32_t g[4];
+        for (size_t j = 0; j < 4; j++)
+            g[j] = indices[i+j]/IndicesPerHashOutput;
+        hasher.Finalize4(g, hashes);
+        for (size_t j = 0; j < 4; j++) {
+            ExpandArray(tmpHash[j]+((indices[i+j] % IndicesPerHashOutput) * N/8), N/8,
+                        rows+((i+j)*HashLength), HashLength, CollisionBitLength);
+        }
+    }
+    return IsValidSolutionTree(indices, rows);
 }
 
 // Explicit instantiations for Equihash<96,3>
@@ -806,6 +879,7 @@ template bool Equihash<96,3>::OptimisedSolve(const eh_HashState& base_state,
                                              const std::function<bool(EhSolverCancelCheck)> cancelled);
 #endif
 template bool Equihash<96,3>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template bool Equihash<96,3>::IsValidSolution(const unsigned char* input, size_t inputLen, const std::vector<unsigned char>& soln);
 
 // Explicit instantiations for Equihash<200,9>
 template int Equihash<200,9>::InitialiseState(eh_HashState& base_state);
@@ -818,6 +892,7 @@ template bool Equihash<200,9>::OptimisedSolve(const eh_HashState& base_state,
                                               const std::function<bool(EhSolverCancelCheck)> cancelled);
 #endif
 template bool Equihash<200,9>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template bool Equihash<200,9>::IsValidSolution(const unsigned char* input, size_t inputLen, const std::vector<unsigned char>& soln);
 
 // Explicit instantiations for Equihash<96,5>
 template int Equihash<96,5>::InitialiseState(eh_HashState& base_state);
@@ -830,6 +905,7 @@ template bool Equihash<96,5>::OptimisedSolve(const eh_HashState& base_state,
                                              const std::function<bool(EhSolverCancelCheck)> cancelled);
 #endif
 template bool Equihash<96,5>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template bool Equihash<96,5>::IsValidSolution(const unsigned char* input, size_t inputLen, const std::vector<unsigned char>& soln);
 
 // Explicit instantiations for Equihash<48,5>
 template int Equihash<48,5>::InitialiseState(eh_HashState& base_state);
@@ -842,3 +918,4 @@ template bool Equihash<48,5>::OptimisedSolve(const eh_HashState& base_state,
                                              const std::function<bool(EhSolverCancelCheck)> cancelled);
 #endif
 template bool Equihash<48,5>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template bool Equihash<48,5>::IsValidSolution(const unsigned char* input, size_t inputLen, const std::vector<unsigned char>& soln);
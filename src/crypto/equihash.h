@@ -167,6 +167,10 @@ private:
     BOOST_STATIC_ASSERT(N % 8 == 0);
     BOOST_STATIC_ASSERT((N/(K+1)) + 1 < 8*sizeof(eh_index));
 
+    void GetPersonalization(unsigned char* personalization);
+    bool GetSolutionIndices(const std::vector<unsigned char>& soln, eh_index* indices);
+    bool IsValidSolutionTree(const eh_index* indices, unsigned char* rows);
+
 public:
     enum : size_t { IndicesPerHashOutput=512/N };
     enum : size_t { HashOutput=IndicesPerHashOutput*N/8 };
@@ -191,6 +195,8 @@ public:
                         const std::function<bool(EhSolverCancelCheck)> cancelled);
 #endif
     bool IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+    /** Same check for the hash input I||V, hashing four indices at a time */
+    bool IsValidSolution(const unsigned char* input, size_t inputLen, const std::vector<unsigned char>& soln);
 };
 
 #include "equihash.tcc"
@@ -276,4 +282,17 @@ inline bool EhOptimisedSolveUncancellable(unsigned int n, unsigned int k, const
         throw std::invalid_argument("Unsupported Equihash parameters"); \
     }
 
+#define EhIsValidSolutionForInput(n, k, input, inputLen, soln, ret)   \
+    if (n == 96 && k == 3) {                                         \
+        ret = Eh96_3.IsValidSolution(input, inputLen, soln);         \
+    } else if (n == 200 && k == 9) {                                 \
+        ret = Eh200_9.IsValidSolution(input, inputLen, soln);        \
+    } else if (n == 96 && k == 5) {                                  \
+        ret = Eh96_5.IsValidSolution(input, inputLen, soln);         \
+    } else if (n == 48 && k == 5) {                                  \
+        ret = Eh48_5.IsValidSolution(input, inputLen, soln);         \
+    } else {                                                         \
+        throw std::invalid_argument("Unsupported Equihash parameters"); \
+    }
+
 #endif // BITCOIN_EQUIHASH_H
@@ -5,6 +5,7 @@
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
 
+#include "crypto/blake2b.h"
 #include "crypto/equihash.h"
 #include "uint256.h"
 
@@ -289,3 +290,42 @@ TEST(equihash_tests, check_optimised_solver_cancelled) {
     }
 }
 #endif // ENABLE_MINING
+
+TEST(equihash_tests, blake2b_index_hasher) {
+    unsigned char personalization[crypto_generichash_blake2b_PERSONALBYTES] = {};
+    memcpy(personalization, "ZcashPoW", 8);
+    personalization[8] = 200;
+    personalization[12] = 9;
+    std::vector<unsigned char> prefix(300);
+    for (size_t i = 0; i < prefix.size(); i++) {
+        prefix[i] = i * 7 + 3;
+    }
+
+    // Cover prefixes whose index lands mid-block, straddles blocks or starts one
+    for (size_t len : {0, 12, 123, 124, 125, 127, 128, 140, 256, 300}) {
+        SCOPED_TRACE(len);
+        crypto_generichash_blake2b_state base_state;
+        crypto_generichash_blake2b_init_salt_personal(&base_state, NULL, 0, 50, NULL, personalization);
+        crypto_generichash_blake2b_update(&base_state, prefix.data(), len);
+        CBlake2bIndexHasher hasher(50, personalization);
+        hasher.Write(prefix.data(), len);
+
+        uint32_t indices[4] = {0, 1, 255, 0x12345678};
+        unsigned char hashes[4][50];
+        unsigned char* const out[4] = {hashes[0], hashes[1], hashes[2], hashes[3]};
+        hasher.Finalize4(indices, out);
+        for (int i = 0; i < 4; i++) {
+            crypto_generichash_blake2b_state state = base_state;
+            unsigned char le[4] = {(unsigned char)indices[i], (unsigned char)(indices[i] >> 8),
+                                   (unsigned char)(indices[i] >> 16), (unsigned char)(indices[i] >> 24)};
+            crypto_generichash_blake2b_update(&state, le, 4);
+            unsigned char expected[50];
+            crypto_generichash_blake2b_final(&state, expected, 50);
+            EXPECT_EQ(0, memcmp(expected, hashes[i], 50));
+
+            unsigned char single[50];
+            hasher.Finalize(indices[i], single);
+            EXPECT_EQ(0, memcmp(expected, single, 50));
+        }
+    }
+}
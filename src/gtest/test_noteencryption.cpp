@@ -44,10 +44,12 @@ TEST(noteencryption, api)
             // Test decryption
             auto plaintext = decrypter.decrypt(ciphertext, b.get_epk(), uint256(), i);
             ASSERT_TRUE(plaintext == message);
+            ASSERT_TRUE(decrypter.check(ciphertext, b.get_epk(), uint256(), i));
 
             // Test wrong nonce
             ASSERT_THROW(decrypter.decrypt(ciphertext, b.get_epk(), uint256(), (i == 0) ? 1 : (i - 1)),
                          libzcash::note_decryption_failed);
+            ASSERT_FALSE(decrypter.check(ciphertext, b.get_epk(), uint256(), (i == 0) ? 1 : (i - 1)));
         
             // Test wrong ephemeral key
             {
@@ -65,6 +67,7 @@ TEST(noteencryption, api)
             ciphertext[10] ^= 0xff;
             ASSERT_THROW(decrypter.decrypt(ciphertext, b.get_epk(), uint256(), i),
                          libzcash::note_decryption_failed);
+            ASSERT_FALSE(decrypter.check(ciphertext, b.get_epk(), uint256(), i));
             ciphertext[10] ^= 0xff;
         }
 
@@ -75,6 +78,7 @@ TEST(noteencryption, api)
 
             ASSERT_THROW(decrypter.decrypt(ciphertext, b.get_epk(), uint256(), i),
                          libzcash::note_decryption_failed);
+            ASSERT_FALSE(decrypter.check(ciphertext, b.get_epk(), uint256(), i));
         }
 
         {
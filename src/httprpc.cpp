@@ -176,13 +176,39 @@ static bool InitRPCAuthentication()
     return true;
 }
 
+/** Work queue lane of a JSON-RPC request: the method it calls, "batch" for
+ * batches, or the shared lane when the method isn't one of ours. Only the
+ * start of the body is scanned, the request is parsed later on a worker.
+ */
+static std::string HTTPReq_JSONRPCLane(HTTPRequest* req, const std::string &)
+{
+    std::string strBody = req->PeekBody(4096);
+    size_t pos = strBody.find_first_not_of(" \t\r\n");
+    if (pos != std::string::npos && strBody[pos] == '[')
+        return "batch";
+    pos = strBody.find("\"method\"");
+    if (pos == std::string::npos)
+        return "";
+    pos = strBody.find_first_not_of(" \t\r\n", pos + 8);
+    if (pos == std::string::npos || strBody[pos] != ':')
+        return "";
+    pos = strBody.find_first_not_of(" \t\r\n", pos + 1);
+    if (pos == std::string::npos || strBody[pos] != '"')
+        return "";
+    size_t end = strBody.find('"', pos + 1);
+    if (end == std::string::npos)
+        return "";
+    std::string strMethod = strBody.substr(pos + 1, end - pos - 1);
+    return tableRPC[strMethod] ? strMethod : "";
+}
+
 bool StartHTTPRPC()
 {
     LogPrint("rpc", "Starting HTTP RPC server\n");
     if (!InitRPCAuthentication())
         return false;
 
-    RegisterHTTPHandler("/", true, HTTPReq_JSONRPC);
+    RegisterHTTPHandler("/", true, HTTPReq_JSONRPC, HTTPReq_JSONRPCLane);
 
     assert(EventBase());
     httpRPCTimerInterface = new HTTPRPCTimerInterface(EventBase());
@@ -58,21 +58,50 @@ private:
     HTTPRequestHandler func;
 };
 
-/** Simple work queue for distributing work over multiple threads.
- * Work items are simply callable objects.
+/** Latency histogram bucket of a duration in microseconds */
+static int LatencyBucket(int64_t nMicros)
+{
+    int64_t nBound = 1000;
+    int nBucket = 0;
+    while (nBucket < HTTP_LATENCY_BUCKETS - 1 && nMicros >= nBound) {
+        nBound *= 10;
+        nBucket++;
+    }
+    return nBucket;
+}
+
+/** Work queue for distributing work over multiple threads.
+ * Work items are callable objects, filed into named lanes. Each lane has its
+ * own depth limit and a cap on how many of its items run at once. Idle
+ * workers take the oldest item of the next lane, round robin, that is under
+ * its cap, so a backlog of slow calls in one lane can't starve the others.
  */
 template <typename WorkItem>
 class WorkQueue
 {
 private:
+    struct Lane
+    {
+        std::deque<std::pair<WorkItem*, int64_t> > queue; // with enqueue time
+        int running;
+        int maxRunning;
+        uint64_t completed;
+        uint64_t rejected;
+        std::vector<uint64_t> waitHistogram;
+        std::vector<uint64_t> runHistogram;
+    };
+
     /** Mutex protects entire object */
     CWaitableCriticalSection cs;
     CConditionVariable cond;
-    /* XXX in C++11 we can use std::unique_ptr here and avoid manual cleanup */
-    std::deque<WorkItem*> queue;
+    std::map<std::string, Lane> lanes;
+    //! Lane the last work item was taken from
+    std::string lastLane;
     bool running;
     size_t maxDepth;
     int numThreads;
+    int defaultMaxRunning;
+    std::map<std::string, int> mapMaxRunning;
 
     /** RAII object to keep track of number of running worker threads */
     class ThreadCounter
@@ -92,10 +121,51 @@ private:
         }
     };
 
+    Lane& GetLane(const std::string& name)
+    {
+        typename std::map<std::string, Lane>::iterator it = lanes.find(name);
+        if (it == lanes.end()) {
+            Lane& lane = lanes[name];
+            lane.running = 0;
+            std::map<std::string, int>::const_iterator mi = mapMaxRunning.find(name);
+            lane.maxRunning = mi != mapMaxRunning.end() ? mi->second : defaultMaxRunning;
+            lane.completed = 0;
+            lane.rejected = 0;
+            lane.waitHistogram.assign(HTTP_LATENCY_BUCKETS, 0);
+            lane.runHistogram.assign(HTTP_LATENCY_BUCKETS, 0);
+            return lane;
+        }
+        return it->second;
+    }
+
+    /** Take the next runnable item, starting after the lane served last. Call with cs held. */
+    WorkItem* Pop(std::string& laneName)
+    {
+        typename std::map<std::string, Lane>::iterator start = lanes.upper_bound(lastLane);
+        typename std::map<std::string, Lane>::iterator it = start;
+        for (size_t n = 0; n < lanes.size(); n++, it++) {
+            if (it == lanes.end())
+                it = lanes.begin();
+            Lane& lane = it->second;
+            if (lane.queue.empty() || lane.running >= lane.maxRunning)
+                continue;
+            WorkItem* item = lane.queue.front().first;
+            lane.waitHistogram[LatencyBucket(GetTimeMicros() - lane.queue.front().second)]++;
+            lane.queue.pop_front();
+            lane.running++;
+            lastLane = laneName = it->first;
+            return item;
+        }
+        return 0;
+    }
+
 public:
-    WorkQueue(size_t maxDepth) : running(true),
+    WorkQueue(size_t maxDepth, int defaultMaxRunning, const std::map<std::string, int>& mapMaxRunning) :
+                                 running(true),
                                  maxDepth(maxDepth),
-                                 numThreads(0)
+                                 numThreads(0),
+                                 defaultMaxRunning(defaultMaxRunning),
+                                 mapMaxRunning(mapMaxRunning)
     {
     }
     /*( Precondition: worker threads have all stopped
@@ -103,19 +173,23 @@ public:
      */
     ~WorkQueue()
     {
-        while (!queue.empty()) {
-            delete queue.front();
-            queue.pop_front();
+        for (typename std::map<std::string, Lane>::iterator it = lanes.begin(); it != lanes.end(); it++) {
+            while (!it->second.queue.empty()) {
+                delete it->second.queue.front().first;
+                it->second.queue.pop_front();
+            }
         }
     }
-    /** Enqueue a work item */
-    bool Enqueue(WorkItem* item)
+    /** Enqueue a work item in the given lane */
+    bool Enqueue(WorkItem* item, const std::string& laneName = "")
     {
         boost::unique_lock<boost::mutex> lock(cs);
-        if (queue.size() >= maxDepth) {
+        Lane& lane = GetLane(laneName);
+        if (lane.queue.size() >= maxDepth) {
+            lane.rejected++;
             return false;
         }
-        queue.push_back(item);
+        lane.queue.push_back(std::make_pair(item, GetTimeMicros()));
         cond.notify_one();
         return true;
     }
@@ -125,17 +199,26 @@ public:
         ThreadCounter count(*this);
         while (running) {
             WorkItem* i = 0;
+            std::string laneName;
             {
                 boost::unique_lock<boost::mutex> lock(cs);
-                while (running && queue.empty())
+                while (running && !(i = Pop(laneName)))
                     cond.wait(lock);
                 if (!running)
                     break;
-                i = queue.front();
-                queue.pop_front();
             }
+            int64_t nStart = GetTimeMicros();
             (*i)();
             delete i;
+            {
+                boost::unique_lock<boost::mutex> lock(cs);
+                Lane& lane = GetLane(laneName);
+                lane.running--;
+                lane.completed++;
+                lane.runHistogram[LatencyBucket(GetTimeMicros() - nStart)]++;
+                // The lane may have been held back by its cap
+                cond.notify_one();
+            }
         }
     }
     /** Interrupt and exit loops */
@@ -157,20 +240,44 @@ public:
     size_t Depth()
     {
         boost::unique_lock<boost::mutex> lock(cs);
-        return queue.size();
+        size_t depth = 0;
+        for (typename std::map<std::string, Lane>::iterator it = lanes.begin(); it != lanes.end(); it++)
+            depth += it->second.queue.size();
+        return depth;
+    }
+
+    /** Return the statistics of every lane used so far */
+    std::vector<HTTPWorkQueueLaneStats> Stats()
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        std::vector<HTTPWorkQueueLaneStats> vStats;
+        for (typename std::map<std::string, Lane>::iterator it = lanes.begin(); it != lanes.end(); it++) {
+            HTTPWorkQueueLaneStats stats;
+            stats.name = it->first;
+            stats.depth = it->second.queue.size();
+            stats.running = it->second.running;
+            stats.maxRunning = it->second.maxRunning;
+            stats.completed = it->second.completed;
+            stats.rejected = it->second.rejected;
+            stats.waitHistogram = it->second.waitHistogram;
+            stats.runHistogram = it->second.runHistogram;
+            vStats.push_back(stats);
+        }
+        return vStats;
     }
 };
 
 struct HTTPPathHandler
 {
     HTTPPathHandler() {}
-    HTTPPathHandler(std::string prefix, bool exactMatch, HTTPRequestHandler handler):
-        prefix(prefix), exactMatch(exactMatch), handler(handler)
+    HTTPPathHandler(std::string prefix, bool exactMatch, HTTPRequestHandler handler, HTTPRequestClassifier classifier):
+        prefix(prefix), exactMatch(exactMatch), handler(handler), classifier(classifier)
     {
     }
     std::string prefix;
     bool exactMatch;
     HTTPRequestHandler handler;
+    HTTPRequestClassifier classifier;
 };
 
 /** HTTP module state */
@@ -285,9 +392,10 @@ static void http_request_cb(struct evhttp_request* req, void* arg)
 
     // Dispatch to worker thread
     if (i != iend) {
+        std::string lane = i->classifier ? i->classifier(hreq.get(), path) : i->prefix;
         std::unique_ptr<HTTPWorkItem> item(new HTTPWorkItem(hreq.release(), path, i->handler));
         assert(workQueue);
-        if (workQueue->Enqueue(item.get()))
+        if (workQueue->Enqueue(item.get(), lane))
             item.release(); /* if true, queue took ownership */
         else
             item->req->WriteReply(HTTP_INTERNAL, "Work queue depth exceeded");
@@ -430,9 +538,26 @@ bool InitHTTPServer()
 
     LogPrint("http", "Initialized HTTP server\n");
     int workQueueDepth = std::max((long)GetArg("-rpcworkqueue", DEFAULT_HTTP_WORKQUEUE), 1L);
-    LogPrintf("HTTP: creating work queue of depth %d\n", workQueueDepth);
+    // By default no single lane may occupy every worker
+    int rpcThreads = std::max((long)GetArg("-rpcthreads", DEFAULT_HTTP_THREADS), 1L);
+    int laneThreads = std::max(rpcThreads - 1, 1);
+    std::map<std::string, int> mapLaneThreads;
+    if (mapMultiArgs.count("-rpcmethodthreads")) {
+        BOOST_FOREACH (const std::string& strLimit, mapMultiArgs["-rpcmethodthreads"]) {
+            size_t pos = strLimit.rfind(':');
+            int n = pos == std::string::npos ? 0 : atoi(strLimit.substr(pos + 1).c_str());
+            if (pos == 0 || n < 1) {
+                uiInterface.ThreadSafeMessageBox(
+                    strprintf("Invalid -rpcmethodthreads specification: %s. Use <method>:<threads>.", strLimit),
+                    "", CClientUIInterface::MSG_ERROR);
+                return false;
+            }
+            mapLaneThreads[strLimit.substr(0, pos)] = n;
+        }
+    }
+    LogPrintf("HTTP: creating work queue of depth %d per lane, %d threads per lane\n", workQueueDepth, laneThreads);
 
-    workQueue = new WorkQueue<HTTPClosure>(workQueueDepth);
+    workQueue = new WorkQueue<HTTPClosure>(workQueueDepth, laneThreads, mapLaneThreads);
     eventBase = base;
     eventHTTP = http;
     return true;
@@ -560,6 +685,18 @@ std::pair<bool, std::string> HTTPRequest::GetHeader(const std::string& hdr)
         return std::make_pair(false, "");
 }
 
+std::string HTTPRequest::PeekBody(size_t nMaxSize)
+{
+    struct evbuffer* buf = evhttp_request_get_input_buffer(req);
+    if (!buf)
+        return "";
+    size_t size = std::min(evbuffer_get_length(buf), nMaxSize);
+    std::string rv(size, '\0');
+    if (size > 0 && evbuffer_copyout(buf, &rv[0], size) != (ev_ssize_t)size)
+        return "";
+    return rv;
+}
+
 std::string HTTPRequest::ReadBody()
 {
     struct evbuffer* buf = evhttp_request_get_input_buffer(req);
@@ -646,10 +783,10 @@ HTTPRequest::RequestMethod HTTPRequest::GetRequestMethod()
     }
 }
 
-void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler)
+void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler, const HTTPRequestClassifier &classifier)
 {
     LogPrint("http", "Registering HTTP handler for %s (exactmatch %d)\n", prefix, exactMatch);
-    pathHandlers.push_back(HTTPPathHandler(prefix, exactMatch, handler));
+    pathHandlers.push_back(HTTPPathHandler(prefix, exactMatch, handler, classifier));
 }
 
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch)
@@ -666,3 +803,10 @@ void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch)
     }
 }
 
+
+std::vector<HTTPWorkQueueLaneStats> GetHTTPWorkQueueStats()
+{
+    if (!workQueue)
+        return std::vector<HTTPWorkQueueLaneStats>();
+    return workQueue->Stats();
+}
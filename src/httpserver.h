@@ -7,6 +7,7 @@
 
 #include <string>
 #include <stdint.h>
+#include <vector>
 #include <boost/thread.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/function.hpp>
@@ -14,6 +15,8 @@
 static const int DEFAULT_HTTP_THREADS=4;
 static const int DEFAULT_HTTP_WORKQUEUE=16;
 static const int DEFAULT_HTTP_SERVER_TIMEOUT=30;
+//! Latency histogram buckets: under 1ms, 10ms, 100ms, 1s, 10s, and the rest
+static const int HTTP_LATENCY_BUCKETS=6;
 
 struct evhttp_request;
 struct event_base;
@@ -36,14 +39,38 @@ void StopHTTPServer();
 
 /** Handler for requests to a certain HTTP path */
 typedef boost::function<void(HTTPRequest* req, const std::string &)> HTTPRequestHandler;
+/** Picks the work queue lane of a request to a certain HTTP path.
+ * It runs on the event loop thread, so it must be cheap and must not
+ * consume the request body.
+ */
+typedef boost::function<std::string(HTTPRequest* req, const std::string &)> HTTPRequestClassifier;
 /** Register handler for prefix.
  * If multiple handlers match a prefix, the first-registered one will
- * be invoked.
+ * be invoked. Without a classifier all its requests share the lane named
+ * after the prefix.
  */
-void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler);
+void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler, const HTTPRequestClassifier &classifier = HTTPRequestClassifier());
 /** Unregister handler for prefix */
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch);
 
+/** Work queue statistics of one lane */
+struct HTTPWorkQueueLaneStats
+{
+    std::string name;
+    size_t depth;
+    int running;
+    int maxRunning;
+    uint64_t completed;
+    uint64_t rejected;
+    //! Time spent queued, per latency bucket
+    std::vector<uint64_t> waitHistogram;
+    //! Time spent running, per latency bucket
+    std::vector<uint64_t> runHistogram;
+};
+
+/** Return the statistics of every work queue lane used so far */
+std::vector<HTTPWorkQueueLaneStats> GetHTTPWorkQueueStats();
+
 /** Return evhttp event base. This can be used by submodules to
  * queue timers or custom events.
  */
@@ -99,6 +126,12 @@ public:
      */
     std::string ReadBody();
 
+    /**
+     * Return up to nMaxSize bytes from the start of the request body,
+     * without consuming it.
+     */
+    std::string PeekBody(size_t nMaxSize);
+
     /**
      * Write output header.
      *
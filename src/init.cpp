@@ -161,6 +161,15 @@ public:
             abort();
         }
     }
+    bool GetCoinsOutput(const COutPoint &outpoint, CCoinsCacheEntry &entry) const {
+        try {
+            return CCoinsViewBacked::GetCoinsOutput(outpoint, entry);
+        } catch(const std::runtime_error& e) {
+            uiInterface.ThreadSafeMessageBox(_("Error reading from database, shutting down."), "", CClientUIInterface::MSG_ERROR);
+            LogPrintf("Error reading from database: %s\n", e.what());
+            abort(); // As in GetCoins
+        }
+    }
     // Writes do not need similar protection, as failure to write is handled by the caller.
 };
 
@@ -343,6 +352,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", _("Execute command when the best block changes (%s in cmd is replaced by block hash)"));
     strUsage += HelpMessageOpt("-checkblocks=<n>", strprintf(_("How many blocks to check at startup (default: %u, 0 = all)"), 288));
     strUsage += HelpMessageOpt("-checklevel=<n>", strprintf(_("How thorough the block verification of -checkblocks is (0-4, default: %u)"), 3));
+    strUsage += HelpMessageOpt("-compactblockindex", strprintf(_("Keep Equihash solutions of indexed blocks on disk and read them back when headers are served (default: %u)"), DEFAULT_COMPACT_BLOCKINDEX));
     strUsage += HelpMessageOpt("-conf=<file>", strprintf(_("Specify configuration file (default: %s)"), "komodo.conf"));
     if (mode == HMM_BITCOIND)
     {
@@ -374,6 +384,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-addressindex", strprintf(_("Maintain a full address index, used to query for the balance, txids and unspent outputs for addresses (default: %u)"), DEFAULT_ADDRESSINDEX));
     strUsage += HelpMessageOpt("-timestampindex", strprintf(_("Maintain a timestamp index for block hashes, used to query blocks hashes by a range of timestamps (default: %u)"), DEFAULT_TIMESTAMPINDEX));
     strUsage += HelpMessageOpt("-spentindex", strprintf(_("Maintain a full spent index, used to query the spending txid and input index for an outpoint (default: %u)"), DEFAULT_SPENTINDEX));
+    strUsage += HelpMessageOpt("-ccindex", strprintf(_("Maintain an index of unspent crypto-condition outputs by contract and reference txid, used by the CC contracts to find their funds (default: %u)"), DEFAULT_CCINDEX));
     strUsage += HelpMessageGroup(_("Connection options:"));
     strUsage += HelpMessageOpt("-addnode=<ip>", _("Add a node to connect to and attempt to keep the connection open"));
     strUsage += HelpMessageOpt("-banscore=<n>", strprintf(_("Threshold for disconnecting misbehaving peers (default: %u)"), 100));
@@ -470,7 +481,7 @@ std::string HelpMessage(HelpMessageMode mode)
     {
         strUsage += HelpMessageOpt("-limitfreerelay=<n>", strprintf("Continuously rate-limit free transactions to <n>*1000 bytes per minute (default: %u)", 15));
         strUsage += HelpMessageOpt("-relaypriority", strprintf("Require high priority for relaying free or low-fee transactions (default: %u)", 0));
-        strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit size of signature cache to <n> entries (default: %u)", 50000));
+        strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit size of signature cache to <n> MiB (default: %u)", DEFAULT_MAX_SIG_CACHE_SIZE));
     }
     strUsage += HelpMessageOpt("-minrelaytxfee=<amt>", strprintf(_("Fees (in %s/kB) smaller than this are considered zero fee for relaying (default: %s)"),
         CURRENCY_UNIT, FormatMoney(::minRelayTxFee.GetFeePerK())));
@@ -521,8 +532,10 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-rpcport=<port>", strprintf(_("Listen for JSON-RPC connections on <port> (default: %u or testnet: %u)"), 7771, 17771));
     strUsage += HelpMessageOpt("-rpcallowip=<ip>", _("Allow JSON-RPC connections from specified source. Valid for <ip> are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0) or a network/CIDR (e.g. 1.2.3.4/24). This option can be specified multiple times"));
     strUsage += HelpMessageOpt("-rpcthreads=<n>", strprintf(_("Set the number of threads to service RPC calls (default: %d)"), DEFAULT_HTTP_THREADS));
+    strUsage += HelpMessageOpt("-rpcmethodthreads=<method>:<n>", _("Let at most <n> calls to <method> run at once (default: one less than -rpcthreads). This option can be specified multiple times"));
     if (showDebug) {
-        strUsage += HelpMessageOpt("-rpcworkqueue=<n>", strprintf("Set the depth of the work queue to service RPC calls (default: %d)", DEFAULT_HTTP_WORKQUEUE));
+        strUsage += HelpMessageOpt("-rpcworkqueue=<n>", strprintf("Set the depth of the work queue to service RPC calls, per method (default: %d)", DEFAULT_HTTP_WORKQUEUE));
+        strUsage += HelpMessageOpt("-rpcbatchthreads=<n>", strprintf("Set the number of threads running the read-only calls of a JSON-RPC batch (default: %d)", DEFAULT_RPC_BATCH_THREADS));
         strUsage += HelpMessageOpt("-rpcservertimeout=<n>", strprintf("Timeout during HTTP requests (default: %d)", DEFAULT_HTTP_SERVER_TIMEOUT));
     }
 
@@ -926,12 +939,18 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     if (GetBoolArg("-benchmark", false))
         InitWarning(_("Warning: Unsupported argument -benchmark ignored, use -debug=bench."));
 
+    // -maxsigcachesize used to be a number of entries, now it is a size in MiB
+    if (GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE) > MAX_MAX_SIG_CACHE_SIZE)
+        InitWarning(strprintf(_("Warning: -maxsigcachesize=%d is above the limit of %d MiB, probably an entry count from an older version; using the default of %d MiB."),
+                              GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE), MAX_MAX_SIG_CACHE_SIZE, DEFAULT_MAX_SIG_CACHE_SIZE));
+
     // Checkmempool and checkblockindex default to true in regtest mode
     int ratio = std::min<int>(std::max<int>(GetArg("-checkmempool", chainparams.DefaultConsistencyChecks() ? 1 : 0), 0), 1000000);
     if (ratio != 0) {
         mempool.setSanityCheck(1.0 / ratio);
     }
     fCheckBlockIndex = GetBoolArg("-checkblockindex", chainparams.DefaultConsistencyChecks());
+    fCompactBlockIndex = GetBoolArg("-compactblockindex", DEFAULT_COMPACT_BLOCKINDEX);
     fCheckpointsEnabled = GetBoolArg("-checkpoints", true);
 
     // -par=0 means autodetect, but nScriptCheckThreads==0 means no concurrency
@@ -1145,10 +1164,14 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     LogPrintf("Using at most %i connections (%i file descriptors available)\n", nMaxConnections, nFD);
     std::ostringstream strErrors;
 
-    LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
+    LogPrintf("Using %u threads for script, JoinSplit and header verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
         for (int i=0; i<nScriptCheckThreads-1; i++)
+        {
             threadGroup.create_thread(&ThreadScriptCheck);
+            threadGroup.create_thread(&ThreadJoinSplitCheck);
+            threadGroup.create_thread(&ThreadHeaderCheck);
+        }
     }
 
     // Start the lightweight task scheduler thread
@@ -1381,8 +1404,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     nTotalCache = std::min(nTotalCache, nMaxDbCache << 20); // total cache cannot be greated than nMaxDbcache
     int64_t nBlockTreeDBCache = nTotalCache / 8;
 
-    if (GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX) || GetBoolArg("-spentindex", DEFAULT_SPENTINDEX)) {
-        // enable 3/4 of the cache if addressindex and/or spentindex is enabled
+    if (GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX) || GetBoolArg("-spentindex", DEFAULT_SPENTINDEX) || GetBoolArg("-ccindex", DEFAULT_CCINDEX)) {
+        // enable 3/4 of the cache if addressindex, spentindex and/or ccindex is enabled
         nBlockTreeDBCache = nTotalCache * 3 / 4;
     } else {
         if (nBlockTreeDBCache > (1 << 21) && !GetBoolArg("-txindex", false)) {
@@ -1401,7 +1424,7 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     if ( fReindex == 0 )
     {
-        bool checkval,fAddressIndex,fSpentIndex;
+        bool checkval,fAddressIndex,fSpentIndex,fCCIndex;
         pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex, dbCompression, dbMaxOpenFiles);
         fAddressIndex = GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
         pblocktree->ReadFlag("addressindex", checkval);
@@ -1419,6 +1442,19 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
             fprintf(stderr,"set spentindex, will reindex. sorry will take a while.\n");
             fReindex = true;
         }
+        fCCIndex = GetBoolArg("-ccindex", DEFAULT_CCINDEX);
+        // Block trees from before -ccindex have no flag: treat it as off, so
+        // upgrading only reindexes when the index is asked for
+        checkval = false;
+        bool fHaveCCIndexFlag = pblocktree->ReadFlag("ccindex", checkval);
+        if ( checkval != fCCIndex )
+        {
+            pblocktree->WriteFlag("ccindex", fCCIndex);
+            fprintf(stderr,"set ccindex, will reindex. sorry will take a while.\n");
+            fReindex = true;
+        }
+        else if ( !fHaveCCIndexFlag )
+            pblocktree->WriteFlag("ccindex", false);
     }
     
     bool fLoaded = false;
@@ -1445,6 +1481,18 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                 pnotarisations = new NotarisationDB(100*1024*1024, false, fReindex);
 
 
+                if (pcoinsdbview->NeedsUpgrade()) {
+                    uiInterface.InitMessage(_("Upgrading coin database..."));
+                    if (!pcoinsdbview->Upgrade()) {
+                        strLoadError = _("Error upgrading coin database");
+                        break;
+                    }
+                    if (ShutdownRequested()) {
+                        LogPrintf("Shutdown requested during the coin database upgrade. Exiting.\n");
+                        return false;
+                    }
+                }
+
                 if (fReindex) {
                     pblocktree->WriteReindexing(true);
                     //If we're reindexing in prune mode, wipe away unusable block files and all undo data files
@@ -36,7 +36,7 @@
 
 int32_t gettxout_scriptPubKey(uint8_t *scriptPubkey,int32_t maxsize,uint256 txid,int32_t n);
 void komodo_event_rewind(struct komodo_state *sp,char *symbol,int32_t height);
-void komodo_connectblock(CBlockIndex *pindex,CBlock& block);
+void komodo_connectblock(CBlockIndex *pindex,CBlock& block,const CBlockUndo *blockundo);
 
 #include "komodo_structs.h"
 #include "komodo_globals.h"
@@ -793,12 +793,62 @@ int32_t komodo_notarycmp(uint8_t *scriptPubKey,int32_t scriptlen,uint8_t pubkeys
     return(-1);
 }
 
-void komodo_connectblock(CBlockIndex *pindex,CBlock& block)
+// prevout scripts for notary signature detection: the block undo data has every spent output, the scriptcache keeps
+// recently created 25/35 byte scripts (newest output wins its slot) so the txindex/disk path is only a last resort
+#define KOMODO_SCRIPTCACHE_SIZE (1 << 16)
+struct komodo_scriptcache_entry { uint256 txid; int32_t vout; uint8_t len,script[35]; };
+struct komodo_scriptcache_entry *KOMODO_SCRIPTCACHE;
+uint64_t KOMODO_SCRIPTCACHE_UNDO,KOMODO_SCRIPTCACHE_HITS,KOMODO_SCRIPTCACHE_DISK;
+
+struct komodo_scriptcache_entry *komodo_scriptcache_slot(uint256 txid,int32_t vout)
+{
+    if ( KOMODO_SCRIPTCACHE == 0 && (KOMODO_SCRIPTCACHE= (struct komodo_scriptcache_entry *)calloc(KOMODO_SCRIPTCACHE_SIZE,sizeof(*KOMODO_SCRIPTCACHE))) == 0 )
+        return(0);
+    return(&KOMODO_SCRIPTCACHE[(txid.GetCheapHash() + vout) & (KOMODO_SCRIPTCACHE_SIZE - 1)]);
+}
+
+void komodo_scriptcache_add(uint256 txid,int32_t vout,const CScript &scriptPubKey)
+{
+    struct komodo_scriptcache_entry *ptr; int32_t len = (int32_t)scriptPubKey.size();
+    if ( (len == 25 || len == 35) && (ptr= komodo_scriptcache_slot(txid,vout)) != 0 )
+    {
+        ptr->txid = txid;
+        ptr->vout = vout;
+        ptr->len = len;
+        memcpy(ptr->script,scriptPubKey.data(),len);
+    }
+}
+
+int32_t komodo_prevout_script(uint8_t *scriptPubKey,int32_t maxsize,const CTxUndo *txundo,int32_t vini,uint256 txid,int32_t n)
+{
+    struct komodo_scriptcache_entry *ptr; int32_t len;
+    if ( txundo != 0 && vini < txundo->vprevout.size() )
+    {
+        const CScript &script = txundo->vprevout[vini].txout.scriptPubKey;
+        if ( (len= (int32_t)script.size()) > maxsize )
+            len = maxsize;
+        memcpy(scriptPubKey,script.data(),len);
+        KOMODO_SCRIPTCACHE_UNDO++;
+        return(len);
+    }
+    if ( (ptr= komodo_scriptcache_slot(txid,n)) != 0 && ptr->len != 0 && ptr->vout == n && ptr->txid == txid )
+    {
+        len = (ptr->len > maxsize) ? maxsize : ptr->len;
+        memcpy(scriptPubKey,ptr->script,len);
+        KOMODO_SCRIPTCACHE_HITS++;
+        return(len);
+    }
+    KOMODO_SCRIPTCACHE_DISK++;
+    return(gettxout_scriptPubKey(scriptPubKey,maxsize,txid,n));
+}
+
+void komodo_connectblock(CBlockIndex *pindex,CBlock& block,const CBlockUndo *blockundo)
 {
     static int32_t hwmheight;
     uint64_t signedmask,voutmask; char symbol[KOMODO_ASSETCHAIN_MAXLEN],dest[KOMODO_ASSETCHAIN_MAXLEN]; struct komodo_state *sp;
     uint8_t scriptbuf[10001],pubkeys[64][33],rmd160[20],scriptPubKey[35]; uint256 zero,btctxid,txhash;
     int32_t i,j,k,numnotaries,notarized,scriptlen,isratification,nid,numvalid,specialtx,notarizedheight,notaryid,len,numvouts,numvins,height,txn_count;
+    const CTxUndo *txundo;
     memset(&zero,0,sizeof(zero));
     komodo_init(pindex->nHeight);
     KOMODO_INITDONE = (uint32_t)time(NULL);
@@ -836,11 +886,14 @@ void komodo_connectblock(CBlockIndex *pindex,CBlock& block)
             voutmask = specialtx = notarizedheight = isratification = notarized = 0;
             signedmask = (height < 91400) ? 1 : 0;
             numvins = block.vtx[i].vin.size();
+            txundo = (blockundo != 0 && i > 0 && i-1 < blockundo->vtxundo.size()) ? &blockundo->vtxundo[i-1] : 0;
+            if ( txundo != 0 && txundo->vprevout.size() != numvins )
+                txundo = 0;
             for (j=0; j<numvins; j++)
             {
                 if ( i == 0 && j == 0 )
                     continue;
-                if ( (scriptlen= gettxout_scriptPubKey(scriptPubKey,sizeof(scriptPubKey),block.vtx[i].vin[j].prevout.hash,block.vtx[i].vin[j].prevout.n)) > 0 )
+                if ( (scriptlen= komodo_prevout_script(scriptPubKey,sizeof(scriptPubKey),txundo,j,block.vtx[i].vin[j].prevout.hash,block.vtx[i].vin[j].prevout.n)) > 0 )
                 {
                     if ( (k= komodo_notarycmp(scriptPubKey,scriptlen,pubkeys,numnotaries,rmd160)) >= 0 )
                         signedmask |= (1LL << k);
@@ -883,6 +936,7 @@ void komodo_connectblock(CBlockIndex *pindex,CBlock& block)
                 printf("(tx.%d: ",i);
             for (j=0; j<numvouts; j++)
             {
+                komodo_scriptcache_add(txhash,j,block.vtx[i].vout[j].scriptPubKey);
                 /*if ( i == 0 && j == 0 )
                 {
                     uint8_t *script = (uint8_t *)block.vtx[0].vout[numvouts-1].scriptPubKey.data();
@@ -963,6 +1017,7 @@ void komodo_connectblock(CBlockIndex *pindex,CBlock& block)
             printf("%s ht.%d\n",ASSETCHAINS_SYMBOL[0] == 0 ? "KMD" : ASSETCHAINS_SYMBOL,height);
         if ( pindex->nHeight == hwmheight )
             komodo_stateupdate(height,0,0,0,zero,0,0,0,0,height,(uint32_t)pindex->nTime,0,0,0,0,zero,0);
+        LogPrint("bench","    - komodo_connectblock prevout scripts: undo.%llu cache.%llu disk.%llu\n",(long long)KOMODO_SCRIPTCACHE_UNDO,(long long)KOMODO_SCRIPTCACHE_HITS,(long long)KOMODO_SCRIPTCACHE_DISK);
     } else fprintf(stderr,"komodo_connectblock: unexpected null pindex\n");
     //KOMODO_INITDONE = (uint32_t)time(NULL);
     //fprintf(stderr,"%s end connect.%d\n",ASSETCHAINS_SYMBOL,pindex->nHeight);
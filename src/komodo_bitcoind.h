@@ -818,15 +818,72 @@ uint32_t komodo_heightstamp(int32_t height)
     }
 }*/
 
+void komodo_pindex_setproducer(CBlockIndex *pindex,CBlock *block)
+{
+    int32_t j,n; uint8_t notarypubs33[64][33];
+    memset(pindex->pubkey33,0,33);
+    pindex->notaryid = -1;
+    if ( komodo_block2pubkey33(pindex->pubkey33,block) != 0 )
+    {
+        n = komodo_notaries(notarypubs33,pindex->nHeight,0);
+        for (j=0; j<n; j++)
+            if ( memcmp(notarypubs33[j],pindex->pubkey33,33) == 0 )
+            {
+                pindex->notaryid = j;
+                break;
+            }
+    }
+    else
+    {
+        memset(pindex->pubkey33,0,33);
+        pindex->notaryid = -2;
+    }
+    pindex->nStatus |= BLOCK_HAVE_PRODUCER;
+}
+
+// same result as komodo_block2pubkey33 on the block, -1 if it cant be loaded. entries connected before the producer was cached are filled in once and written back with the block index
+int32_t komodo_pindex_pubkey33(uint8_t *pubkey33,CBlockIndex *pindex)
+{
+    CBlock block;
+    if ( (pindex->nStatus & BLOCK_HAVE_PRODUCER) == 0 )
+    {
+        if ( komodo_blockload(block,pindex) != 0 )
+        {
+            memset(pubkey33,0,33);
+            return(-1);
+        }
+        TRY_LOCK(cs_main,lockMain);
+        if ( !lockMain )
+            return(komodo_block2pubkey33(pubkey33,&block));
+        komodo_pindex_setproducer(pindex,&block);
+        setDirtyBlockIndex.insert(pindex);
+    }
+    if ( pindex->notaryid == -2 )
+    {
+        memset(pubkey33,KOMODO_LOADINGBLOCKS == 0 ? 0xff : 0,33);
+        return(0);
+    }
+    memcpy(pubkey33,pindex->pubkey33,33);
+    return(1);
+}
+
+// notary id of the producer of pindex within notarypubs33, trusting the cached id when it still matches
+int32_t komodo_pindex_notaryid(CBlockIndex *pindex,uint8_t *pubkey33,uint8_t notarypubs33[64][33],int32_t numnotaries)
+{
+    int32_t j;
+    if ( pindex->notaryid >= 0 && pindex->notaryid < numnotaries && memcmp(notarypubs33[pindex->notaryid],pubkey33,33) == 0 )
+        return(pindex->notaryid);
+    for (j=0; j<numnotaries; j++)
+        if ( memcmp(notarypubs33[j],pubkey33,33) == 0 )
+            return(j);
+    return(-1);
+}
+
 void komodo_index2pubkey33(uint8_t *pubkey33,CBlockIndex *pindex,int32_t height)
 {
-    int32_t num,i; CBlock block;
     memset(pubkey33,0,33);
     if ( pindex != 0 )
-    {
-        if ( komodo_blockload(block,pindex) == 0 )
-            komodo_block2pubkey33(pubkey33,&block);
-    }
+        komodo_pindex_pubkey33(pubkey33,pindex);
 }
 
 /*int8_t komodo_minerid(int32_t height,uint8_t *destpubkey33)
@@ -859,7 +916,7 @@ void komodo_index2pubkey33(uint8_t *pubkey33,CBlockIndex *pindex,int32_t height)
 
 int32_t komodo_eligiblenotary(uint8_t pubkeys[66][33],int32_t *mids,uint32_t blocktimes[66],int32_t *nonzpkeysp,int32_t height)
 {
-    int32_t i,j,n,duplicate; CBlock block; CBlockIndex *pindex; uint8_t notarypubs33[64][33];
+    int32_t i,n,duplicate; CBlockIndex *pindex; uint8_t notarypubs33[64][33];
     memset(mids,-1,sizeof(*mids)*66);
     n = komodo_notaries(notarypubs33,height,0);
     for (i=duplicate=0; i<66; i++)
@@ -867,18 +924,10 @@ int32_t komodo_eligiblenotary(uint8_t pubkeys[66][33],int32_t *mids,uint32_t blo
         if ( (pindex= komodo_chainactive(height-i)) != 0 )
         {
             blocktimes[i] = pindex->nTime;
-            if ( komodo_blockload(block,pindex) == 0 )
+            if ( komodo_pindex_pubkey33(pubkeys[i],pindex) >= 0 )
             {
-                komodo_block2pubkey33(pubkeys[i],&block);
-                for (j=0; j<n; j++)
-                {
-                    if ( memcmp(notarypubs33[j],pubkeys[i],33) == 0 )
-                    {
-                        mids[i] = j;
-                        (*nonzpkeysp)++;
-                        break;
-                    }
-                }
+                if ( (mids[i]= komodo_pindex_notaryid(pindex,pubkeys[i],notarypubs33,n)) >= 0 )
+                    (*nonzpkeysp)++;
             } else fprintf(stderr,"couldnt load block.%d\n",height);
             if ( mids[0] >= 0 && i > 0 && mids[i] == mids[0] )
                 duplicate++;
@@ -891,7 +940,7 @@ int32_t komodo_eligiblenotary(uint8_t pubkeys[66][33],int32_t *mids,uint32_t blo
 
 int32_t komodo_minerids(uint8_t *minerids,int32_t height,int32_t width)
 {
-    int32_t i,j,n,nonz,numnotaries; CBlock block; CBlockIndex *pindex; uint8_t notarypubs33[64][33],pubkey33[33];
+    int32_t i,j,n,nonz,numnotaries; CBlockIndex *pindex; uint8_t notarypubs33[64][33],pubkey33[33];
     numnotaries = komodo_notaries(notarypubs33,height,0);
     for (i=nonz=0; i<width; i++,n++)
     {
@@ -899,19 +948,11 @@ int32_t komodo_minerids(uint8_t *minerids,int32_t height,int32_t width)
             continue;
         if ( (pindex= komodo_chainactive(height-width+i+1)) != 0 )
         {
-            if ( komodo_blockload(block,pindex) == 0 )
+            if ( komodo_pindex_pubkey33(pubkey33,pindex) >= 0 )
             {
-                komodo_block2pubkey33(pubkey33,&block);
-                for (j=0; j<numnotaries; j++)
-                {
-                    if ( memcmp(notarypubs33[j],pubkey33,33) == 0 )
-                    {
-                        minerids[nonz++] = j;
-                        break;
-                    }
-                }
-                if ( j == numnotaries )
-                    minerids[nonz++] = j;
+                if ( (j= komodo_pindex_notaryid(pindex,pubkey33,notarypubs33,numnotaries)) < 0 )
+                    j = numnotaries;
+                minerids[nonz++] = j;
             } else fprintf(stderr,"couldnt load block.%d\n",height);
         }
     }
@@ -1134,68 +1175,134 @@ uint32_t komodo_segid32(char *coinaddr)
     return(addrhash.uints[0]);
 }
 
+// segid of the staking tx at the end of block, -1 if it isnt one. *cacheablep is cleared when the staked output couldnt be looked up
+int8_t komodo_blocksegid(int32_t *cacheablep,CBlock *block,int32_t height)
+{
+    CTxDestination voutaddress; uint64_t value; char voutaddr[64],destaddr[64]; int32_t txn_count,vout; uint256 txid; int8_t segid = -1;
+    txn_count = block->vtx.size();
+    if ( txn_count > 1 && block->vtx[txn_count-1].vin.size() == 1 && block->vtx[txn_count-1].vout.size() == 1 )
+    {
+        txid = block->vtx[txn_count-1].vin[0].prevout.hash;
+        vout = block->vtx[txn_count-1].vin[0].prevout.n;
+        destaddr[0] = 0;
+        komodo_txtime(&value,txid,vout,destaddr);
+        if ( value == 0 )
+            *cacheablep = 0;
+        if ( ExtractDestination(block->vtx[txn_count-1].vout[0].scriptPubKey,voutaddress) )
+        {
+            strcpy(voutaddr,CBitcoinAddress(voutaddress).ToString().c_str());
+            if ( strcmp(destaddr,voutaddr) == 0 && block->vtx[txn_count-1].vout[0].nValue == value )
+            {
+                segid = komodo_segid32(voutaddr) & 0x3f;
+                //fprintf(stderr,"komodo_segid.(%d) -> %02x\n",height,segid);
+            }
+        } else fprintf(stderr,"komodo_segid ht.%d couldnt extract voutaddress\n",height);
+    }
+    return(segid);
+}
+
+void komodo_pindex_setsegid(CBlockIndex *pindex,int8_t segid)
+{
+    pindex->stakesegid = segid;
+    pindex->nStatus |= BLOCK_HAVE_SEGID;
+}
+
+// nocache skips the PoS validated pindex->segid, the stake segid itself is computed once per block and written back with the block index
 int8_t komodo_segid(int32_t nocache,int32_t height)
 {
-    CTxDestination voutaddress; CBlock block; CBlockIndex *pindex; uint64_t value; uint32_t txtime; char voutaddr[64],destaddr[64]; int32_t txn_count,vout; uint256 txid; int8_t segid = -1;
+    CBlock block; CBlockIndex *pindex; int32_t cacheable; int8_t segid = -1;
     if ( height > 0 && (pindex= komodo_chainactive(height)) != 0 )
     {
         if ( nocache == 0 && pindex->segid >= -1 )
             return(pindex->segid);
+        if ( (pindex->nStatus & BLOCK_HAVE_SEGID) != 0 )
+            return(pindex->stakesegid);
         if ( komodo_blockload(block,pindex) == 0 )
         {
-            txn_count = block.vtx.size();
-            if ( txn_count > 1 && block.vtx[txn_count-1].vin.size() == 1 && block.vtx[txn_count-1].vout.size() == 1 )
+            cacheable = 1;
+            segid = komodo_blocksegid(&cacheable,&block,height);
+            if ( cacheable != 0 )
             {
-                txid = block.vtx[txn_count-1].vin[0].prevout.hash;
-                vout = block.vtx[txn_count-1].vin[0].prevout.n;
-                txtime = komodo_txtime(&value,txid,vout,destaddr);
-                if ( ExtractDestination(block.vtx[txn_count-1].vout[0].scriptPubKey,voutaddress) )
+                TRY_LOCK(cs_main,lockMain);
+                if ( lockMain )
                 {
-                    strcpy(voutaddr,CBitcoinAddress(voutaddress).ToString().c_str());
-                    if ( strcmp(destaddr,voutaddr) == 0 && block.vtx[txn_count-1].vout[0].nValue == value )
-                    {
-                        segid = komodo_segid32(voutaddr) & 0x3f;
-                        //fprintf(stderr,"komodo_segid.(%d) -> %02x\n",height,segid);
-                    }
-                } else fprintf(stderr,"komodo_segid ht.%d couldnt extract voutaddress\n",height);
+                    komodo_pindex_setsegid(pindex,segid);
+                    setDirtyBlockIndex.insert(pindex);
+                }
             }
         }
     }
     return(segid);
 }
 
+#define KOMODO_SEGIDRING_SIZE 128 // power of 2 that covers the 100 block window of komodo_segids
+struct komodo_segidslot { CBlockIndex *pindex; int8_t segid; };
+struct komodo_segidslot KOMODO_SEGIDRING[KOMODO_SEGIDRING_SIZE];
+pthread_mutex_t KOMODO_SEGIDRING_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// called from UpdateTip on connect and disconnect. a slot is only used while its pindex is still chainActive at that height, so a reorg can never leave a stale segid behind
+void komodo_segids_tip(CBlockIndex *pindex)
+{
+    struct komodo_segidslot *slot;
+    if ( ASSETCHAINS_STAKED == 0 || pindex == 0 )
+        return;
+    pthread_mutex_lock(&KOMODO_SEGIDRING_mutex);
+    slot = &KOMODO_SEGIDRING[(pindex->nHeight+1) & (KOMODO_SEGIDRING_SIZE-1)];
+    if ( slot->pindex != 0 && slot->pindex->nHeight == pindex->nHeight+1 )
+        memset(slot,0,sizeof(*slot));
+    slot = &KOMODO_SEGIDRING[pindex->nHeight & (KOMODO_SEGIDRING_SIZE-1)];
+    if ( (pindex->nStatus & BLOCK_HAVE_SEGID) != 0 )
+    {
+        slot->pindex = pindex;
+        slot->segid = pindex->stakesegid;
+    } else memset(slot,0,sizeof(*slot));
+    pthread_mutex_unlock(&KOMODO_SEGIDRING_mutex);
+}
+
 int32_t komodo_segids(uint8_t *hashbuf,int32_t height,int32_t n)
 {
-    static uint8_t prevhashbuf[100]; static int32_t prevheight;
-    int32_t i;
-    if ( height == prevheight && n == 100 )
-        memcpy(hashbuf,prevhashbuf,100);
-    else
+    struct komodo_segidslot *slot; CBlockIndex *pindex; int32_t i,ht,found;
+    memset(hashbuf,0xff,n);
+    for (i=0; i<n; i++)
     {
-        memset(hashbuf,0xff,n);
-        for (i=0; i<n; i++)
-        {
-            hashbuf[i] = (uint8_t)komodo_segid(1,height+i);
-            //fprintf(stderr,"%02x ",hashbuf[i]);
-        }
-        if ( n == 100 )
+        ht = height + i;
+        if ( ht <= 0 || (pindex= komodo_chainactive(ht)) == 0 )
+            continue;
+        slot = &KOMODO_SEGIDRING[ht & (KOMODO_SEGIDRING_SIZE-1)];
+        pthread_mutex_lock(&KOMODO_SEGIDRING_mutex);
+        if ( (found= (slot->pindex == pindex)) != 0 )
+            hashbuf[i] = (uint8_t)slot->segid;
+        pthread_mutex_unlock(&KOMODO_SEGIDRING_mutex);
+        if ( found != 0 )
+            continue;
+        hashbuf[i] = (uint8_t)komodo_segid(1,ht);
+        if ( (pindex->nStatus & BLOCK_HAVE_SEGID) != 0 )
         {
-            memcpy(prevhashbuf,hashbuf,100);
-            prevheight = height;
-            //fprintf(stderr,"prevsegids.%d\n",height+n);
+            pthread_mutex_lock(&KOMODO_SEGIDRING_mutex);
+            slot->pindex = pindex;
+            slot->segid = pindex->stakesegid;
+            pthread_mutex_unlock(&KOMODO_SEGIDRING_mutex);
         }
+        //fprintf(stderr,"%02x ",hashbuf[i]);
     }
+    return(n);
 }
 
-uint32_t komodo_stakehash(uint256 *hashp,char *address,uint8_t *hashbuf,uint256 txid,int32_t vout)
+// same as komodo_stakehash with the sha256 of the address already computed, for the staking candidate cache
+uint32_t komodo_stakehash2(uint256 *hashp,uint256 addrhash,uint8_t *hashbuf,uint256 txid,int32_t vout)
 {
-    bits256 addrhash;
-    vcalc_sha256(0,(uint8_t *)&addrhash,(uint8_t *)address,(int32_t)strlen(address));
     memcpy(&hashbuf[100],&addrhash,sizeof(addrhash));
     memcpy(&hashbuf[100+sizeof(addrhash)],&txid,sizeof(txid));
     memcpy(&hashbuf[100+sizeof(addrhash)+sizeof(txid)],&vout,sizeof(vout));
     vcalc_sha256(0,(uint8_t *)hashp,hashbuf,100 + (int32_t)sizeof(uint256)*2 + sizeof(vout));
-    return(addrhash.uints[0]);
+    return(((uint32_t *)&addrhash)[0]);
+}
+
+uint32_t komodo_stakehash(uint256 *hashp,char *address,uint8_t *hashbuf,uint256 txid,int32_t vout)
+{
+    uint256 addrhash;
+    vcalc_sha256(0,(uint8_t *)&addrhash,(uint8_t *)address,(int32_t)strlen(address));
+    return(komodo_stakehash2(hashp,addrhash,hashbuf,txid,vout));
 }
 
 uint32_t komodo_stake(int32_t validateflag,arith_uint256 bnTarget,int32_t nHeight,uint256 txid,int32_t vout,uint32_t blocktime,uint32_t prevtime,char *destaddr)
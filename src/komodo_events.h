@@ -20,7 +20,7 @@
 struct komodo_event *komodo_eventadd(struct komodo_state *sp,int32_t height,char *symbol,uint8_t type,uint8_t *data,uint16_t datalen)
 {
     struct komodo_event *ep=0; uint16_t len = (uint16_t)(sizeof(*ep) + datalen);
-    if ( sp != 0 && ASSETCHAINS_SYMBOL[0] != 0 )
+    if ( sp != 0 && ASSETCHAINS_SYMBOL[0] != 0 && KOMODO_STATESNAP_REPLAY == 0 )
     {
         portable_mutex_lock(&komodo_mutex);
         ep = (struct komodo_event *)calloc(1,len);
@@ -15,6 +15,12 @@
 
 // paxdeposit equivalent in reverse makes opreturn and KMD does the same in reverse
 #include "komodo_defs.h"
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 int32_t pax_fiatstatus(uint64_t *available,uint64_t *deposited,uint64_t *issued,uint64_t *withdrawn,uint64_t *approved,uint64_t *redeemed,char *base)
 {
@@ -1096,6 +1102,7 @@ const char *komodo_opreturn(int32_t height,uint64_t value,uint8_t *opretbuf,int3
 }
 
 int32_t komodo_parsestatefiledata(struct komodo_state *sp,uint8_t *filedata,long *fposp,long datalen,char *symbol,char *dest);
+int32_t memread(void *dest,int32_t size,uint8_t *filedata,long *fposp,long datalen);
 
 void komodo_stateind_set(struct komodo_state *sp,uint32_t *inds,int32_t n,uint8_t *filedata,long datalen,char *symbol,char *dest)
 {
@@ -1237,6 +1244,41 @@ uint8_t *OS_fileptr(long *allocsizep,char *fname)
     return((uint8_t *)retptr);
 }
 
+// read-only view of a whole file, mmap'ed where available so startup does not copy komodostate into the heap
+uint8_t *komodo_mapfile(char *fname,long *filesizep)
+{
+#ifndef _WIN32
+    int fd; struct stat st; void *ptr;
+    *filesizep = 0;
+    if ( (fd= open(fname,O_RDONLY)) < 0 )
+        return(0);
+    if ( fstat(fd,&st) != 0 || st.st_size == 0 )
+    {
+        close(fd);
+        return(0);
+    }
+    ptr = mmap(0,(size_t)st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+    close(fd);
+    if ( ptr == MAP_FAILED )
+        return(0);
+    madvise(ptr,(size_t)st.st_size,MADV_SEQUENTIAL);
+    *filesizep = (long)st.st_size;
+    return((uint8_t *)ptr);
+#else
+    return(OS_fileptr(filesizep,fname));
+#endif
+}
+
+void komodo_unmapfile(uint8_t *filedata,long filesize)
+{
+#ifndef _WIN32
+    if ( filedata != 0 )
+        munmap(filedata,(size_t)filesize);
+#else
+    free(filedata);
+#endif
+}
+
 long komodo_stateind_validate(struct komodo_state *sp,char *indfname,uint8_t *filedata,long datalen,uint32_t *prevpos100p,uint32_t *indcounterp,char *symbol,char *dest)
 {
     FILE *fp; long fsize,lastfpos=0,fpos=0; uint8_t *inds,func; int32_t i,n; uint32_t offset,tmp,prevpos100 = 0;
@@ -1301,66 +1343,200 @@ long komodo_indfile_update(FILE *indfp,uint32_t *prevpos100p,long lastfpos,long
     return(newfpos);
 }
 
+uint32_t komodo_statesnap_crc(uint8_t *filedata,long fpos)
+{
+    long n = (fpos < KOMODO_STATESNAP_CRCLEN) ? fpos : KOMODO_STATESNAP_CRCLEN;
+    return(calc_crc32(0,&filedata[fpos - n],n));
+}
+
+void komodo_statesnap_clear(struct komodo_state *sp)
+{
+    int32_t i;
+    if ( sp->Komodo_events != 0 )
+    {
+        for (i=0; i<sp->Komodo_numevents; i++)
+            if ( sp->Komodo_events[i] != 0 )
+                free(sp->Komodo_events[i]);
+        free(sp->Komodo_events);
+    }
+    if ( sp->NPOINTS != 0 )
+        free(sp->NPOINTS);
+    if ( sp->MoMPOINTS != 0 )
+        free(sp->MoMPOINTS);
+    memset(sp,0,sizeof(*sp));
+}
+
+// writes the derived state (komodo_state scalars, NPOINTS, MoMPOINTS, events) as of fpos plus the offsets of the P/R/V records whose global side effects must be reapplied on load
+int32_t komodo_statesnap_save(struct komodo_state *sp,char *snapfname,uint8_t *filedata,long fpos,uint32_t indcounter,uint32_t prevpos100,uint32_t *journal,int32_t numjournal,char *symbol)
+{
+    FILE *fp; char tmpfname[1024]; struct komodo_statesnap H; struct komodo_state S; struct komodo_event *ep; int32_t i,errs = 0; uint16_t len;
+    if ( fpos <= 0 || fpos >= (1LL << 32) )
+        return(-1);
+    memset(&H,0,sizeof(H));
+    H.magic = KOMODO_STATESNAP_MAGIC;
+    H.version = KOMODO_STATESNAP_VERSION;
+    H.statesize = (uint32_t)sizeof(S);
+    H.npointsize = (uint32_t)sizeof(*sp->NPOINTS);
+    H.eventsize = (uint32_t)sizeof(*ep);
+    H.fpos = (uint32_t)fpos;
+    H.indcounter = indcounter;
+    H.prevpos100 = prevpos100;
+    H.crc = komodo_statesnap_crc(filedata,fpos);
+    H.numjournal = numjournal;
+    H.numevents = sp->Komodo_numevents;
+    safecopy(H.symbol,symbol,sizeof(H.symbol));
+    memcpy(&S,sp,sizeof(S));
+    S.NPOINTS = 0, S.MoMPOINTS = 0, S.Komodo_events = 0;
+    memset(S.RTbufs,0,sizeof(S.RTbufs)), S.RTmask = 0;
+    sprintf(tmpfname,"%s.tmp",snapfname);
+    if ( (fp= fopen(tmpfname,"wb")) == 0 )
+        return(-1);
+    if ( fwrite(&H,1,sizeof(H),fp) != sizeof(H) || fwrite(&S,1,sizeof(S),fp) != sizeof(S) )
+        errs++;
+    if ( sp->NUM_NPOINTS > 0 && fwrite(sp->NPOINTS,sizeof(*sp->NPOINTS),sp->NUM_NPOINTS,fp) != sp->NUM_NPOINTS )
+        errs++;
+    if ( sp->NUM_MoMPOINTS > 0 && fwrite(sp->MoMPOINTS,sizeof(*sp->MoMPOINTS),sp->NUM_MoMPOINTS,fp) != sp->NUM_MoMPOINTS )
+        errs++;
+    for (i=0; i<sp->Komodo_numevents && errs == 0; i++)
+    {
+        ep = sp->Komodo_events[i];
+        len = ep->len;
+        if ( fwrite(&len,1,sizeof(len),fp) != sizeof(len) || fwrite(ep,1,len,fp) != len )
+            errs++;
+    }
+    if ( numjournal > 0 && fwrite(journal,sizeof(*journal),numjournal,fp) != numjournal )
+        errs++;
+    fclose(fp);
+    if ( errs != 0 || rename(tmpfname,snapfname) != 0 )
+    {
+        fprintf(stderr,"error saving %s\n",snapfname);
+        remove(tmpfname);
+        return(-1);
+    }
+    return(0);
+}
+
+// restores the state written by komodo_statesnap_save into a fresh sp if it matches the validated prefix of komodostate
+long komodo_statesnap_load(struct komodo_state *sp,char *snapfname,uint8_t *filedata,long validated,uint32_t indcounter,uint32_t **journalp,int32_t *numjournalp,char *symbol)
+{
+    struct komodo_statesnap H; struct komodo_state S; struct komodo_event *ep; uint8_t *snap; long snaplen,pos = 0; uint32_t *journal = 0; int32_t i,errs = 0; uint16_t len;
+    *journalp = 0, *numjournalp = 0;
+    if ( (snap= OS_fileptr(&snaplen,snapfname)) == 0 )
+        return(-1);
+    if ( memread(&H,sizeof(H),snap,&pos,snaplen) != sizeof(H) || H.magic != KOMODO_STATESNAP_MAGIC || H.version != KOMODO_STATESNAP_VERSION || H.statesize != sizeof(S) || H.npointsize != sizeof(*sp->NPOINTS) || H.eventsize != sizeof(*ep) || strncmp(H.symbol,symbol,sizeof(H.symbol)) != 0 )
+        errs++;
+    else if ( H.fpos != validated || H.indcounter != indcounter || H.crc != komodo_statesnap_crc(filedata,validated) )
+    {
+        fprintf(stderr,"%s is stale: fpos.%u vs %ld indcounter.%u vs %u\n",snapfname,H.fpos,validated,H.indcounter,indcounter);
+        errs++;
+    }
+    else if ( memread(&S,sizeof(S),snap,&pos,snaplen) != sizeof(S) || S.NUM_NPOINTS < 0 || S.NUM_MoMPOINTS < 0 || H.numevents < 0 )
+        errs++;
+    else
+    {
+        memcpy(sp,&S,sizeof(S));
+        sp->NPOINTS = 0, sp->MoMPOINTS = 0, sp->Komodo_events = 0, sp->Komodo_numevents = 0;
+        if ( sp->NUM_NPOINTS > 0 && ((sp->NPOINTS= (struct notarized_checkpoint *)malloc(sp->NUM_NPOINTS * sizeof(*sp->NPOINTS))) == 0 || memread(sp->NPOINTS,(int32_t)(sp->NUM_NPOINTS * sizeof(*sp->NPOINTS)),snap,&pos,snaplen) < 0) )
+            errs++;
+        if ( errs == 0 && sp->NUM_MoMPOINTS > 0 && ((sp->MoMPOINTS= (int32_t *)malloc(sp->NUM_MoMPOINTS * sizeof(*sp->MoMPOINTS))) == 0 || memread(sp->MoMPOINTS,(int32_t)(sp->NUM_MoMPOINTS * sizeof(*sp->MoMPOINTS)),snap,&pos,snaplen) < 0) )
+            errs++;
+        for (i=0; errs==0 && i<sp->NUM_MoMPOINTS; i++)
+            if ( sp->MoMPOINTS[i] < 0 || sp->MoMPOINTS[i] >= sp->NUM_NPOINTS )
+                errs++;
+        if ( errs == 0 && H.numevents > 0 && (sp->Komodo_events= (struct komodo_event **)calloc(H.numevents,sizeof(*sp->Komodo_events))) == 0 )
+            errs++;
+        for (i=0; errs==0 && i<H.numevents; i++)
+        {
+            if ( memread(&len,sizeof(len),snap,&pos,snaplen) != sizeof(len) || len < sizeof(*ep) || (ep= (struct komodo_event *)calloc(1,len)) == 0 )
+                errs++;
+            else
+            {
+                sp->Komodo_events[sp->Komodo_numevents++] = ep;
+                if ( memread(ep,len,snap,&pos,snaplen) != len || ep->len != len )
+                    errs++;
+                ep->related = 0;
+            }
+        }
+        if ( errs == 0 && H.numjournal > 0 && ((journal= (uint32_t *)malloc(H.numjournal * sizeof(*journal))) == 0 || memread(journal,(int32_t)(H.numjournal * sizeof(*journal)),snap,&pos,snaplen) < 0) )
+            errs++;
+        for (i=0; errs==0 && i<H.numjournal; i++)
+            if ( journal[i] >= validated || (filedata[journal[i]] != 'P' && filedata[journal[i]] != 'R' && filedata[journal[i]] != 'V') )
+                errs++;
+        if ( errs != 0 || pos != snaplen )
+        {
+            fprintf(stderr,"%s is corrupted\n",snapfname);
+            komodo_statesnap_clear(sp);
+            if ( journal != 0 )
+                free(journal);
+            free(snap);
+            return(-1);
+        }
+        *journalp = journal, *numjournalp = H.numjournal;
+    }
+    free(snap);
+    return(errs == 0 ? (long)H.fpos : -1);
+}
+
 int32_t komodo_faststateinit(struct komodo_state *sp,char *fname,char *symbol,char *dest)
 {
-    FILE *indfp; char indfname[1024]; uint8_t *filedata; long validated=-1,datalen,fpos,lastfpos; uint32_t tmp,prevpos100,indcounter,starttime; int32_t func,finished = 0;
+    FILE *indfp = 0; char indfname[1024],snapfname[1024]; uint8_t *filedata; long validated=-1,datalen,fpos,lastfpos,jpos; uint32_t prevpos100,indcounter,starttime,*journal = 0; int32_t i,func,numjournal = 0,loaded = 0;
     starttime = (uint32_t)time(NULL);
-    safecopy(indfname,fname,sizeof(indfname)-4);
+    safecopy(indfname,fname,sizeof(indfname)-5);
+    strcpy(snapfname,indfname);
     strcat(indfname,".ind");
-    if ( (filedata= OS_fileptr(&datalen,fname)) != 0 )
+    strcat(snapfname,".snap");
+    if ( (filedata= komodo_mapfile(fname,&datalen)) != 0 )
     {
-        if ( 1 )//datalen >= (1LL << 32) || GetArg("-genind",0) != 0 || (validated= komodo_stateind_validate(0,indfname,filedata,datalen,&prevpos100,&indcounter,symbol,dest)) < 0 )
+        // resume only when both the .ind record boundaries and the snapshot agree with the current komodostate prefix.
+        // globals outside komodo_state come back from the journal: Pubkeys (P), PVALS (V), pax and kv (R).
+        // KOMODO_LASTMINED/prevKOMODO_LASTMINED are only set by komodo_connectblock and a rewind record only touches
+        // them when prevKOMODO_LASTMINED != 0, which is never the case when komodo_init loads the state; require it anyway
+        if ( datalen < (1LL << 32) && GetArg("-genind",0) == 0 && prevKOMODO_LASTMINED == 0 && sp->NUM_NPOINTS == 0 && sp->Komodo_numevents == 0 && (validated= komodo_stateind_validate(0,indfname,filedata,datalen,&prevpos100,&indcounter,symbol,dest)) > 0 && komodo_statesnap_load(sp,snapfname,filedata,validated,indcounter,&journal,&numjournal,symbol) == validated && (loaded= 1) != 0 && (indfp= fopen(indfname,"rb+")) != 0 )
+        {
+            fseek(indfp,indcounter * sizeof(uint32_t),SEEK_SET);
+            KOMODO_STATESNAP_REPLAY = 1;
+            for (i=0; i<numjournal; i++)
+            {
+                jpos = journal[i];
+                komodo_parsestatefiledata(sp,filedata,&jpos,validated,symbol,dest);
+            }
+            KOMODO_STATESNAP_REPLAY = 0;
+            fpos = validated;
+            fprintf(stderr,"loaded %s at fpos.%ld, NPOINTS.%d events.%d side effects.%d, replaying %ldKB of %s\n",snapfname,fpos,sp->NUM_NPOINTS,sp->Komodo_numevents,numjournal,(datalen-fpos)/1024,fname);
+        }
+        else
         {
-            lastfpos = fpos = 0;
+            if ( journal != 0 )
+                free(journal), journal = 0;
+            if ( loaded != 0 )
+                komodo_statesnap_clear(sp);
+            numjournal = 0;
+            fpos = 0;
             indcounter = prevpos100 = 0;
             if ( (indfp= fopen(indfname,"wb")) != 0 )
                 fwrite(&prevpos100,1,sizeof(prevpos100),indfp), indcounter++;
             fprintf(stderr,"processing %s %ldKB, validated.%ld\n",fname,datalen/1024,validated);
-            while ( (func= komodo_parsestatefiledata(sp,filedata,&fpos,datalen,symbol,dest)) >= 0 )
-            {
-                lastfpos = komodo_indfile_update(indfp,&prevpos100,lastfpos,fpos,func,&indcounter);
-            }
-            if ( indfp != 0 )
-            {
-                fclose(indfp);
-                if ( (fpos= komodo_stateind_validate(0,indfname,filedata,datalen,&prevpos100,&indcounter,symbol,dest)) < 0 )
-                    printf("unexpected komodostate.ind validate failure %s datalen.%ld\n",indfname,datalen);
-                else printf("%s validated fpos.%ld\n",indfname,fpos);
-            }
-            finished = 1;
-            fprintf(stderr,"took %d seconds to process %s %ldKB\n",(int32_t)(time(NULL)-starttime),fname,datalen/1024);
         }
-        else if ( validated > 0 )
+        lastfpos = fpos;
+        while ( (func= komodo_parsestatefiledata(sp,filedata,&fpos,datalen,symbol,dest)) >= 0 )
         {
-            if ( (indfp= fopen(indfname,"rb+")) != 0 )
+            if ( func == 'P' || func == 'R' || func == 'V' )
             {
-                lastfpos = fpos = validated;
-                fprintf(stderr,"datalen.%ld validated %ld -> indcounter %u, prevpos100 %u offset.%ld\n",datalen,validated,indcounter,prevpos100,indcounter * sizeof(uint32_t));
-                if ( fpos < datalen )
-                {
-                    fseek(indfp,indcounter * sizeof(uint32_t),SEEK_SET);
-                    if ( ftell(indfp) == indcounter * sizeof(uint32_t) )
-                    {
-                        while ( (func= komodo_parsestatefiledata(sp,filedata,&fpos,datalen,symbol,dest)) >= 0 )
-                        {
-                            lastfpos = komodo_indfile_update(indfp,&prevpos100,lastfpos,fpos,func,&indcounter);
-                            if ( lastfpos != fpos )
-                                fprintf(stderr,"unexpected lastfpos.%ld != %ld\n",lastfpos,fpos);
-                        }
-                    }
-                    fclose(indfp);
-                }
-                if ( komodo_stateind_validate(sp,indfname,filedata,datalen,&prevpos100,&indcounter,symbol,dest) < 0 )
-                    printf("unexpected komodostate.ind validate failure %s datalen.%ld\n",indfname,datalen);
-                else
-                {
-                    printf("%s validated updated from validated.%ld to %ld new.[%ld] -> indcounter %u, prevpos100 %u offset.%ld | elapsed %d seconds\n",indfname,validated,fpos,fpos-validated,indcounter,prevpos100,indcounter * sizeof(uint32_t),(int32_t)(time(NULL) - starttime));
-                    finished = 1;
-                }
+                journal = (uint32_t *)realloc(journal,(numjournal+1) * sizeof(*journal));
+                journal[numjournal++] = (uint32_t)lastfpos;
             }
-        } else printf("komodo_faststateinit unexpected case\n");
-        free(filedata);
-        return(finished == 1);
+            lastfpos = komodo_indfile_update(indfp,&prevpos100,lastfpos,fpos,func,&indcounter);
+        }
+        if ( indfp != 0 )
+        {
+            fclose(indfp);
+            komodo_statesnap_save(sp,snapfname,filedata,fpos,indcounter,prevpos100,journal,numjournal,symbol);
+        }
+        fprintf(stderr,"took %d seconds to process %s %ldKB\n",(int32_t)(time(NULL)-starttime),fname,datalen/1024);
+        if ( journal != 0 )
+            free(journal);
+        komodo_unmapfile(filedata,datalen);
+        return(1);
     }
     return(-1);
 }
@@ -1427,7 +1603,7 @@ void komodo_passport_iteration()
                 komodo_nameset(symbol,dest,base);
                 sp = komodo_stateptrget(symbol);
                 n = 0;
-                if ( lastpos[baseid] == 0 && (filedata= OS_fileptr(&datalen,fname)) != 0 )
+                if ( lastpos[baseid] == 0 && (filedata= komodo_mapfile(fname,&datalen)) != 0 )
                 {
                     fpos = 0;
                     fprintf(stderr,"%s processing %s %ldKB\n",ASSETCHAINS_SYMBOL,fname,datalen/1024);
@@ -1435,7 +1611,7 @@ void komodo_passport_iteration()
                         lastfpos = fpos;
                     fprintf(stderr,"%s took %d seconds to process %s %ldKB\n",ASSETCHAINS_SYMBOL,(int32_t)(time(NULL)-starttime),fname,datalen/1024);
                     lastpos[baseid] = lastfpos;
-                    free(filedata), filedata = 0;
+                    komodo_unmapfile(filedata,datalen), filedata = 0;
                     datalen = 0;
                 }
                 else if ( (fp= fopen(fname,"rb")) != 0 && sp != 0 )
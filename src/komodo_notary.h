@@ -385,19 +385,59 @@ int32_t komodo_chosennotary(int32_t *notaryidp,int32_t height,uint8_t *pubkey33,
 
 //struct komodo_state *komodo_stateptr(char *symbol,char *dest);
 
-struct notarized_checkpoint *komodo_npptr_for_height(int32_t height, int *idx)
+/*
+ NPOINTS are appended in block order, so they are sorted by nHeight, and the MoM bearing ones (MoMPOINTS) by notarized_height. Lookups binary search these and only fall back to the linear scans if a checkpoint was ever appended out of order.
+ */
+struct notarized_checkpoint *komodo_npptr_for_height_scan(struct komodo_state *sp,int32_t height,int *idx)
 {
-    char symbol[KOMODO_ASSETCHAIN_MAXLEN],dest[KOMODO_ASSETCHAIN_MAXLEN]; int32_t i; struct komodo_state *sp; struct notarized_checkpoint *np = 0;
-    if ( (sp= komodo_stateptr(symbol,dest)) != 0 )
+    int32_t i; struct notarized_checkpoint *np;
+    for (i=sp->NUM_NPOINTS-1; i>=0; i--)
+    {
+        *idx = i;
+        np = &sp->NPOINTS[i];
+        if ( np->MoMdepth != 0 && height > np->notarized_height-(np->MoMdepth&0xffff) && height <= np->notarized_height )
+            return(np);
+    }
+    *idx = -1;
+    return(0);
+}
+
+struct notarized_checkpoint *komodo_npptr_for_height_search(struct komodo_state *sp,int32_t height,int *idx)
+{
+    int32_t lo,hi,mid,j,i; struct notarized_checkpoint *np,*best = 0;
+    *idx = -1;
+    if ( sp->MoMPOINTS_unsorted != 0 )
+        return(komodo_npptr_for_height_scan(sp,height,idx));
+    // first MoM checkpoint with notarized_height >= height
+    lo = 0, hi = sp->NUM_MoMPOINTS;
+    while ( lo < hi )
+    {
+        mid = (lo + hi) >> 1;
+        if ( sp->NPOINTS[sp->MoMPOINTS[mid]].notarized_height < height )
+            lo = mid + 1;
+        else hi = mid;
+    }
+    // every later one also ends at or above height, the latest whose MoMdepth reaches back to height wins
+    for (j=lo; j<sp->NUM_MoMPOINTS; j++)
     {
-        for (i=sp->NUM_NPOINTS-1; i>=0; i--)
+        i = sp->MoMPOINTS[j];
+        np = &sp->NPOINTS[i];
+        if ( np->notarized_height - sp->MAX_MoMdepth >= height )
+            break;
+        if ( height > np->notarized_height-(np->MoMdepth&0xffff) )
         {
+            best = np;
             *idx = i;
-            np = &sp->NPOINTS[i];
-            if ( np->MoMdepth != 0 && height > np->notarized_height-(np->MoMdepth&0xffff) && height <= np->notarized_height )
-                return(np);
         }
     }
+    return(best);
+}
+
+struct notarized_checkpoint *komodo_npptr_for_height(int32_t height, int *idx)
+{
+    char symbol[KOMODO_ASSETCHAIN_MAXLEN],dest[KOMODO_ASSETCHAIN_MAXLEN]; struct komodo_state *sp;
+    if ( (sp= komodo_stateptr(symbol,dest)) != 0 )
+        return(komodo_npptr_for_height_search(sp,height,idx));
     *idx = -1;
     return(0);
 }
@@ -419,17 +459,9 @@ struct notarized_checkpoint *komodo_npptr_at(int idx)
 
 int32_t komodo_prevMoMheight()
 {
-    static uint256 zero;
-    char symbol[KOMODO_ASSETCHAIN_MAXLEN],dest[KOMODO_ASSETCHAIN_MAXLEN]; int32_t i; struct komodo_state *sp; struct notarized_checkpoint *np = 0;
-    if ( (sp= komodo_stateptr(symbol,dest)) != 0 )
-    {
-        for (i=sp->NUM_NPOINTS-1; i>=0; i--)
-        {
-            np = &sp->NPOINTS[i];
-            if ( np->MoM != zero )
-                return(np->notarized_height);
-        }
-    }
+    char symbol[KOMODO_ASSETCHAIN_MAXLEN],dest[KOMODO_ASSETCHAIN_MAXLEN]; struct komodo_state *sp;
+    if ( (sp= komodo_stateptr(symbol,dest)) != 0 && sp->lastMoMi > 0 )
+        return(sp->NPOINTS[sp->lastMoMi-1].notarized_height);
     return(0);
 }
 
@@ -489,56 +521,43 @@ int32_t komodo_MoMdata(int32_t *notarized_htp,uint256 *MoMp,uint256 *kmdtxidp,in
     return(0);
 }
 
+// index of the last checkpoint before the first one at or above nHeight, -1 if none
+int32_t komodo_notarizeddata_scan(struct komodo_state *sp,int32_t nHeight)
+{
+    int32_t i;
+    for (i=0; i<sp->NUM_NPOINTS; i++)
+        if ( sp->NPOINTS[i].nHeight >= nHeight )
+            break;
+    return(i-1);
+}
+
+int32_t komodo_notarizeddata_search(struct komodo_state *sp,int32_t nHeight)
+{
+    int32_t lo,hi,mid;
+    if ( sp->NPOINTS_unsorted != 0 )
+        return(komodo_notarizeddata_scan(sp,nHeight));
+    lo = 0, hi = sp->NUM_NPOINTS;
+    while ( lo < hi )
+    {
+        mid = (lo + hi) >> 1;
+        if ( sp->NPOINTS[mid].nHeight < nHeight )
+            lo = mid + 1;
+        else hi = mid;
+    }
+    return(lo-1);
+}
+
 int32_t komodo_notarizeddata(int32_t nHeight,uint256 *notarized_hashp,uint256 *notarized_desttxidp)
 {
-    struct notarized_checkpoint *np = 0; int32_t i=0,flag = 0; char symbol[KOMODO_ASSETCHAIN_MAXLEN],dest[KOMODO_ASSETCHAIN_MAXLEN]; struct komodo_state *sp;
-    if ( (sp= komodo_stateptr(symbol,dest)) != 0 )
+    struct notarized_checkpoint *np; int32_t i; char symbol[KOMODO_ASSETCHAIN_MAXLEN],dest[KOMODO_ASSETCHAIN_MAXLEN]; struct komodo_state *sp;
+    if ( (sp= komodo_stateptr(symbol,dest)) != 0 && (i= komodo_notarizeddata_search(sp,nHeight)) >= 0 )
     {
-        if ( sp->NUM_NPOINTS > 0 )
-        {
-            flag = 0;
-            if ( sp->last_NPOINTSi < sp->NUM_NPOINTS && sp->last_NPOINTSi > 0 )
-            {
-                np = &sp->NPOINTS[sp->last_NPOINTSi-1];
-                if ( np->nHeight < nHeight )
-                {
-                    for (i=sp->last_NPOINTSi; i<sp->NUM_NPOINTS; i++)
-                    {
-                        if ( sp->NPOINTS[i].nHeight >= nHeight )
-                        {
-                            //printf("flag.1 i.%d np->ht %d [%d].ht %d >= nHeight.%d, last.%d num.%d\n",i,np->nHeight,i,sp->NPOINTS[i].nHeight,nHeight,sp->last_NPOINTSi,sp->NUM_NPOINTS);
-                            flag = 1;
-                            break;
-                        }
-                        np = &sp->NPOINTS[i];
-                        sp->last_NPOINTSi = i;
-                    }
-                }
-            }
-            if ( flag == 0 )
-            {
-                np = 0;
-                for (i=0; i<sp->NUM_NPOINTS; i++)
-                {
-                    if ( sp->NPOINTS[i].nHeight >= nHeight )
-                    {
-                        //printf("i.%d np->ht %d [%d].ht %d >= nHeight.%d\n",i,np->nHeight,i,sp->NPOINTS[i].nHeight,nHeight);
-                        break;
-                    }
-                    np = &sp->NPOINTS[i];
-                    sp->last_NPOINTSi = i;
-                }
-            }
-        }
-        if ( np != 0 )
-        {
-            //char str[65],str2[65]; printf("[%s] notarized_ht.%d\n",ASSETCHAINS_SYMBOL,np->notarized_height);
-            if ( np->nHeight >= nHeight || (i < sp->NUM_NPOINTS && np[1].nHeight < nHeight) )
-                printf("warning: flag.%d i.%d np->ht %d [1].ht %d >= nHeight.%d\n",flag,i,np->nHeight,np[1].nHeight,nHeight);
-            *notarized_hashp = np->notarized_hash;
-            *notarized_desttxidp = np->notarized_desttxid;
-            return(np->notarized_height);
-        }
+        np = &sp->NPOINTS[i];
+        sp->last_NPOINTSi = i;
+        //char str[65],str2[65]; printf("[%s] notarized_ht.%d\n",ASSETCHAINS_SYMBOL,np->notarized_height);
+        *notarized_hashp = np->notarized_hash;
+        *notarized_desttxidp = np->notarized_desttxid;
+        return(np->notarized_height);
     }
     memset(notarized_hashp,0,sizeof(*notarized_hashp));
     memset(notarized_desttxidp,0,sizeof(*notarized_desttxidp));
@@ -547,7 +566,7 @@ int32_t komodo_notarizeddata(int32_t nHeight,uint256 *notarized_hashp,uint256 *n
 
 void komodo_notarized_update(struct komodo_state *sp,int32_t nHeight,int32_t notarized_height,uint256 notarized_hash,uint256 notarized_desttxid,uint256 MoM,int32_t MoMdepth)
 {
-    struct notarized_checkpoint *np;
+    static uint256 zero; struct notarized_checkpoint *np;
     if ( notarized_height >= nHeight )
     {
         fprintf(stderr,"komodo_notarized_update REJECT notarized_height %d > %d nHeight\n",notarized_height,nHeight);
@@ -557,6 +576,8 @@ void komodo_notarized_update(struct komodo_state *sp,int32_t nHeight,int32_t not
         fprintf(stderr,"[%s] komodo_notarized_update nHeight.%d notarized_height.%d\n",ASSETCHAINS_SYMBOL,nHeight,notarized_height);
     portable_mutex_lock(&komodo_mutex);
     sp->NPOINTS = (struct notarized_checkpoint *)realloc(sp->NPOINTS,(sp->NUM_NPOINTS+1) * sizeof(*sp->NPOINTS));
+    if ( sp->NUM_NPOINTS > 0 && nHeight < sp->NPOINTS[sp->NUM_NPOINTS-1].nHeight )
+        sp->NPOINTS_unsorted = 1;
     np = &sp->NPOINTS[sp->NUM_NPOINTS++];
     memset(np,0,sizeof(*np));
     np->nHeight = nHeight;
@@ -565,6 +586,17 @@ void komodo_notarized_update(struct komodo_state *sp,int32_t nHeight,int32_t not
     sp->NOTARIZED_DESTTXID = np->notarized_desttxid = notarized_desttxid;
     sp->MoM = np->MoM = MoM;
     sp->MoMdepth = np->MoMdepth = MoMdepth;
+    if ( MoM != zero )
+        sp->lastMoMi = sp->NUM_NPOINTS;
+    if ( MoMdepth != 0 )
+    {
+        sp->MoMPOINTS = (int32_t *)realloc(sp->MoMPOINTS,(sp->NUM_MoMPOINTS+1) * sizeof(*sp->MoMPOINTS));
+        if ( sp->NUM_MoMPOINTS > 0 && notarized_height < sp->NPOINTS[sp->MoMPOINTS[sp->NUM_MoMPOINTS-1]].notarized_height )
+            sp->MoMPOINTS_unsorted = 1;
+        sp->MoMPOINTS[sp->NUM_MoMPOINTS++] = sp->NUM_NPOINTS-1;
+        if ( (MoMdepth & 0xffff) > sp->MAX_MoMdepth )
+            sp->MAX_MoMdepth = (MoMdepth & 0xffff);
+    }
     portable_mutex_unlock(&komodo_mutex);
 }
 
@@ -120,8 +120,21 @@ struct komodo_state
     uint32_t SAVEDTIMESTAMP;
     uint64_t deposited,issued,withdrawn,approved,redeemed,shorted;
     struct notarized_checkpoint *NPOINTS; int32_t NUM_NPOINTS,last_NPOINTSi;
+    int32_t *MoMPOINTS,NUM_MoMPOINTS,MAX_MoMdepth,lastMoMi,NPOINTS_unsorted,MoMPOINTS_unsorted; // NPOINTS indices with MoMdepth, lastMoMi is 1 + index of the latest nonzero MoM
     struct komodo_event **Komodo_events; int32_t Komodo_numevents;
     uint32_t RTbufs[64][3]; uint64_t RTmask;
 };
 
+#define KOMODO_STATESNAP_MAGIC 0x70616e73 // "snap"
+#define KOMODO_STATESNAP_VERSION 1
+#define KOMODO_STATESNAP_CRCLEN (1 << 20)
+
+struct komodo_statesnap // header of komodostate.snap, the derived komodo_state as of fpos in komodostate
+{
+    uint32_t magic,version,statesize,npointsize,eventsize;
+    uint32_t fpos,indcounter,prevpos100,crc,numjournal;
+    int32_t numevents;
+    char symbol[KOMODO_ASSETCHAIN_MAXLEN];
+};
+
 #endif /* KOMODO_STRUCTS_H */
@@ -59,6 +59,11 @@ public:
 
         batch.Delete(slKey);
     }
+
+    void Clear()
+    {
+        batch.Clear();
+    }
 };
 
 class CLevelDBWrapper
@@ -168,6 +173,13 @@ public:
     {
         return pdb->NewIterator(iteroptions);
     }
+
+    //! Iterator for short scans of records that are likely to be read again,
+    //! going through the block cache unlike NewIterator()
+    leveldb::Iterator* NewCachedIterator() const
+    {
+        return pdb->NewIterator(readoptions);
+    }
 };
 
 #endif // BITCOIN_LEVELDBWRAPPER_H
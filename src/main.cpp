@@ -77,10 +77,13 @@ bool fTxIndex = false;
 bool fAddressIndex = false;
 bool fTimestampIndex = false;
 bool fSpentIndex = false;
+bool fCCIndex = false;
+bool fAddressBalances = false;
 bool fHavePruned = false;
 bool fPruneMode = false;
 bool fIsBareMultisigStd = true;
 bool fCheckBlockIndex = false;
+bool fCompactBlockIndex = DEFAULT_COMPACT_BLOCKINDEX;
 bool fCheckpointsEnabled = true;
 bool fCoinbaseEnforcedProtectionEnabled = true;
 size_t nCoinCacheUsage = 5000 * 300;
@@ -598,6 +601,12 @@ UniValue komodo_snapshot(int top)
 
     if (fAddressIndex) {
 	    if ( pblocktree != 0 ) {
+		if ( !fAddressBalances ) {
+		    fprintf(stderr,"building address balances from the address unspent index\n");
+		    if ( !pblocktree->RebuildAddressBalances() || !pblocktree->WriteFlag("addressbalances", true) )
+			return(result);
+		    fAddressBalances = true;
+		}
 		result = pblocktree->Snapshot(top);
 	    } else {
 		fprintf(stderr,"null pblocktree start with -addressindex=1\n");
@@ -1005,7 +1014,7 @@ bool ContextualCheckTransaction(const CTransaction& tx, CValidationState &state,
 }
 
 bool CheckTransaction(const CTransaction& tx, CValidationState &state,
-                      libzcash::ProofVerifier& verifier)
+                      libzcash::ProofVerifier& verifier, std::vector<CJoinSplitCheck> *pvChecks)
 {
     static uint256 array[64]; static int32_t numbanned,indallvouts; int32_t j,k,n;
     if ( *(int32_t *)&array[0] == 0 )
@@ -1033,8 +1042,10 @@ bool CheckTransaction(const CTransaction& tx, CValidationState &state,
         return false;
     } else {
         // Ensure that zk-SNARKs v|| y
-        BOOST_FOREACH(const JSDescription &joinsplit, tx.vjoinsplit) {
-            if (!joinsplit.Verify(*pzcashParams, verifier, tx.joinSplitPubKey)) {
+        for (unsigned int i = 0; i < tx.vjoinsplit.size(); i++) {
+            if (pvChecks) {
+                pvChecks->push_back(CJoinSplitCheck(tx, i, verifier));
+            } else if (!tx.vjoinsplit[i].Verify(*pzcashParams, verifier, tx.joinSplitPubKey)) {
                 return state.DoS(100, error("CheckTransaction(): joinsplit does not verify"),
                                  REJECT_INVALID, "bad-txns-joinsplit-verification-failed");
             }
@@ -1476,8 +1487,9 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
         bool fSpendsCoinbase = false;
         if (!tx.IsCoinImport()) {
             BOOST_FOREACH(const CTxIn &txin, tx.vin) {
-                const CCoins *coins = view.AccessCoins(txin.prevout.hash);
-                if (coins->IsCoinBase()) {
+                bool fPrevCoinBase = false;
+                view.AccessOutput(txin.prevout, NULL, &fPrevCoinBase);
+                if (fPrevCoinBase) {
                     fSpendsCoinbase = true;
                     break;
                 }
@@ -1649,6 +1661,122 @@ bool GetAddressUnspent(uint160 addressHash, int type,
     return true;
 }
 
+bool GetAddressIndexPage(const std::vector<std::pair<uint160, int> > &addresses, const std::string &cursor,
+                         int start, int end, unsigned int limit,
+                         std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, std::string &next)
+{
+    if (!fAddressIndex)
+        return error("address index not enabled");
+
+    if (!pblocktree->ReadAddressIndexPage(addresses, cursor, start, end, limit, addressIndex, next))
+        return error("unable to get txids for address");
+
+    return true;
+}
+
+bool GetAddressUnspentPage(const std::vector<std::pair<uint160, int> > &addresses, const std::string &cursor,
+                           unsigned int limit,
+                           std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs, std::string &next)
+{
+    if (!fAddressIndex)
+        return error("address index not enabled");
+
+    if (!pblocktree->ReadAddressUnspentIndexPage(addresses, cursor, limit, unspentOutputs, next))
+        return error("unable to get txids for address");
+
+    return true;
+}
+
+bool GetCCIndexUnspent(uint8_t evalcode, uint256 reftxid, uint8_t funcid,
+                       std::vector<std::pair<CCCIndexKey, CCCIndexValue> > &unspentOutputs)
+{
+    if (!fCCIndex)
+        return false;
+
+    if (!pblocktree->ReadCCIndex(evalcode, reftxid, funcid, unspentOutputs))
+        return error("unable to get unspent outputs for contract");
+
+    return true;
+}
+
+uint8_t CCindexDecodeOpRet(uint256 txid,const CScript &scriptPubKey,uint8_t &evalcode,uint256 &reftxid);
+void AssetsBookConnectBlock(const CBlock &block,int32_t height);
+void AssetsBookDisconnectBlock(const CBlock &block);
+
+/**
+ * Build the -ccindex entries for the crypto-condition outputs of tx. The contract and
+ * reference txid come from the opreturn in the last vout, so outputs of transactions
+ * without a decodable opreturn are not indexed.
+ */
+static void GetCCIndexOutputs(const CTransaction &tx, int nHeight, std::vector<std::pair<CCCIndexKey, CCCIndexValue> > &outputs)
+{
+    uint8_t evalcode; uint256 reftxid;
+    if (tx.vout.size() < 2)
+        return;
+    const CScript &opret = tx.vout[tx.vout.size()-1].scriptPubKey;
+    uint256 txhash = tx.GetHash();
+    uint8_t funcid = CCindexDecodeOpRet(txhash, opret, evalcode, reftxid);
+    if (evalcode == 0 || funcid == 0)
+        return;
+    for (unsigned int k = 0; k < tx.vout.size()-1; k++) {
+        const CTxOut &out = tx.vout[k];
+        if (out.scriptPubKey.IsPayToCryptoCondition())
+            outputs.push_back(make_pair(CCCIndexKey(evalcode, reftxid, funcid, txhash, k), CCCIndexValue(out.nValue, out.scriptPubKey, opret, nHeight)));
+    }
+}
+
+/**
+ * Queue the -ccindex changes of connecting tx. Spent contract outputs are looked up
+ * first among the outputs created earlier in the same block, then in the outpoint
+ * table, so no transaction needs to be fetched from disk.
+ */
+static void CCIndexConnectTx(const CTransaction &tx, int nHeight,
+                             std::map<CSpentIndexKey, CCCIndexKey, CSpentIndexKeyCompare> &blockOutputs,
+                             std::vector<std::pair<CCCIndexKey, CCCIndexValue> > &ccUnspent,
+                             std::vector<std::pair<CCCIndexKey, CCCIndexValue> > &ccOutpoints)
+{
+    if (!tx.IsMint()) {
+        BOOST_FOREACH(const CTxIn &input, tx.vin) {
+            CSpentIndexKey outpoint(input.prevout.hash, input.prevout.n);
+            std::map<CSpentIndexKey, CCCIndexKey, CSpentIndexKeyCompare>::iterator mi = blockOutputs.find(outpoint);
+            if (mi != blockOutputs.end()) {
+                ccUnspent.push_back(make_pair(mi->second, CCCIndexValue()));
+                continue;
+            }
+            CCCIndexKey key; CCCIndexValue value;
+            if (pblocktree->ReadCCIndexOutpoint(input.prevout.hash, input.prevout.n, key, value))
+                ccUnspent.push_back(make_pair(key, CCCIndexValue()));
+        }
+    }
+    std::vector<std::pair<CCCIndexKey, CCCIndexValue> > outputs;
+    GetCCIndexOutputs(tx, nHeight, outputs);
+    for (unsigned int k = 0; k < outputs.size(); k++) {
+        blockOutputs[CSpentIndexKey(outputs[k].first.txhash, outputs[k].first.index)] = outputs[k].first;
+        ccUnspent.push_back(outputs[k]);
+        ccOutpoints.push_back(outputs[k]);
+    }
+}
+
+/** Queue the -ccindex changes that undo CCIndexConnectTx. */
+static void CCIndexDisconnectTx(const CTransaction &tx, int nHeight,
+                                std::vector<std::pair<CCCIndexKey, CCCIndexValue> > &ccUnspent,
+                                std::vector<std::pair<CCCIndexKey, CCCIndexValue> > &ccOutpoints)
+{
+    std::vector<std::pair<CCCIndexKey, CCCIndexValue> > outputs;
+    GetCCIndexOutputs(tx, nHeight, outputs);
+    for (unsigned int k = 0; k < outputs.size(); k++) {
+        ccUnspent.push_back(make_pair(outputs[k].first, CCCIndexValue()));
+        ccOutpoints.push_back(make_pair(outputs[k].first, CCCIndexValue()));
+    }
+    if (!tx.IsMint()) {
+        BOOST_FOREACH(const CTxIn &input, tx.vin) {
+            CCCIndexKey key; CCCIndexValue value;
+            if (pblocktree->ReadCCIndexOutpoint(input.prevout.hash, input.prevout.n, key, value))
+                ccUnspent.push_back(make_pair(key, value));
+        }
+    }
+}
+
 /*uint64_t myGettxout(uint256 hash,int32_t n)
 {
     CCoins coins;
@@ -1861,6 +1989,79 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex,bool checkPOW)
     return true;
 }
 
+//! Number of recently served raw blocks kept in memory
+static const unsigned int RAW_BLOCK_CACHE_SIZE = 8;
+//! Only blocks this close to the tip are cached, older ones are fetched once by syncing peers
+static const int RAW_BLOCK_CACHE_DEPTH = 100;
+
+static CCriticalSection cs_rawblockcache;
+static std::list<std::pair<uint256, std::shared_ptr<const CDataStream> > > lRawBlockCache; // most recently used first
+
+static bool FindRawBlockCache(std::shared_ptr<const CDataStream>& pblock, const uint256& hash)
+{
+    AssertLockHeld(cs_rawblockcache);
+    for (std::list<std::pair<uint256, std::shared_ptr<const CDataStream> > >::iterator it = lRawBlockCache.begin(); it != lRawBlockCache.end(); it++) {
+        if (it->first == hash) {
+            pblock = it->second;
+            lRawBlockCache.splice(lRawBlockCache.begin(), lRawBlockCache, it);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ReadRawBlockFromDisk(std::shared_ptr<const CDataStream>& pblock, const CBlockIndex* pindex)
+{
+    if ( pindex == 0 )
+        return false;
+    uint256 hash = pindex->GetBlockHash();
+    {
+        LOCK(cs_rawblockcache);
+        if (FindRawBlockCache(pblock, hash))
+            return true;
+    }
+
+    // The serialized size is stored right in front of the block, see WriteBlockToDisk
+    CDiskBlockPos pos = pindex->GetBlockPos();
+    if (pos.IsNull() || pos.nPos < sizeof(unsigned int))
+        return error("%s: no block data for %s", __func__, hash.ToString());
+    pos.nPos -= sizeof(unsigned int);
+    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
+
+    std::shared_ptr<CDataStream> ssBlock(new CDataStream(SER_NETWORK, PROTOCOL_VERSION));
+    try {
+        unsigned int nSize;
+        filein >> nSize;
+        if (nSize < CBlockHeader::HEADER_SIZE || nSize > MAX_BLOCK_SIZE)
+            return error("%s: invalid block size %u at %s", __func__, nSize, pos.ToString());
+        ssBlock->resize(nSize);
+        filein.read(&(*ssBlock)[0], nSize);
+
+        // Only the header is deserialized, to check the data against the index
+        CBlockHeader header;
+        *ssBlock >> header;
+        ssBlock->Rewind(nSize - ssBlock->size());
+        if (header.GetHash() != hash)
+            return error("%s: GetHash() doesn't match index for %s at %s", __func__, pindex->ToString(), pos.ToString());
+    } catch (const std::exception& e) {
+        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+    pblock = ssBlock;
+
+    if (pindex->nHeight + RAW_BLOCK_CACHE_DEPTH > chainActive.Height()) {
+        LOCK(cs_rawblockcache);
+        std::shared_ptr<const CDataStream> pcached;
+        if (!FindRawBlockCache(pcached, hash)) {
+            lRawBlockCache.push_front(std::make_pair(hash, pblock));
+            if (lRawBlockCache.size() > RAW_BLOCK_CACHE_SIZE)
+                lRawBlockCache.pop_back();
+        }
+    }
+    return true;
+}
+
 //uint64_t komodo_moneysupply(int32_t height);
 extern char ASSETCHAINS_SYMBOL[KOMODO_ASSETCHAIN_MAXLEN];
 extern uint32_t ASSETCHAINS_MAGIC;
@@ -2132,20 +2333,10 @@ void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, CTxUndo &txund
     {
         txundo.vprevout.reserve(tx.vin.size());
         BOOST_FOREACH(const CTxIn &txin, tx.vin) {
-            CCoinsModifier coins = inputs.ModifyCoins(txin.prevout.hash);
-            unsigned nPos = txin.prevout.n;
-            
-            if (nPos >= coins->vout.size() || coins->vout[nPos].IsNull())
-                assert(false);
             // mark an outpoint spent, and construct undo information
-            txundo.vprevout.push_back(CTxInUndo(coins->vout[nPos]));
-            coins->Spend(nPos);
-            if (coins->vout.size() == 0) {
-                CTxInUndo& undo = txundo.vprevout.back();
-                undo.nHeight = coins->nHeight;
-                undo.fCoinBase = coins->fCoinBase;
-                undo.nVersion = coins->nVersion;
-            }
+            txundo.vprevout.push_back(CTxInUndo());
+            if (!inputs.SpendOutput(txin.prevout, &txundo.vprevout.back()))
+                assert(false);
         }
     }
     BOOST_FOREACH(const JSDescription &joinsplit, tx.vjoinsplit) { // spend nullifiers
@@ -2169,6 +2360,18 @@ void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight)
     UpdateCoins(tx, inputs, txundo, nHeight);
 }
 
+bool CJoinSplitCheck::operator()() {
+    const JSDescription &joinsplit = ptxTo->vjoinsplit[nJoinSplit];
+    if (!joinsplit.Verify(*pzcashParams, *pverifier, ptxTo->joinSplitPubKey)) {
+        return ::error("CJoinSplitCheck(): %s:%d joinsplit does not verify", ptxTo->GetHash().ToString(), nJoinSplit);
+    }
+    return true;
+}
+
+bool CEquihashCheck::operator()() {
+    return CheckEquihashSolution(pheader, Params());
+}
+
 bool CScriptCheck::operator()() {
     const CScript &scriptSig = ptxTo->vin[nIn].scriptSig;
     ServerTransactionSignatureChecker checker(ptxTo, nIn, amount, cacheStore, *txdata);
@@ -2202,14 +2405,16 @@ namespace Consensus {
         for (unsigned int i = 0; i < tx.vin.size(); i++)
         {
             const COutPoint &prevout = tx.vin[i].prevout;
-            const CCoins *coins = inputs.AccessCoins(prevout.hash);
-            assert(coins);
+            int nPrevHeight;
+            bool fPrevCoinBase;
+            const CTxOut *prevTxOut = inputs.AccessOutput(prevout, &nPrevHeight, &fPrevCoinBase);
+            assert(prevTxOut);
             
-            if (coins->IsCoinBase()) {
+            if (fPrevCoinBase) {
                 // Ensure that coinbases are matured
-                if (nSpendHeight - coins->nHeight < COINBASE_MATURITY) {
+                if (nSpendHeight - nPrevHeight < COINBASE_MATURITY) {
                     return state.Invalid(
-                                         error("CheckInputs(): tried to spend coinbase at depth %d", nSpendHeight - coins->nHeight),
+                                         error("CheckInputs(): tried to spend coinbase at depth %d", nSpendHeight - nPrevHeight),
                                          REJECT_INVALID, "bad-txns-premature-spend-of-coinbase");
                 }
                 
@@ -2225,22 +2430,22 @@ namespace Consensus {
             }
             
             // Check for negative or overflow input values
-            nValueIn += coins->vout[prevout.n].nValue;
+            nValueIn += prevTxOut->nValue;
 #ifdef KOMODO_ENABLE_INTEREST
             if ( ASSETCHAINS_SYMBOL[0] == 0 && nSpendHeight > 60000 )//chainActive.LastTip() != 0 && chainActive.LastTip()->nHeight >= 60000 )
             {
-                if ( coins->vout[prevout.n].nValue >= 10*COIN )
+                if ( prevTxOut->nValue >= 10*COIN )
                 {
                     int64_t interest; int32_t txheight; uint32_t locktime;
-                    if ( (interest= komodo_accrued_interest(&txheight,&locktime,prevout.hash,prevout.n,0,coins->vout[prevout.n].nValue,(int32_t)nSpendHeight-1)) != 0 )
+                    if ( (interest= komodo_accrued_interest(&txheight,&locktime,prevout.hash,prevout.n,0,prevTxOut->nValue,(int32_t)nSpendHeight-1)) != 0 )
                     {
-                        //fprintf(stderr,"checkResult %.8f += val %.8f interest %.8f ht.%d lock.%u tip.%u\n",(double)nValueIn/COIN,(double)coins->vout[prevout.n].nValue/COIN,(double)interest/COIN,txheight,locktime,chainActive.LastTip()->nTime);
+                        //fprintf(stderr,"checkResult %.8f += val %.8f interest %.8f ht.%d lock.%u tip.%u\n",(double)nValueIn/COIN,(double)prevTxOut->nValue/COIN,(double)interest/COIN,txheight,locktime,chainActive.LastTip()->nTime);
                         nValueIn += interest;
                     }
                 }
             }
 #endif
-            if (!MoneyRange(coins->vout[prevout.n].nValue) || !MoneyRange(nValueIn))
+            if (!MoneyRange(prevTxOut->nValue) || !MoneyRange(nValueIn))
                 return state.DoS(100, error("CheckInputs(): txin values out of range"),
                                  REJECT_INVALID, "bad-txns-inputvalues-outofrange");
             
@@ -2300,12 +2505,11 @@ bool ContextualCheckInputs(
         // still computed and checked, and any change will be caught at the next checkpoint.
         if (fScriptChecks) {
             for (unsigned int i = 0; i < tx.vin.size(); i++) {
-                const COutPoint &prevout = tx.vin[i].prevout;
-                const CCoins* coins = inputs.AccessCoins(prevout.hash);
-                assert(coins);
+                const CTxOut* prevTxOut = inputs.AccessOutput(tx.vin[i].prevout);
+                assert(prevTxOut);
                 
                 // Verify signature
-                CScriptCheck check(*coins, tx, i, flags, cacheStore, consensusBranchId, &txdata);
+                CScriptCheck check(*prevTxOut, tx, i, flags, cacheStore, consensusBranchId, &txdata);
                 if (pvChecks) {
                     pvChecks->push_back(CScriptCheck());
                     check.swap(pvChecks->back());
@@ -2317,7 +2521,7 @@ bool ContextualCheckInputs(
                         // arguments; if so, don't trigger DoS protection to
                         // avoid splitting the network between upgraded and
                         // non-upgraded nodes.
-                        CScriptCheck check2(*coins, tx, i,
+                        CScriptCheck check2(*prevTxOut, tx, i,
                                             flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore, consensusBranchId, &txdata);
                         if (check2())
                             return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
@@ -2543,11 +2747,14 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
     std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
     std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+    std::vector<std::pair<CCCIndexKey, CCCIndexValue> > ccUnspent, ccOutpoints;
 
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--) {
         const CTransaction &tx = block.vtx[i];
         uint256 hash = tx.GetHash();
+        if (fCCIndex)
+            CCIndexDisconnectTx(tx, pindex->nHeight, ccUnspent, ccOutpoints);
         if (fAddressIndex) {
 
             for (unsigned int k = tx.vout.size(); k-- > 0;) {
@@ -2718,8 +2925,20 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
         if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
             return AbortNode(state, "Failed to write address unspent index");
         }
+        if (fAddressBalances && !pblocktree->UpdateAddressBalances(addressIndex, false)) {
+            return AbortNode(state, "Failed to write address balances");
+        }
     }
 
+    if (fCCIndex) {
+        if (!pblocktree->UpdateCCIndex(ccUnspent, ccOutpoints)) {
+            return AbortNode(state, "Failed to delete cc index");
+        }
+    }
+
+    if ( ASSETCHAINS_CC != 0 )
+        AssetsBookDisconnectBlock(block);
+
     return fClean;
 }
 
@@ -2755,6 +2974,44 @@ void ThreadScriptCheck() {
     scriptcheckqueue.Thread();
 }
 
+// Each proof takes milliseconds to verify, so workers take them one at a time.
+// cs_joinsplitcheckqueue keeps concurrent CheckBlock callers from sharing the queue.
+static CCheckQueue<CJoinSplitCheck> joinsplitcheckqueue(1);
+static CCriticalSection cs_joinsplitcheckqueue;
+
+void ThreadJoinSplitCheck() {
+    RenameThread("zcash-jscheck");
+    joinsplitcheckqueue.Thread();
+}
+
+// Headers arrive at most MAX_HEADERS_RESULTS at a time and each solution
+// takes well under a millisecond, so workers take a few at once.
+static CCheckQueue<CEquihashCheck> headercheckqueue(4);
+static CCriticalSection cs_headercheckqueue;
+
+void ThreadHeaderCheck() {
+    RenameThread("zcash-hdrcheck");
+    headercheckqueue.Thread();
+}
+
+/** Check the Equihash solutions of a batch of headers, over the -par workers if there are any */
+static bool CheckHeaderSolutions(std::vector<CEquihashCheck>& vChecks)
+{
+    TRY_LOCK(cs_headercheckqueue, fHeaderQueue);
+    if (fHeaderQueue && nScriptCheckThreads)
+    {
+        CCheckQueueControl<CEquihashCheck> control(&headercheckqueue);
+        control.Add(vChecks);
+        return control.Wait();
+    }
+    BOOST_FOREACH(CEquihashCheck& check, vChecks)
+    {
+        if (!check())
+            return false;
+    }
+    return true;
+}
+
 //
 // Called periodically asynchronously; alerts if it smells like
 // we're being fed a bad chain (blocks being generated much
@@ -2913,6 +3170,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
     std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+    std::vector<std::pair<CCCIndexKey, CCCIndexValue> > ccUnspent, ccOutpoints;
+    std::map<CSpentIndexKey, CCCIndexKey, CSpentIndexKeyCompare> ccBlockOutputs;
     // Construct the incremental merkle tree at the current
     // block position,
     auto old_tree_root = view.GetBestAnchor();
@@ -3076,6 +3335,9 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             }
         }
 
+        if (fCCIndex)
+            CCIndexConnectTx(tx, pindex->nHeight, ccBlockOutputs, ccUnspent, ccOutpoints);
+
         //if ( ASSETCHAINS_SYMBOL[0] == 0 )
         //    komodo_earned_interest(pindex->nHeight,sum);
         CTxUndo undoDummy;
@@ -3165,11 +3427,28 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         setDirtyBlockIndex.insert(pindex);
     }
 
+    // cache the coinbase pubkey so notary eligibility checks of later blocks stay in memory
+    if ((pindex->nStatus & BLOCK_HAVE_PRODUCER) == 0) {
+        komodo_pindex_setproducer(pindex, (CBlock *)&block);
+        setDirtyBlockIndex.insert(pindex);
+    }
+
     ConnectNotarisations(block, pindex->nHeight);
     
     if (fTxIndex)
         if (!pblocktree->WriteTxIndex(vPos))
             return AbortNode(state, "Failed to write transaction index");
+
+    // cache the stake segid once, komodo_segids reads it for the 100 blocks after this one
+    if (ASSETCHAINS_STAKED != 0 && (pindex->nStatus & BLOCK_HAVE_SEGID) == 0) {
+        int32_t cacheable = 1;
+        int8_t segid = komodo_blocksegid(&cacheable, (CBlock *)&block, pindex->nHeight);
+        if (cacheable != 0) {
+            komodo_pindex_setsegid(pindex, segid);
+            setDirtyBlockIndex.insert(pindex);
+        }
+    }
+
     if (fAddressIndex) {
         if (!pblocktree->WriteAddressIndex(addressIndex)) {
             return AbortNode(state, "Failed to write address index");
@@ -3178,12 +3457,23 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
             return AbortNode(state, "Failed to write address unspent index");
         }
+
+        if (fAddressBalances && !pblocktree->UpdateAddressBalances(addressIndex, true)) {
+            return AbortNode(state, "Failed to write address balances");
+        }
     }
 
     if (fSpentIndex)
         if (!pblocktree->UpdateSpentIndex(spentIndex))
             return AbortNode(state, "Failed to write transaction index");
 
+    if (fCCIndex)
+        if (!pblocktree->UpdateCCIndex(ccUnspent, ccOutpoints))
+            return AbortNode(state, "Failed to write cc index");
+
+    if ( ASSETCHAINS_CC != 0 )
+        AssetsBookConnectBlock(block, pindex->nHeight);
+
     if (fTimestampIndex) {
         unsigned int logicalTS = pindex->nTime;
         unsigned int prevLogicalTS = 0;
@@ -3220,7 +3510,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     LogPrint("bench", "    - Callbacks: %.2fms [%.2fs]\n", 0.001 * (nTime4 - nTime3), nTimeCallbacks * 0.000001);
     
     //FlushStateToDisk();
-    komodo_connectblock(pindex,*(CBlock *)&block);
+    komodo_connectblock(pindex,*(CBlock *)&block,&blockundo);
     return true;
 }
 
@@ -3302,6 +3592,12 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
                 if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile, vBlocks)) {
                     return AbortNode(state, "Files to write to block index database");
                 }
+                // The solutions of these entries can now be read back from the block index database
+                if (fCompactBlockIndex) {
+                    BOOST_FOREACH(const CBlockIndex *pblockindex, vBlocks) {
+                        const_cast<CBlockIndex *>(pblockindex)->TrimSolution();
+                    }
+                }
             }
             // Finally remove any pruned files
             if (fFlushForPrune)
@@ -3348,6 +3644,7 @@ void PruneAndFlush() {
 void static UpdateTip(CBlockIndex *pindexNew) {
     const CChainParams& chainParams = Params();
     chainActive.SetTip(pindexNew);
+    komodo_segids_tip(pindexNew);
     
     // New best block
     nTimeBestReceived = GetTime();
@@ -4254,12 +4551,18 @@ bool CheckBlock(int32_t *futureblockp,int32_t height,CBlockIndex *pindex,const C
         }
         //fprintf(stderr,"done putting block's tx into mempool\n");
     }
+    // JoinSplit proofs are spread over the -par workers while the rest of the block is checked
+    TRY_LOCK(cs_joinsplitcheckqueue, fJoinSplitQueue);
+    bool fParallelProofs = fJoinSplitQueue && nScriptCheckThreads;
+    CCheckQueueControl<CJoinSplitCheck> control(fParallelProofs ? &joinsplitcheckqueue : NULL);
     BOOST_FOREACH(const CTransaction& tx, block.vtx)
     {
         if ( komodo_validate_interest(tx,height == 0 ? komodo_block2height((CBlock *)&block) : height,block.nTime,0) < 0 )
             return error("CheckBlock: komodo_validate_interest failed");
-        if (!CheckTransaction(tx, state, verifier))
+        std::vector<CJoinSplitCheck> vChecks;
+        if (!CheckTransaction(tx, state, verifier, fParallelProofs ? &vChecks : NULL))
             return error("CheckBlock: CheckTransaction failed");
+        control.Add(vChecks);
     }
     unsigned int nSigOps = 0;
     BOOST_FOREACH(const CTransaction& tx, block.vtx)
@@ -4277,6 +4580,9 @@ bool CheckBlock(int32_t *futureblockp,int32_t height,CBlockIndex *pindex,const C
         LogPrintf("CheckBlockHeader komodo_check_deposit error");
         return(false);
     }
+    if (!control.Wait())
+        return state.DoS(100, error("CheckBlock: joinsplit does not verify"),
+                         REJECT_INVALID, "bad-txns-joinsplit-verification-failed");
     return true;
 }
 
@@ -4924,22 +5230,28 @@ CBlockIndex * InsertBlockIndex(uint256 hash)
 bool static LoadBlockIndexDB()
 {
     const CChainParams& chainparams = Params();
+    int64_t nTimeStart = GetTimeMicros();
     LogPrintf("%s: start loading guts\n", __func__);
     if (!pblocktree->LoadBlockIndexGuts())
         return false;
-    LogPrintf("%s: loaded guts\n", __func__);
+    int64_t nTimeGuts = GetTimeMicros();
+    LogPrintf("%s: loaded guts in %.2fs\n", __func__, (nTimeGuts - nTimeStart) * 0.000001);
     boost::this_thread::interruption_point();
     
     // Calculate nChainWork
     vector<pair<int, CBlockIndex*> > vSortedByHeight;
     vSortedByHeight.reserve(mapBlockIndex.size());
+    size_t nSolutionBytes = 0;
     BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
     {
         CBlockIndex* pindex = item.second;
         vSortedByHeight.push_back(make_pair(pindex->nHeight, pindex));
+        nSolutionBytes += pindex->nSolution.capacity();
         //komodo_pindex_init(pindex,(int32_t)pindex->nHeight);
     }
     //fprintf(stderr,"load blockindexDB paired %u\n",(uint32_t)time(NULL));
+    LogPrintf("%s: %u entries, %.1fMiB in CBlockIndex, %.1fMiB in Equihash solutions%s\n", __func__, mapBlockIndex.size(),
+              mapBlockIndex.size() * sizeof(CBlockIndex) * (1.0 / (1<<20)), nSolutionBytes * (1.0 / (1<<20)), fCompactBlockIndex ? " (compact)" : "");
     sort(vSortedByHeight.begin(), vSortedByHeight.end());
     //fprintf(stderr,"load blockindexDB sorted %u\n",(uint32_t)time(NULL));
     BOOST_FOREACH(const PAIRTYPE(int, CBlockIndex*)& item, vSortedByHeight)
@@ -4991,6 +5303,8 @@ bool static LoadBlockIndexDB()
         //komodo_pindex_init(pindex,(int32_t)pindex->nHeight);
     }
     //fprintf(stderr,"load blockindexDB chained %u\n",(uint32_t)time(NULL));
+    int64_t nTimeChain = GetTimeMicros();
+    LogPrintf("%s: sorted and chained in %.2fs\n", __func__, (nTimeChain - nTimeGuts) * 0.000001);
 
     // Load block file info
     pblocktree->ReadLastBlockFile(nLastBlockFile);
@@ -5045,6 +5359,9 @@ bool static LoadBlockIndexDB()
     // Check whether we have an address index
     pblocktree->ReadFlag("addressindex", fAddressIndex);
     LogPrintf("%s: address index %s\n", __func__, fAddressIndex ? "enabled" : "disabled");
+    // Address balances are built from the unspent index on first use when the database predates them
+    pblocktree->ReadFlag("addressbalances", fAddressBalances);
+    fAddressBalances &= fAddressIndex;
 
     // Check whether we have a timestamp index
     pblocktree->ReadFlag("timestampindex", fTimestampIndex);
@@ -5054,6 +5371,10 @@ bool static LoadBlockIndexDB()
     pblocktree->ReadFlag("spentindex", fSpentIndex);
     LogPrintf("%s: spent index %s\n", __func__, fSpentIndex ? "enabled" : "disabled");
 
+    // Check whether the contract output index is enabled
+    pblocktree->ReadFlag("ccindex", fCCIndex);
+    LogPrintf("%s: cc index %s\n", __func__, fCCIndex ? "enabled" : "disabled");
+
     // Fill in-memory data
     BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
     {
@@ -5069,6 +5390,9 @@ bool static LoadBlockIndexDB()
         //komodo_pindex_init(pindex,(int32_t)pindex->nHeight);
     }
     
+    LogPrintf("%s: block files and flags checked in %.2fs, %.2fs total\n", __func__,
+              (GetTimeMicros() - nTimeChain) * 0.000001, (GetTimeMicros() - nTimeStart) * 0.000001);
+
     // Load pointer to end of best chain
     BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
     if (it == mapBlockIndex.end())
@@ -5389,6 +5713,8 @@ bool InitBlockIndex() {
     // Use the provided setting for -addressindex in the new database
     fAddressIndex = GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
     pblocktree->WriteFlag("addressindex", fAddressIndex);
+    fAddressBalances = fAddressIndex;
+    pblocktree->WriteFlag("addressbalances", fAddressBalances);
 
     // Use the provided setting for -timestampindex in the new database
     fTimestampIndex = GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX);
@@ -5396,6 +5722,8 @@ bool InitBlockIndex() {
     
     fSpentIndex = GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
     pblocktree->WriteFlag("spentindex", fSpentIndex);
+    fCCIndex = GetBoolArg("-ccindex", DEFAULT_CCINDEX);
+    pblocktree->WriteFlag("ccindex", fCCIndex);
     fprintf(stderr,"fAddressIndex.%d/%d fSpentIndex.%d/%d\n",fAddressIndex,DEFAULT_ADDRESSINDEX,fSpentIndex,DEFAULT_SPENTINDEX);
     LogPrintf("Initializing databases...\n");
     
@@ -5867,42 +6195,38 @@ void static ProcessGetData(CNode* pfrom)
                 {
                     // Send block from disk
                     CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second,1))
+                    if (inv.type == MSG_BLOCK)
+                    {
+                        // the serialized block goes out as stored, without a CBlock round-trip
+                        std::shared_ptr<const CDataStream> pblock;
+                        if (!ReadRawBlockFromDisk(pblock, (*mi).second))
+                            assert(!"cannot load block from disk");
+                        pfrom->PushMessage("block", *pblock);
+                    }
+                    else if (!ReadBlockFromDisk(block, (*mi).second,1))
                     {
                         assert(!"cannot load block from disk");
                     }
-                    else
+                    else // MSG_FILTERED_BLOCK
                     {
-                        if (inv.type == MSG_BLOCK)
-                        {
-                            //uint256 hash; int32_t z;
-                            //hash = block.GetHash();
-                            //for (z=31; z>=0; z--)
-                            //    fprintf(stderr,"%02x",((uint8_t *)&hash)[z]);
-                            //fprintf(stderr," send block %d\n",komodo_block2height(&block));
-                            pfrom->PushMessage("block", block);
-                        }
-                        else // MSG_FILTERED_BLOCK)
+                        LOCK(pfrom->cs_filter);
+                        if (pfrom->pfilter)
                         {
-                            LOCK(pfrom->cs_filter);
-                            if (pfrom->pfilter)
-                            {
-                                CMerkleBlock merkleBlock(block, *pfrom->pfilter);
-                                pfrom->PushMessage("merkleblock", merkleBlock);
-                                // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
-                                // This avoids hurting performance by pointlessly requiring a round-trip
-                                // Note that there is currently no way for a node to request any single transactions we didn't send here -
-                                // they must either disconnect and retry or request the full block.
-                                // Thus, the protocol spec specified allows for us to provide duplicate txn here,
-                                // however we MUST always provide at least what the remote peer needs
-                                typedef std::pair<unsigned int, uint256> PairType;
-                                BOOST_FOREACH(PairType& pair, merkleBlock.vMatchedTxn)
-                                if (!pfrom->setInventoryKnown.count(CInv(MSG_TX, pair.second)))
-                                    pfrom->PushMessage("tx", block.vtx[pair.first]);
-                            }
-                            // else
-                            // no response
+                            CMerkleBlock merkleBlock(block, *pfrom->pfilter);
+                            pfrom->PushMessage("merkleblock", merkleBlock);
+                            // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
+                            // This avoids hurting performance by pointlessly requiring a round-trip
+                            // Note that there is currently no way for a node to request any single transactions we didn't send here -
+                            // they must either disconnect and retry or request the full block.
+                            // Thus, the protocol spec specified allows for us to provide duplicate txn here,
+                            // however we MUST always provide at least what the remote peer needs
+                            typedef std::pair<unsigned int, uint256> PairType;
+                            BOOST_FOREACH(PairType& pair, merkleBlock.vMatchedTxn)
+                            if (!pfrom->setInventoryKnown.count(CInv(MSG_TX, pair.second)))
+                                pfrom->PushMessage("tx", block.vtx[pair.first]);
                         }
+                        // else
+                        // no response
                     }
                     // Trigger the peer node to send a getblocks request for the next batch of inventory
                     if (inv.hash == pfrom->hashContinue)
@@ -6539,8 +6863,25 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
         }
         
+        // AcceptBlockHeader leaves the solution to CheckBlock, so check the
+        // new headers here, in parallel and without holding cs_main
+        std::vector<CEquihashCheck> vChecks;
+        {
+            LOCK(cs_main);
+            BOOST_FOREACH(const CBlockHeader& header, headers) {
+                if (mapBlockIndex.count(header.GetHash()) == 0)
+                    vChecks.push_back(CEquihashCheck(header));
+            }
+        }
+        bool fValidSolutions = CheckHeaderSolutions(vChecks);
+        
         LOCK(cs_main);
         
+        if (!fValidSolutions) {
+            Misbehaving(pfrom->GetId(), 100);
+            return error("invalid header solution received");
+        }
+        
         if (nCount == 0) {
             // Nothing interesting. Stop asking this peers for more headers.
             return true;
@@ -31,6 +31,7 @@
 #include <algorithm>
 #include <exception>
 #include <map>
+#include <memory>
 #include <set>
 #include <stdint.h>
 #include <string>
@@ -44,6 +45,7 @@ class CBlockTreeDB;
 class CBloomFilter;
 class CInv;
 class CScriptCheck;
+class CJoinSplitCheck;
 class CValidationInterface;
 class CValidationState;
 class PrecomputedTransactionData;
@@ -107,6 +109,8 @@ static const unsigned int MAX_REJECT_MESSAGE_LENGTH = 111;
 #define DEFAULT_ADDRESSINDEX (GetArg("-ac_cc",0) != 0 || GetArg("-ac_ccactivate",0) != 0)
 #define DEFAULT_SPENTINDEX (GetArg("-ac_cc",0) != 0 || GetArg("-ac_ccactivate",0) != 0)
 static const bool DEFAULT_TIMESTAMPINDEX = false;
+static const bool DEFAULT_CCINDEX = false;
+static const bool DEFAULT_COMPACT_BLOCKINDEX = true;
 static const unsigned int DEFAULT_DB_MAX_OPEN_FILES = 1000;
 static const bool DEFAULT_DB_COMPRESSION = true;
 
@@ -141,6 +145,7 @@ extern int nScriptCheckThreads;
 extern bool fTxIndex;
 extern bool fIsBareMultisigStd;
 extern bool fCheckBlockIndex;
+extern bool fCompactBlockIndex;
 extern bool fCheckpointsEnabled;
 // TODO: remove this flag by structuring our code such that
 // it is unneeded for testing
@@ -220,6 +225,10 @@ bool ProcessMessages(CNode* pfrom);
 bool SendMessages(CNode* pto, bool fSendTrickle);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the JoinSplit proof checking thread */
+void ThreadJoinSplitCheck();
+/** Run an instance of the header Equihash checking thread */
+void ThreadHeaderCheck();
 /** Try to detect Partition (network isolation) attacks against us */
 void PartitionCheck(bool (*initialDownloadCheck)(), CCriticalSection& cs, const CBlockIndex *const &bestHeader, int64_t nPowTargetSpacing);
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
@@ -609,6 +618,202 @@ struct CAddressIndexIteratorHeightKey {
     }
 };
 
+/** -ccindex key: crypto-condition output grouped by contract and the txid its opret refers to */
+struct CCCIndexKey {
+    uint8_t evalcode;
+    uint256 reftxid;
+    uint8_t funcid;
+    uint256 txhash;
+    unsigned int index;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 70;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        ser_writedata8(s, evalcode);
+        reftxid.Serialize(s, nType, nVersion);
+        ser_writedata8(s, funcid);
+        txhash.Serialize(s, nType, nVersion);
+        ser_writedata32(s, index);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        evalcode = ser_readdata8(s);
+        reftxid.Unserialize(s, nType, nVersion);
+        funcid = ser_readdata8(s);
+        txhash.Unserialize(s, nType, nVersion);
+        index = ser_readdata32(s);
+    }
+
+    CCCIndexKey(uint8_t e, uint256 ref, uint8_t f, uint256 txid, unsigned int indexValue) {
+        evalcode = e;
+        reftxid = ref;
+        funcid = f;
+        txhash = txid;
+        index = indexValue;
+    }
+
+    CCCIndexKey() {
+        SetNull();
+    }
+
+    void SetNull() {
+        evalcode = 0;
+        reftxid.SetNull();
+        funcid = 0;
+        txhash.SetNull();
+        index = 0;
+    }
+};
+
+struct CCCIndexIteratorKey {
+    uint8_t evalcode;
+    uint256 reftxid;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 33;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        ser_writedata8(s, evalcode);
+        reftxid.Serialize(s, nType, nVersion);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        evalcode = ser_readdata8(s);
+        reftxid.Unserialize(s, nType, nVersion);
+    }
+
+    CCCIndexIteratorKey(uint8_t e, uint256 ref) {
+        evalcode = e;
+        reftxid = ref;
+    }
+
+    CCCIndexIteratorKey() {
+        SetNull();
+    }
+
+    void SetNull() {
+        evalcode = 0;
+        reftxid.SetNull();
+    }
+};
+
+struct CCCIndexValue {
+    CAmount satoshis;
+    CScript script;
+    CScript opret;
+    int blockHeight;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(satoshis);
+        READWRITE(script);
+        READWRITE(opret);
+        READWRITE(blockHeight);
+    }
+
+    CCCIndexValue(CAmount sats, CScript scriptPubKey, CScript opretIn, int height) {
+        satoshis = sats;
+        script = scriptPubKey;
+        opret = opretIn;
+        blockHeight = height;
+    }
+
+    CCCIndexValue() {
+        SetNull();
+    }
+
+    void SetNull() {
+        satoshis = -1;
+        script.clear();
+        opret.clear();
+        blockHeight = 0;
+    }
+
+    bool IsNull() const {
+        return (satoshis == -1);
+    }
+};
+
+/** running balance of an address, keyed by CAddressIndexIteratorKey and kept in step with the address index */
+struct CAddressBalanceValue {
+    CAmount balance;
+    int64_t utxos;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(balance);
+        READWRITE(utxos);
+    }
+
+    CAddressBalanceValue(CAmount amount, int64_t count) {
+        balance = amount;
+        utxos = count;
+    }
+
+    CAddressBalanceValue() {
+        SetNull();
+    }
+
+    void SetNull() {
+        balance = 0;
+        utxos = 0;
+    }
+
+    bool IsNull() const {
+        return (balance == 0 && utxos == 0);
+    }
+};
+
+/** balance ordered key, iterating it from the start yields addresses by descending balance */
+struct CAddressBalanceSortedKey {
+    CAmount balance;
+    unsigned int type;
+    uint160 hashBytes;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 29;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        uint64_t inverted = ~(uint64_t)balance;
+        ser_writedata32be(s, (uint32_t)(inverted >> 32));
+        ser_writedata32be(s, (uint32_t)inverted);
+        ser_writedata8(s, type);
+        hashBytes.Serialize(s, nType, nVersion);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        uint64_t inverted = (uint64_t)ser_readdata32be(s) << 32;
+        inverted |= ser_readdata32be(s);
+        balance = (CAmount)~inverted;
+        type = ser_readdata8(s);
+        hashBytes.Unserialize(s, nType, nVersion);
+    }
+
+    CAddressBalanceSortedKey(CAmount amount, unsigned int addressType, uint160 addressHash) {
+        balance = amount;
+        type = addressType;
+        hashBytes = addressHash;
+    }
+
+    CAddressBalanceSortedKey() {
+        SetNull();
+    }
+
+    void SetNull() {
+        balance = 0;
+        type = 0;
+        hashBytes.SetNull();
+    }
+};
+
 struct CDiskTxPos : public CDiskBlockPos
 {
     unsigned int nTxOffset; // after header
@@ -691,8 +896,10 @@ void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight);
 
 /** Transaction validation functions */
 
-/** Context-independent validity checks */
-bool CheckTransaction(const CTransaction& tx, CValidationState& state, libzcash::ProofVerifier& verifier);
+/** Context-independent validity checks
+ * If pvChecks is not NULL, the JoinSplit proof verifications are appended to it instead of being run inline.
+ */
+bool CheckTransaction(const CTransaction& tx, CValidationState& state, libzcash::ProofVerifier& verifier, std::vector<CJoinSplitCheck> *pvChecks = NULL);
 bool CheckTransactionWithoutProofVerification(const CTransaction& tx, CValidationState &state);
 
 /** Check for standard transaction types
@@ -754,6 +961,9 @@ public:
     CScriptCheck(const CCoins& txFromIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn, uint32_t consensusBranchIdIn, PrecomputedTransactionData* txdataIn) :
         scriptPubKey(txFromIn.vout[txToIn.vin[nInIn].prevout.n].scriptPubKey), amount(txFromIn.vout[txToIn.vin[nInIn].prevout.n].nValue),
         ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), consensusBranchId(consensusBranchIdIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn) { }
+    CScriptCheck(const CTxOut& txoutFromIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn, uint32_t consensusBranchIdIn, PrecomputedTransactionData* txdataIn) :
+        scriptPubKey(txoutFromIn.scriptPubKey), amount(txoutFromIn.nValue),
+        ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), consensusBranchId(consensusBranchIdIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn) { }
 
     bool operator()();
 
@@ -772,6 +982,51 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
+/**
+ * Closure representing one JoinSplit proof verification
+ * Note that this stores references to the transaction and the verifier
+ */
+class CJoinSplitCheck
+{
+private:
+    const CTransaction *ptxTo;
+    unsigned int nJoinSplit;
+    libzcash::ProofVerifier *pverifier;
+
+public:
+    CJoinSplitCheck(): ptxTo(0), nJoinSplit(0), pverifier(0) {}
+    CJoinSplitCheck(const CTransaction& txToIn, unsigned int nJoinSplitIn, libzcash::ProofVerifier& verifierIn) :
+        ptxTo(&txToIn), nJoinSplit(nJoinSplitIn), pverifier(&verifierIn) { }
+
+    bool operator()();
+
+    void swap(CJoinSplitCheck &check) {
+        std::swap(ptxTo, check.ptxTo);
+        std::swap(nJoinSplit, check.nJoinSplit);
+        std::swap(pverifier, check.pverifier);
+    }
+};
+
+/**
+ * Closure representing the Equihash solution check of one block header
+ * Note that this stores a reference to the header
+ */
+class CEquihashCheck
+{
+private:
+    const CBlockHeader *pheader;
+
+public:
+    CEquihashCheck(): pheader(0) {}
+    CEquihashCheck(const CBlockHeader& headerIn) : pheader(&headerIn) { }
+
+    bool operator()();
+
+    void swap(CEquihashCheck &check) {
+        std::swap(pheader, check.pheader);
+    }
+};
+
 bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes);
 bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
 bool GetAddressIndex(uint160 addressHash, int type,
@@ -779,11 +1034,23 @@ bool GetAddressIndex(uint160 addressHash, int type,
                      int start = 0, int end = 0);
 bool GetAddressUnspent(uint160 addressHash, int type,
                        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs);
+/** Paged variants for large address sets: at most limit entries after the cursor, next is empty on the last page */
+bool GetAddressIndexPage(const std::vector<std::pair<uint160, int> > &addresses, const std::string &cursor,
+                         int start, int end, unsigned int limit,
+                         std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, std::string &next);
+bool GetAddressUnspentPage(const std::vector<std::pair<uint160, int> > &addresses, const std::string &cursor,
+                           unsigned int limit,
+                           std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs, std::string &next);
+/** Unspent -ccindex outputs of a contract that refer to reftxid, funcid 0 matches any funcid */
+bool GetCCIndexUnspent(uint8_t evalcode, uint256 reftxid, uint8_t funcid,
+                       std::vector<std::pair<CCCIndexKey, CCCIndexValue> > &unspentOutputs);
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
-bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos,bool checkPOW);
+bool ReadBlockFromDisk(int32_t height, CBlock& block, const CDiskBlockPos& pos, bool checkPOW);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex,bool checkPOW);
+/** Serialized block as stored on disk, checked against the index by its header only. Recent blocks come from a small in-memory cache */
+bool ReadRawBlockFromDisk(std::shared_ptr<const CDataStream>& pblock, const CBlockIndex* pindex);
 
 
 /** Functions for validating blocks and updating the block tree */
@@ -74,6 +74,11 @@ static inline size_t DynamicUsage(const std::vector<X>& v)
     return MallocUsage(v.capacity() * sizeof(X));
 }
 
+static inline size_t DynamicUsage(const std::vector<bool>& v)
+{
+    return MallocUsage((v.capacity() + 7) / 8);
+}
+
 template<typename X>
 static inline size_t DynamicUsage(const std::set<X>& s)
 {
@@ -88,9 +88,6 @@ bool CheckEquihashSolution(const CBlockHeader *pblock, const CChainParams& param
 
     if ( Params().NetworkIDString() == "regtest" )
         return(true);
-    // Hash state
-    crypto_generichash_blake2b_state state;
-    EhInitialiseState(n, k, state);
 
     // I = the block header minus nonce and solution.
     CEquihashInput I{*pblock};
@@ -99,9 +96,6 @@ bool CheckEquihashSolution(const CBlockHeader *pblock, const CChainParams& param
     ss << I;
     ss << pblock->nNonce;
 
-    // H(I||V||...
-    crypto_generichash_blake2b_update(&state, (unsigned char*)&ss[0], ss.size());
-
     #ifdef ENABLE_RUST
     // Ensure that our Rust interactions are working in production builds. This is
     // temporary and should be removed.
@@ -110,8 +104,9 @@ bool CheckEquihashSolution(const CBlockHeader *pblock, const CChainParams& param
     }
     #endif // ENABLE_RUST
 
+    // H(I||V||... for every index of the solution, four at a time
     bool isValid;
-    EhIsValidSolution(n, k, state, pblock->nSolution, isValid);
+    EhIsValidSolutionForInput(n, k, (unsigned char*)&ss[0], ss.size(), pblock->nSolution, isValid);
     if (!isValid)
         return error("CheckEquihashSolution(): invalid solution");
 
@@ -125,7 +125,7 @@ UniValue blockheaderToJSON(const CBlockIndex* blockindex)
     result.push_back(Pair("merkleroot", blockindex->hashMerkleRoot.GetHex()));
     result.push_back(Pair("time", (int64_t)blockindex->nTime));
     result.push_back(Pair("nonce", blockindex->nNonce.GetHex()));
-    result.push_back(Pair("solution", HexStr(blockindex->nSolution)));
+    result.push_back(Pair("solution", HexStr(blockindex->GetBlockHeader().nSolution)));
     result.push_back(Pair("bits", strprintf("%08x", blockindex->nBits)));
     result.push_back(Pair("difficulty", GetDifficulty(blockindex)));
     result.push_back(Pair("chainwork", blockindex->nChainWork.GetHex()));
@@ -739,17 +739,18 @@ UniValue getblock(const UniValue& params, bool fHelp)
     if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
 
-    if(!ReadBlockFromDisk(block, pblockindex,1))
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
-
     if (!fVerbose)
     {
-        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
-        ssBlock << block;
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
+        std::shared_ptr<const CDataStream> pblock;
+        if (!ReadRawBlockFromDisk(pblock, pblockindex))
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+        std::string strHex = HexStr(pblock->begin(), pblock->end());
         return strHex;
     }
 
+    if(!ReadBlockFromDisk(block, pblockindex,1))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+
     return blockToJSON(block, pblockindex);
 }
 
@@ -1505,6 +1506,13 @@ UniValue mempoolInfoToJSON()
     ret.push_back(Pair("bytes", (int64_t) mempool.GetTotalTxSize()));
     ret.push_back(Pair("usage", (int64_t) mempool.DynamicMemoryUsage()));
 
+    uint64_t nSigCacheHits, nSigCacheMisses;
+    size_t nSigCacheBytes;
+    GetSignatureCacheStats(nSigCacheHits, nSigCacheMisses, nSigCacheBytes);
+    ret.push_back(Pair("sigcachehits", (int64_t) nSigCacheHits));
+    ret.push_back(Pair("sigcachemisses", (int64_t) nSigCacheMisses));
+    ret.push_back(Pair("sigcachebytes", (int64_t) nSigCacheBytes));
+
     return ret;
 }
 
@@ -1519,6 +1527,9 @@ UniValue getmempoolinfo(const UniValue& params, bool fHelp)
             "  \"size\": xxxxx                (numeric) Current tx count\n"
             "  \"bytes\": xxxxx               (numeric) Sum of all tx sizes\n"
             "  \"usage\": xxxxx               (numeric) Total memory usage for the mempool\n"
+            "  \"sigcachehits\": xxxxx        (numeric) Signature checks answered by the signature cache\n"
+            "  \"sigcachemisses\": xxxxx      (numeric) Signature checks not found in the signature cache\n"
+            "  \"sigcachebytes\": xxxxx       (numeric) Memory taken by the signature cache\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getmempoolinfo", "")
@@ -689,6 +689,40 @@ bool getAddressesFromParams(const UniValue& params, std::vector<std::pair<uint16
     return true;
 }
 
+static const int DEFAULT_ADDRESS_PAGE = 1000;
+static const int MAX_ADDRESS_PAGE = 100000;
+
+/** "limit" and/or "cursor" in the request object switch the address index calls to paged results */
+bool getPagingFromParams(const UniValue& params, size_t cursorSize, unsigned int &limit, std::string &cursor)
+{
+    if (!params[0].isObject())
+        return false;
+    UniValue limitValue = find_value(params[0].get_obj(), "limit");
+    UniValue cursorValue = find_value(params[0].get_obj(), "cursor");
+    if (limitValue.isNull() && cursorValue.isNull())
+        return false;
+
+    int n = limitValue.isNum() ? limitValue.get_int() : DEFAULT_ADDRESS_PAGE;
+    if (n <= 0 || n > MAX_ADDRESS_PAGE)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Invalid parameter, limit must be between 1 and %d", MAX_ADDRESS_PAGE));
+    limit = n;
+
+    cursor.clear();
+    if (cursorValue.isStr() && !cursorValue.get_str().empty()) {
+        std::vector<unsigned char> raw = ParseHex(cursorValue.get_str());
+        if (!IsHex(cursorValue.get_str()) || raw.size() != cursorSize)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid parameter, cursor must be the next value of a previous page");
+        cursor.assign(raw.begin(), raw.end());
+    } else if (!cursorValue.isNull() && !cursorValue.isStr()) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid parameter, cursor must be a string");
+    }
+    return true;
+}
+
+// cursors are the index key bytes after (type, hashBytes) followed by (type, hashBytes)
+static const size_t ADDRESSINDEX_CURSOR_SIZE = 66;
+static const size_t ADDRESSUNSPENT_CURSOR_SIZE = 57;
+
 bool heightSort(std::pair<CAddressUnspentKey, CAddressUnspentValue> a,
                 std::pair<CAddressUnspentKey, CAddressUnspentValue> b) {
     return a.second.blockHeight < b.second.blockHeight;
@@ -784,8 +818,10 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp)
             "      ,...\n"
             "    ],\n"
             "  \"chainInfo\"  (boolean) Include chain info with results\n"
+            "  \"limit\"  (number, optional) Return at most this many outputs per call, ordered by txid and outputIndex\n"
+            "  \"cursor\"  (string, optional) The \"next\" value of the previous page\n"
             "}\n"
-            "\nResult\n"
+            "\nResult (with limit or cursor the outputs are returned as {\"utxos\":[...], \"next\":\"cursor\"}, next is omitted on the last page)\n"
             "[\n"
             "  {\n"
             "    \"address\"  (string) The address base58check encoded\n"
@@ -816,14 +852,23 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp)
     }
 
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    unsigned int limit = 0;
+    std::string cursor, next;
+    bool fPaged = getPagingFromParams(params, ADDRESSUNSPENT_CURSOR_SIZE, limit, cursor);
 
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (!GetAddressUnspent((*it).first, (*it).second, unspentOutputs)) {
+    if (fPaged) {
+        if (!GetAddressUnspentPage(addresses, cursor, limit, unspentOutputs, next)) {
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
         }
-    }
+    } else {
+        for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+            if (!GetAddressUnspent((*it).first, (*it).second, unspentOutputs)) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+            }
+        }
 
-    std::sort(unspentOutputs.begin(), unspentOutputs.end(), heightSort);
+        std::sort(unspentOutputs.begin(), unspentOutputs.end(), heightSort);
+    }
 
     UniValue utxos(UniValue::VARR);
 
@@ -843,13 +888,17 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp)
         utxos.push_back(output);
     }
 
-    if (includeChainInfo) {
+    if (includeChainInfo || fPaged) {
         UniValue result(UniValue::VOBJ);
         result.push_back(Pair("utxos", utxos));
+        if (!next.empty())
+            result.push_back(Pair("next", HexStr(next.begin(), next.end())));
 
-        LOCK(cs_main);
-        result.push_back(Pair("hash", chainActive.LastTip()->GetBlockHash().GetHex()));
-        result.push_back(Pair("height", (int)chainActive.Height()));
+        if (includeChainInfo) {
+            LOCK(cs_main);
+            result.push_back(Pair("hash", chainActive.LastTip()->GetBlockHash().GetHex()));
+            result.push_back(Pair("height", (int)chainActive.Height()));
+        }
         return result;
     } else {
         return utxos;
@@ -872,8 +921,10 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
             "  \"start\" (number) The start block height\n"
             "  \"end\" (number) The end block height\n"
             "  \"chainInfo\" (boolean) Include chain info in results, only applies if start and end specified\n"
+            "  \"limit\" (number, optional) Return at most this many deltas per call, ordered by height\n"
+            "  \"cursor\" (string, optional) The \"next\" value of the previous page\n"
             "}\n"
-            "\nResult:\n"
+            "\nResult (with limit or cursor the deltas are returned as {\"deltas\":[...], \"next\":\"cursor\"}, next is omitted on the last page):\n"
             "[\n"
             "  {\n"
             "    \"satoshis\"  (number) The difference of satoshis\n"
@@ -919,15 +970,24 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
     }
 
     std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    unsigned int limit = 0;
+    std::string cursor, next;
+    bool fPaged = getPagingFromParams(params, ADDRESSINDEX_CURSOR_SIZE, limit, cursor);
 
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (start > 0 && end > 0) {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
-        } else {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    if (fPaged) {
+        if (!GetAddressIndexPage(addresses, cursor, start, end, limit, addressIndex, next)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+        }
+    } else {
+        for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+            if (start > 0 && end > 0) {
+                if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
+                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+                }
+            } else {
+                if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
+                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+                }
             }
         }
     }
@@ -972,10 +1032,17 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
         endInfo.push_back(Pair("height", end));
 
         result.push_back(Pair("deltas", deltas));
+        if (!next.empty())
+            result.push_back(Pair("next", HexStr(next.begin(), next.end())));
         result.push_back(Pair("start", startInfo));
         result.push_back(Pair("end", endInfo));
 
         return result;
+    } else if (fPaged) {
+        result.push_back(Pair("deltas", deltas));
+        if (!next.empty())
+            result.push_back(Pair("next", HexStr(next.begin(), next.end())));
+        return result;
     } else {
         return deltas;
     }
@@ -1106,8 +1173,10 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
             "    ]\n"
             "  \"start\" (number) The start block height\n"
             "  \"end\" (number) The end block height\n"
+            "  \"limit\" (number, optional) Scan at most this many address index entries per call\n"
+            "  \"cursor\" (string, optional) The \"next\" value of the previous page\n"
             "}\n"
-            "\nResult:\n"
+            "\nResult (with limit or cursor the txids are returned as {\"txids\":[...], \"next\":\"cursor\"}, next is omitted on the last page):\n"
             "[\n"
             "  \"transactionid\"  (string) The transaction id\n"
             "  ,...\n"
@@ -1135,6 +1204,32 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
     }
 
     std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    unsigned int limit = 0;
+    std::string cursor, next;
+    bool fPaged = getPagingFromParams(params, ADDRESSINDEX_CURSOR_SIZE, limit, cursor);
+
+    if (fPaged) {
+        if (!GetAddressIndexPage(addresses, cursor, start, end, limit, addressIndex, next)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+        }
+
+        // pages come merged in height order, entries of one tx are adjacent and may straddle two pages
+        uint256 lastTxid;
+        if (!cursor.empty())
+            memcpy(lastTxid.begin(), cursor.data() + 8, 32);
+        UniValue txids(UniValue::VARR);
+        for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
+            if (it->first.txhash != lastTxid) {
+                lastTxid = it->first.txhash;
+                txids.push_back(lastTxid.GetHex());
+            }
+        }
+        UniValue result(UniValue::VOBJ);
+        result.push_back(Pair("txids", txids));
+        if (!next.empty())
+            result.push_back(Pair("next", HexStr(next.begin(), next.end())));
+        return result;
+    }
 
     for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
         if (start > 0 && end > 0) {
@@ -6,6 +6,7 @@
 #include "rpcserver.h"
 
 #include "base58.h"
+#include "httpserver.h"
 #include "init.h"
 #include "random.h"
 #include "sync.h"
@@ -14,6 +15,7 @@
 #include "utilstrencodings.h"
 #include "asyncrpcqueue.h"
 
+#include <atomic>
 #include <memory>
 
 #include <univalue.h>
@@ -254,16 +256,71 @@ UniValue stop(const UniValue& params, bool fHelp)
     return buf;
 }
 
+static UniValue LatencyHistogramToJSON(const std::vector<uint64_t>& vHistogram)
+{
+    UniValue ret(UniValue::VOBJ);
+    int64_t nBound = 1;
+    for (size_t i = 0; i < vHistogram.size(); i++, nBound *= 10) {
+        if (i + 1 < vHistogram.size())
+            ret.push_back(Pair(strprintf("<%d", nBound), (uint64_t)vHistogram[i]));
+        else
+            ret.push_back(Pair(strprintf(">=%d", nBound / 10), (uint64_t)vHistogram[i]));
+    }
+    return ret;
+}
+
+UniValue getrpcqueueinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getrpcqueueinfo\n"
+            "\nReturns the state of the RPC work queue, one entry per lane. JSON-RPC calls\n"
+            "get a lane per method and batches share the \"batch\" lane.\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"lane\": \"name\",       (string) the method, \"batch\", or the HTTP path prefix\n"
+            "    \"queued\": n,           (numeric) requests waiting for a worker\n"
+            "    \"running\": n,          (numeric) requests being served\n"
+            "    \"maxrunning\": n,       (numeric) the cap on requests served at once (-rpcmethodthreads)\n"
+            "    \"completed\": n,        (numeric) requests served since startup\n"
+            "    \"rejected\": n,         (numeric) requests turned away because the lane was full\n"
+            "    \"waitms\": { ... },      (object) time spent queued, counted per millisecond bucket\n"
+            "    \"runms\": { ... }        (object) time spent running, counted per millisecond bucket\n"
+            "  }, ...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getrpcqueueinfo", "")
+            + HelpExampleRpc("getrpcqueueinfo", "")
+        );
+
+    UniValue ret(UniValue::VARR);
+    BOOST_FOREACH(const HTTPWorkQueueLaneStats& stats, GetHTTPWorkQueueStats()) {
+        UniValue lane(UniValue::VOBJ);
+        lane.push_back(Pair("lane", stats.name));
+        lane.push_back(Pair("queued", (uint64_t)stats.depth));
+        lane.push_back(Pair("running", stats.running));
+        lane.push_back(Pair("maxrunning", stats.maxRunning));
+        lane.push_back(Pair("completed", (uint64_t)stats.completed));
+        lane.push_back(Pair("rejected", (uint64_t)stats.rejected));
+        lane.push_back(Pair("waitms", LatencyHistogramToJSON(stats.waitHistogram)));
+        lane.push_back(Pair("runms", LatencyHistogramToJSON(stats.runHistogram)));
+        ret.push_back(lane);
+    }
+    return ret;
+}
+
 /**
  * Call Table
  */
 static const CRPCCommand vRPCCommands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
+{ //  category              name                      actor (function)         okSafeMode  okParallel
+  //  --------------------- ------------------------  -----------------------  ----------  ----------
     /* Overall control/query calls */
     { "control",            "getinfo",                &getinfo,                true  }, /* uses wallet if enabled */
     { "control",            "help",                   &help,                   true  },
     { "control",            "stop",                   &stop,                   true  },
+    { "control",            "getrpcqueueinfo",        &getrpcqueueinfo,        true  },
 
     /* P2P networking */
     { "network",            "getnetworkinfo",         &getnetworkinfo,         true  },
@@ -282,23 +339,23 @@ static const CRPCCommand vRPCCommands[] =
     /* Block chain and UTXO */
     { "blockchain",         "coinsupply",             &coinsupply,             true  },
     { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      true  },
-    { "blockchain",         "getbestblockhash",       &getbestblockhash,       true  },
-    { "blockchain",         "getblockcount",          &getblockcount,          true  },
-    { "blockchain",         "getblock",               &getblock,               true  },
-    { "blockchain",         "getblockdeltas",         &getblockdeltas,         false },
-    { "blockchain",         "getblockhashes",         &getblockhashes,         true  },
-    { "blockchain",         "getblockhash",           &getblockhash,           true  },
-    { "blockchain",         "getblockheader",         &getblockheader,         true  },
+    { "blockchain",         "getbestblockhash",       &getbestblockhash,       true,       true  },
+    { "blockchain",         "getblockcount",          &getblockcount,          true,       true  },
+    { "blockchain",         "getblock",               &getblock,               true,       true  },
+    { "blockchain",         "getblockdeltas",         &getblockdeltas,         false,      true  },
+    { "blockchain",         "getblockhashes",         &getblockhashes,         true,       true  },
+    { "blockchain",         "getblockhash",           &getblockhash,           true,       true  },
+    { "blockchain",         "getblockheader",         &getblockheader,         true,       true  },
     { "blockchain",         "getchaintips",           &getchaintips,           true  },
-    { "blockchain",         "getdifficulty",          &getdifficulty,          true  },
-    { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true  },
-    { "blockchain",         "getrawmempool",          &getrawmempool,          true  },
-    { "blockchain",         "gettxout",               &gettxout,               true  },
-    { "blockchain",         "gettxoutproof",          &gettxoutproof,          true  },
-    { "blockchain",         "verifytxoutproof",       &verifytxoutproof,       true  },
+    { "blockchain",         "getdifficulty",          &getdifficulty,          true,       true  },
+    { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true,       true  },
+    { "blockchain",         "getrawmempool",          &getrawmempool,          true,       true  },
+    { "blockchain",         "gettxout",               &gettxout,               true,       true  },
+    { "blockchain",         "gettxoutproof",          &gettxoutproof,          true,       true  },
+    { "blockchain",         "verifytxoutproof",       &verifytxoutproof,       true,       true  },
     { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true  },
     { "blockchain",         "verifychain",            &verifychain,            true  },
-    { "blockchain",         "getspentinfo",           &getspentinfo,           false },
+    { "blockchain",         "getspentinfo",           &getspentinfo,           false,      true  },
     //{ "blockchain",         "paxprice",               &paxprice,               true  },
     //{ "blockchain",         "paxpending",             &paxpending,             true  },
     //{ "blockchain",         "paxprices",              &paxprices,              true  },
@@ -340,9 +397,9 @@ static const CRPCCommand vRPCCommands[] =
 
     /* Raw transactions */
     { "rawtransactions",    "createrawtransaction",   &createrawtransaction,   true  },
-    { "rawtransactions",    "decoderawtransaction",   &decoderawtransaction,   true  },
-    { "rawtransactions",    "decodescript",           &decodescript,           true  },
-    { "rawtransactions",    "getrawtransaction",      &getrawtransaction,      true  },
+    { "rawtransactions",    "decoderawtransaction",   &decoderawtransaction,   true,       true  },
+    { "rawtransactions",    "decodescript",           &decodescript,           true,       true  },
+    { "rawtransactions",    "getrawtransaction",      &getrawtransaction,      true,       true  },
     { "rawtransactions",    "sendrawtransaction",     &sendrawtransaction,     false },
     { "rawtransactions",    "signrawtransaction",     &signrawtransaction,     false }, /* uses wallet if enabled */
 #ifdef ENABLE_WALLET
@@ -442,6 +499,8 @@ static const CRPCCommand vRPCCommands[] =
     { "tokens",       "tokeninfo",        &tokeninfo,         true },
     { "tokens",       "tokenlist",        &tokenlist,         true },
     { "tokens",       "tokenorders",      &tokenorders,       true },
+    { "tokens",       "tokenbook",        &tokenbook,         true },
+    { "tokens",       "tokenbestprice",   &tokenbestprice,    true },
     { "tokens",       "tokenaddress",     &tokenaddress,      true },
     { "tokens",       "tokenbalance",     &tokenbalance,      true },
     { "tokens",       "tokencreate",      &tokencreate,       true },
@@ -457,17 +516,17 @@ static const CRPCCommand vRPCCommands[] =
     { "tokens",       "tokenconvert",         &tokenconvert,          true },
 
 /* Address index */
-    { "addressindex",       "getaddressmempool",      &getaddressmempool,      true  },
-    { "addressindex",       "getaddressutxos",        &getaddressutxos,        false },
-    { "addressindex",       "getaddressdeltas",       &getaddressdeltas,       false },
-    { "addressindex",       "getaddresstxids",        &getaddresstxids,        false },
-    { "addressindex",       "getaddressbalance",      &getaddressbalance,      false },
+    { "addressindex",       "getaddressmempool",      &getaddressmempool,      true,       true  },
+    { "addressindex",       "getaddressutxos",        &getaddressutxos,        false,      true  },
+    { "addressindex",       "getaddressdeltas",       &getaddressdeltas,       false,      true  },
+    { "addressindex",       "getaddresstxids",        &getaddresstxids,        false,      true  },
+    { "addressindex",       "getaddressbalance",      &getaddressbalance,      false,      true  },
     { "addressindex",       "getsnapshot",            &getsnapshot,            false },
 
     /* Utility functions */
     { "util",               "createmultisig",         &createmultisig,         true  },
     { "util",               "validateaddress",        &validateaddress,        true  }, /* uses wallet if enabled */
-    { "util",               "verifymessage",          &verifymessage,          true  },
+    { "util",               "verifymessage",          &verifymessage,          true,       true  },
     { "util",               "estimatefee",            &estimatefee,            true  },
     { "util",               "estimatepriority",       &estimatepriority,       true  },
     { "util",               "z_validateaddress",      &z_validateaddress,      true  }, /* uses wallet if enabled */
@@ -697,11 +756,55 @@ static UniValue JSONRPCExecOne(const UniValue& req)
     return rpc_result;
 }
 
+static bool IsParallelRPC(const UniValue& req)
+{
+    if (!req.isObject())
+        return false;
+    const UniValue& valMethod = find_value(req, "method");
+    if (!valMethod.isStr())
+        return false;
+    const CRPCCommand *pcmd = tableRPC[valMethod.get_str()];
+    return pcmd && pcmd->okParallel;
+}
+
+static void JSONRPCExecRange(const UniValue& vReq, std::vector<UniValue>& vResults, size_t nEnd, std::atomic<size_t>* pnNext)
+{
+    size_t reqIdx;
+    while ((reqIdx = (*pnNext)++) < nEnd)
+        vResults[reqIdx] = JSONRPCExecOne(vReq[reqIdx]);
+}
+
 std::string JSONRPCExecBatch(const UniValue& vReq)
 {
+    // Consecutive read-only calls are spread over a few threads; any other
+    // call runs on its own, after everything before it has finished, so
+    // side effects are seen in request order.  Replies keep request order.
+    int nThreads = std::max((int)GetArg("-rpcbatchthreads", DEFAULT_RPC_BATCH_THREADS), 1);
+    std::vector<UniValue> vResults(vReq.size());
+    size_t reqIdx = 0;
+    while (reqIdx < vReq.size())
+    {
+        size_t nEnd = reqIdx;
+        while (nEnd < vReq.size() && IsParallelRPC(vReq[nEnd]))
+            nEnd++;
+        if (nEnd == reqIdx)
+        {
+            vResults[reqIdx] = JSONRPCExecOne(vReq[reqIdx]);
+            reqIdx++;
+            continue;
+        }
+        std::atomic<size_t> nNext(reqIdx);
+        boost::thread_group threads;
+        for (size_t i = 1; i < std::min((size_t)nThreads, nEnd - reqIdx); i++)
+            threads.create_thread(boost::bind(&JSONRPCExecRange, boost::cref(vReq), boost::ref(vResults), nEnd, &nNext));
+        JSONRPCExecRange(vReq, vResults, nEnd, &nNext);
+        threads.join_all();
+        reqIdx = nEnd;
+    }
+
     UniValue ret(UniValue::VARR);
-    for (size_t reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+    for (size_t i = 0; i < vResults.size(); i++)
+        ret.push_back(vResults[i]);
 
     return ret.write() + "\n";
 }
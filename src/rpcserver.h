@@ -119,6 +119,9 @@ void RPCRunLater(const std::string& name, boost::function<void(void)> func, int6
 
 typedef UniValue(*rpcfn_type)(const UniValue& params, bool fHelp);
 
+/** Default number of threads executing the parallel-safe calls of a batch */
+static const int DEFAULT_RPC_BATCH_THREADS = 4;
+
 class CRPCCommand
 {
 public:
@@ -126,6 +129,8 @@ public:
     std::string name;
     rpcfn_type actor;
     bool okSafeMode;
+    /** Read-only call that may run alongside others of a JSON-RPC batch */
+    bool okParallel;
 };
 
 /**
@@ -211,6 +216,8 @@ extern UniValue coinsupply(const UniValue& params, bool fHelp);
 extern UniValue tokeninfo(const UniValue& params, bool fHelp);
 extern UniValue tokenlist(const UniValue& params, bool fHelp);
 extern UniValue tokenorders(const UniValue& params, bool fHelp);
+extern UniValue tokenbook(const UniValue& params, bool fHelp);
+extern UniValue tokenbestprice(const UniValue& params, bool fHelp);
 extern UniValue tokenbalance(const UniValue& params, bool fHelp);
 extern UniValue tokenaddress(const UniValue& params, bool fHelp);
 extern UniValue tokencreate(const UniValue& params, bool fHelp);
@@ -324,6 +331,7 @@ extern UniValue walletlock(const UniValue& params, bool fHelp);
 extern UniValue encryptwallet(const UniValue& params, bool fHelp);
 extern UniValue validateaddress(const UniValue& params, bool fHelp);
 extern UniValue getinfo(const UniValue& params, bool fHelp);
+extern UniValue getrpcqueueinfo(const UniValue& params, bool fHelp);
 extern UniValue getwalletinfo(const UniValue& params, bool fHelp);
 extern UniValue getblockchaininfo(const UniValue& params, bool fHelp);
 extern UniValue getnetworkinfo(const UniValue& params, bool fHelp);
@@ -149,6 +149,8 @@ protected:
     const PrecomputedTransactionData* txdata;
 
     virtual bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
+    //! Checks the condition and its signatures, but not its Eval nodes
+    virtual bool VerifyCryptoConditionSignature(const CC *cond, const std::vector<unsigned char>& condBin, const std::vector<unsigned char>& ffillBin, const uint256& sighash) const;
 
 public:
     TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn) : txTo(txToIn), nIn(nInIn), amount(amountIn), txdata(NULL) {}
@@ -7,13 +7,15 @@
 #include "script/cc.h"
 #include "cc/eval.h"
 
+#include "crypto/common.h"
+#include "crypto/sha256.h"
 #include "pubkey.h"
 #include "random.h"
 #include "uint256.h"
 #include "util.h"
 
-#include <boost/thread.hpp>
-#include <boost/tuple/tuple_comparison.hpp>
+#include <atomic>
+#include <memory>
 
 namespace {
 
@@ -21,73 +23,228 @@ namespace {
  * Valid signature cache, to avoid doing expensive ECDSA signature checking
  * twice for every transaction (once when accepted into memory pool, and
  * again when accepted into the block chain)
+ *
+ * Each entry is the 32 byte salted SHA256 of (signature hash, signature,
+ * public key), so the cache takes a fixed amount of memory and never
+ * allocates after start up.  An entry may live in one of two buckets of
+ * four slots picked from its own digest; the salt keeps peers from aiming
+ * entries at a chosen bucket.  Slots are plain atomic words and nothing is
+ * locked: a racing writer can at worst lose an entry or make a reader miss
+ * one, which only costs a signature check.  A torn read cannot produce a
+ * false hit, as that would need a digest made of pieces of two valid
+ * digests.
  */
 class CSignatureCache
 {
 private:
-     //! sigdata_type is (signature hash, signature, public key):
-    typedef boost::tuple<uint256, std::vector<unsigned char>, CPubKey> sigdata_type;
-    std::set< sigdata_type> setValid;
-    boost::shared_mutex cs_serverchecker;
+    static const size_t SLOTS_PER_BUCKET = 4;
+
+    struct CSlot
+    {
+        std::atomic<uint64_t> words[4];
+    };
+
+    //! per-process salt mixed into every digest
+    uint256 nonce;
+    std::unique_ptr<CSlot[]> slots;
+    //! number of buckets, a power of two (0 disables the cache)
+    size_t nBuckets;
+
+    std::atomic<uint64_t> nHits;
+    std::atomic<uint64_t> nMisses;
+
+    void ComputeEntry(uint64_t entry[4], const uint256 &hash, const std::vector<unsigned char>& vchSig, const unsigned char* pKey, size_t nKeyLen) const
+    {
+        unsigned char digest[CSHA256::OUTPUT_SIZE];
+        CSHA256().Write(nonce.begin(), 32).Write(hash.begin(), 32).Write(&vchSig[0], vchSig.size()).Write(pKey, nKeyLen).Finalize(digest);
+        for (int i = 0; i < 4; i++)
+            entry[i] = ReadLE64(digest + 8 * i);
+        // An all zero first word marks an empty slot
+        if (entry[0] == 0)
+            entry[0] = 1;
+    }
+
+    size_t Bucket(const uint64_t entry[4], int n) const
+    {
+        size_t b1 = entry[1] & (nBuckets - 1);
+        if (n == 0)
+            return b1;
+        size_t b2 = entry[2] & (nBuckets - 1);
+        return (b2 == b1) ? (b1 ^ 1) & (nBuckets - 1) : b2;
+    }
+
+    static bool Matches(const CSlot& slot, const uint64_t entry[4])
+    {
+        for (int i = 0; i < 4; i++)
+            if (slot.words[i].load(std::memory_order_relaxed) != entry[i])
+                return false;
+        return true;
+    }
+
+    static void Store(CSlot& slot, const uint64_t entry[4])
+    {
+        for (int i = 0; i < 4; i++)
+            slot.words[i].store(entry[i], std::memory_order_relaxed);
+    }
+
+    CSlot* Find(const uint64_t entry[4])
+    {
+        for (int n = 0; n < 2; n++)
+        {
+            CSlot* bucket = &slots[Bucket(entry, n) * SLOTS_PER_BUCKET];
+            for (size_t i = 0; i < SLOTS_PER_BUCKET; i++)
+                if (Matches(bucket[i], entry))
+                    return &bucket[i];
+        }
+        return NULL;
+    }
+
+    CSlot* FindEmpty(size_t nBucket)
+    {
+        CSlot* bucket = &slots[nBucket * SLOTS_PER_BUCKET];
+        for (size_t i = 0; i < SLOTS_PER_BUCKET; i++)
+            if (bucket[i].words[0].load(std::memory_order_relaxed) == 0)
+                return &bucket[i];
+        return NULL;
+    }
 
 public:
+    CSignatureCache(const char* strName, int64_t nMaxCacheBytes) : nonce(GetRandHash()), nBuckets(0), nHits(0), nMisses(0)
+    {
+        size_t nMaxBuckets = nMaxCacheBytes / (SLOTS_PER_BUCKET * sizeof(CSlot));
+        if (nMaxBuckets < 2)
+            return;
+        nBuckets = 2;
+        while (nBuckets * 2 <= nMaxBuckets)
+            nBuckets *= 2;
+        slots.reset(new CSlot[nBuckets * SLOTS_PER_BUCKET]());
+        LogPrintf("Using %u MiB for the %s cache (%u entries)\n", (nBuckets * SLOTS_PER_BUCKET * sizeof(CSlot)) >> 20, strName, nBuckets * SLOTS_PER_BUCKET);
+    }
+
     bool
-    Get(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
+    Get(const uint256 &hash, const std::vector<unsigned char>& vchSig, const unsigned char* pKey, size_t nKeyLen, bool erase)
     {
-        boost::shared_lock<boost::shared_mutex> lock(cs_serverchecker);
+        if (nBuckets == 0 || vchSig.empty())
+            return false;
 
-        sigdata_type k(hash, vchSig, pubKey);
-        std::set<sigdata_type>::iterator mi = setValid.find(k);
-        if (mi != setValid.end())
-            return true;
-        return false;
+        uint64_t entry[4];
+        ComputeEntry(entry, hash, vchSig, pKey, nKeyLen);
+        CSlot* slot = Find(entry);
+        if (slot == NULL) {
+            nMisses++;
+            return false;
+        }
+        nHits++;
+        // A signature checked for a block is unlikely to be seen again
+        if (erase)
+            slot->words[0].store(0, std::memory_order_relaxed);
+        return true;
     }
 
-    void Set(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
+    void Set(const uint256 &hash, const std::vector<unsigned char>& vchSig, const unsigned char* pKey, size_t nKeyLen)
     {
-        // DoS prevention: limit cache size to less than 10MB
-        // (~200 bytes per cache entry times 50,000 entries)
-        // Since there can be no more than 20,000 signature operations per block
-        // 50,000 is a reasonable default.
-        int64_t nMaxCacheSize = GetArg("-maxservercheckersize", 50000);
-        if (nMaxCacheSize <= 0) return;
+        if (nBuckets == 0 || vchSig.empty())
+            return;
 
-        boost::unique_lock<boost::shared_mutex> lock(cs_serverchecker);
+        uint64_t entry[4];
+        ComputeEntry(entry, hash, vchSig, pKey, nKeyLen);
+        if (Find(entry) != NULL)
+            return;
 
-        while (static_cast<int64_t>(setValid.size()) > nMaxCacheSize)
+        CSlot* slot = FindEmpty(Bucket(entry, 0));
+        if (slot == NULL)
+            slot = FindEmpty(Bucket(entry, 1));
+        if (slot == NULL)
         {
-            // Evict a random entry. Random because that helps
-            // foil would-be DoS attackers who might try to pre-generate
-            // and re-use a set of valid signatures just-slightly-greater
-            // than our cache size.
-            uint256 randomHash = GetRandHash();
-            std::vector<unsigned char> unused;
-            std::set<sigdata_type>::iterator it =
-                setValid.lower_bound(sigdata_type(randomHash, unused, unused));
-            if (it == setValid.end())
-                it = setValid.begin();
-            setValid.erase(*it);
+            // Both buckets are full: move a random victim to its other
+            // bucket if that has room, otherwise evict it.  Random because
+            // that helps foil would-be DoS attackers who might try to
+            // pre-generate and re-use a set of valid signatures.
+            uint64_t nRand = GetRand(2 * SLOTS_PER_BUCKET);
+            slot = &slots[Bucket(entry, nRand & 1) * SLOTS_PER_BUCKET + (nRand >> 1)];
+            uint64_t victim[4];
+            for (int i = 0; i < 4; i++)
+                victim[i] = slot->words[i].load(std::memory_order_relaxed);
+            if (victim[0] != 0)
+            {
+                size_t nHome = (slot - &slots[0]) / SLOTS_PER_BUCKET;
+                size_t nOther = Bucket(victim, 0) == nHome ? Bucket(victim, 1) : Bucket(victim, 0);
+                CSlot* moved = FindEmpty(nOther);
+                if (moved != NULL)
+                    Store(*moved, victim);
+            }
         }
+        Store(*slot, entry);
+    }
 
-        sigdata_type k(hash, vchSig, pubKey);
-        setValid.insert(k);
+    void GetStats(uint64_t& nHitsOut, uint64_t& nMissesOut, size_t& nBytesOut) const
+    {
+        nHitsOut = nHits;
+        nMissesOut = nMisses;
+        nBytesOut = nBuckets * SLOTS_PER_BUCKET * sizeof(CSlot);
     }
 };
 
+int64_t GetMaxSignatureCacheBytes()
+{
+    int64_t nMaxCacheSize = GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE);
+    // Larger values are entry counts from before the size was given in MiB
+    if (nMaxCacheSize > MAX_MAX_SIG_CACHE_SIZE)
+        nMaxCacheSize = DEFAULT_MAX_SIG_CACHE_SIZE;
+    return std::max(nMaxCacheSize, (int64_t)0) << 20;
+}
+
+CSignatureCache& GetSignatureCache()
+{
+    static CSignatureCache signatureCache("signature", GetMaxSignatureCacheBytes());
+    return signatureCache;
+}
+
+/**
+ * Same for the signatures of crypto-condition fulfillments, keyed by
+ * (signature hash, fulfillment, condition).  CC spends are a small share
+ * of all inputs, so this gets an eighth of the signature cache budget.
+ */
+CSignatureCache& GetCCSignatureCache()
+{
+    static CSignatureCache ccSignatureCache("crypto-condition signature", GetMaxSignatureCacheBytes() / 8);
+    return ccSignatureCache;
+}
+
+}
+
+void GetSignatureCacheStats(uint64_t& nHits, uint64_t& nMisses, size_t& nBytes)
+{
+    GetSignatureCache().GetStats(nHits, nMisses, nBytes);
 }
 
 bool ServerTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
-    static CSignatureCache signatureCache;
+    CSignatureCache& signatureCache = GetSignatureCache();
 
-    if (signatureCache.Get(sighash, vchSig, pubkey))
+    if (signatureCache.Get(sighash, vchSig, pubkey.begin(), pubkey.size(), !store))
         return true;
 
     if (!TransactionSignatureChecker::VerifySignature(vchSig, pubkey, sighash))
         return false;
 
     if (store)
-        signatureCache.Set(sighash, vchSig, pubkey);
+        signatureCache.Set(sighash, vchSig, pubkey.begin(), pubkey.size());
+    return true;
+}
+
+bool ServerTransactionSignatureChecker::VerifyCryptoConditionSignature(const CC *cond, const std::vector<unsigned char>& condBin, const std::vector<unsigned char>& ffillBin, const uint256& sighash) const
+{
+    CSignatureCache& ccSignatureCache = GetCCSignatureCache();
+
+    if (ccSignatureCache.Get(sighash, ffillBin, condBin.data(), condBin.size(), !store))
+        return true;
+
+    if (!TransactionSignatureChecker::VerifyCryptoConditionSignature(cond, condBin, ffillBin, sighash))
+        return false;
+
+    if (store)
+        ccSignatureCache.Set(sighash, ffillBin, condBin.data(), condBin.size());
     return true;
 }
 
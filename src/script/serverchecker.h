@@ -12,6 +12,14 @@
 
 class CPubKey;
 
+/** Default size of the signature cache in MiB (-maxsigcachesize) */
+static const int64_t DEFAULT_MAX_SIG_CACHE_SIZE = 32;
+/** Largest accepted -maxsigcachesize, in MiB */
+static const int64_t MAX_MAX_SIG_CACHE_SIZE = 16384;
+
+/** Hit and miss counts of the signature cache and the memory it takes */
+void GetSignatureCacheStats(uint64_t& nHits, uint64_t& nMisses, size_t& nBytes);
+
 class ServerTransactionSignatureChecker : public TransactionSignatureChecker
 {
 private:
@@ -21,6 +29,7 @@ public:
     ServerTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nIn, const CAmount& amount, bool storeIn, PrecomputedTransactionData& txdataIn) : TransactionSignatureChecker(txToIn, nIn, amount, txdataIn), store(storeIn) {}
 
     bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
+    bool VerifyCryptoConditionSignature(const CC *cond, const std::vector<unsigned char>& condBin, const std::vector<unsigned char>& ffillBin, const uint256& sighash) const;
     int CheckEvalCondition(const CC *cond) const;
 };
 
@@ -8,6 +8,7 @@
 #include "uint256.h"
 #include "utilstrencodings.h"
 #include "test/test_bitcoin.h"
+#include "txdb.h"
 #include "consensus/validation.h"
 #include "main.h"
 #include "undo.h"
@@ -79,6 +80,26 @@ public:
         return true;
     }
 
+    bool GetCoinsOutput(const COutPoint& outpoint, CCoinsCacheEntry& entry) const
+    {
+        if (!GetCoins(outpoint.hash, entry.coins)) {
+            return false;
+        }
+        if (insecure_rand() % 2 == 0) {
+            // Randomly return only the requested output, as the database does for large transactions.
+            entry.vAvail.resize(entry.coins.vout.size());
+            for (unsigned int n = 0; n < entry.coins.vout.size(); n++) {
+                entry.vAvail[n] = entry.coins.IsAvailable(n);
+            }
+            if (entry.coins.IsAvailable(outpoint.n)) {
+                entry.mapOutputs[outpoint.n] = entry.coins.vout[outpoint.n];
+            }
+            std::vector<CTxOut>().swap(entry.coins.vout);
+            entry.flags = CCoinsCacheEntry::PARTIAL;
+        }
+        return true;
+    }
+
     bool HaveCoins(const uint256& txid) const
     {
         CCoins coins;
@@ -94,8 +115,16 @@ public:
                     CNullifiersMap& mapNullifiers)
     {
         for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); ) {
-            map_[it->first] = it->second.coins;
-            if (it->second.coins.IsPruned() && insecure_rand() % 3 == 0) {
+            CCoins& coins = map_[it->first];
+            if (it->second.flags & CCoinsCacheEntry::PARTIAL) {
+                // Partial entries only carry spends.
+                BOOST_FOREACH(uint32_t n, it->second.vDirtyOutputs) {
+                    coins.Spend(n);
+                }
+            } else {
+                coins = it->second.coins;
+            }
+            if (coins.IsPruned() && insecure_rand() % 3 == 0) {
                 // Randomly delete empty entries on write.
                 map_.erase(it->first);
             }
@@ -143,13 +172,43 @@ public:
                      memusage::DynamicUsage(cacheAnchors) +
                      memusage::DynamicUsage(cacheNullifiers);
         for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end(); it++) {
-            ret += it->second.coins.DynamicMemoryUsage();
+            ret += it->second.DynamicMemoryUsage();
         }
         BOOST_CHECK_EQUAL(DynamicMemoryUsage(), ret);
     }
 
+    std::vector<uint32_t> DirtyOutputs(const uint256& txid) const
+    {
+        CCoinsMap::const_iterator it = cacheCoins.find(txid);
+        return it == cacheCoins.end() ? std::vector<uint32_t>() : it->second.vDirtyOutputs;
+    }
+
+};
+
+class CCoinsViewDBTest : public CCoinsViewDB
+{
+public:
+    CCoinsViewDBTest() : CCoinsViewDB("coinsdbtest", 1 << 20, true) {}
+
+    void WriteLegacyCoins(const uint256& txid, const CCoins& coins)
+    {
+        db.Write(std::make_pair('c', txid), coins);
+    }
 };
 
+CTransaction CreateManyOutputsTx(unsigned int nOutputs)
+{
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    mtx.vout.resize(nOutputs);
+    for (unsigned int i = 0; i < nOutputs; i++) {
+        mtx.vout[i].nValue = 1000 + i;
+        mtx.vout[i].scriptPubKey = CScript() << OP_TRUE;
+    }
+    return CTransaction(mtx);
+}
+
 }
 
 uint256 appendRandomCommitment(ZCIncrementalMerkleTree &tree)
@@ -631,6 +690,7 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     bool updated_an_entry = false;
     bool found_an_entry = false;
     bool missed_an_entry = false;
+    bool spent_an_output = false;
 
     // A simple map to track what we expect the cache stack to represent.
     std::map<uint256, CCoins> result;
@@ -652,27 +712,61 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
         {
             uint256 txid = txids[insecure_rand() % txids.size()]; // txid we're going to modify in this iteration.
             CCoins& coins = result[txid];
-            CCoinsModifier entry = stack.back()->ModifyCoins(txid);
-            BOOST_CHECK(coins == *entry);
-            if (insecure_rand() % 5 == 0 || coins.IsPruned()) {
-                if (coins.IsPruned()) {
-                    added_an_entry = true;
-                } else {
-                    updated_an_entry = true;
+            if (!coins.IsPruned() && insecure_rand() % 3 == 0) {
+                // Spend a single output, which may only load that output.
+                uint32_t n = insecure_rand() % coins.vout.size();
+                CTxInUndo undo;
+                bool fSpent = stack.back()->SpendOutput(COutPoint(txid, n), &undo);
+                BOOST_CHECK_EQUAL(fSpent, coins.IsAvailable(n));
+                if (fSpent) {
+                    BOOST_CHECK(undo.txout == coins.vout[n]);
+                    coins.Spend(n);
+                    if (coins.IsPruned()) {
+                        BOOST_CHECK_EQUAL(undo.nVersion, coins.nVersion);
+                        BOOST_CHECK_EQUAL(undo.nHeight, coins.nHeight);
+                    } else {
+                        BOOST_CHECK_EQUAL(undo.nHeight, 0);
+                    }
+                    spent_an_output = true;
                 }
-                coins.nVersion = insecure_rand();
-                coins.vout.resize(1);
-                coins.vout[0].nValue = insecure_rand();
-                *entry = coins;
             } else {
-                coins.Clear();
-                entry->Clear();
-                removed_an_entry = true;
+                CCoinsModifier entry = stack.back()->ModifyCoins(txid);
+                BOOST_CHECK(coins == *entry);
+                if (insecure_rand() % 5 == 0 || coins.IsPruned()) {
+                    if (coins.IsPruned()) {
+                        added_an_entry = true;
+                    } else {
+                        updated_an_entry = true;
+                    }
+                    coins.nVersion = insecure_rand();
+                    coins.vout.resize(1 + insecure_rand() % 4);
+                    for (unsigned int n = 0; n < coins.vout.size(); n++) {
+                        coins.vout[n].nValue = insecure_rand();
+                    }
+                    *entry = coins;
+                } else {
+                    coins.Clear();
+                    entry->Clear();
+                    removed_an_entry = true;
+                }
             }
         }
 
         // Once every 1000 iterations and at the end, verify the full cache.
         if (insecure_rand() % 1000 == 1 || i == NUM_SIMULATION_ITERATIONS - 1) {
+            for (std::map<uint256, CCoins>::iterator it = result.begin(); it != result.end(); it++) {
+                for (unsigned int n = 0; n <= it->second.vout.size(); n++) {
+                    const CTxOut* txout = stack.back()->AccessOutput(COutPoint(it->first, n));
+                    if (it->second.IsAvailable(n)) {
+                        BOOST_CHECK(txout && *txout == it->second.vout[n]);
+                    } else {
+                        BOOST_CHECK(!txout);
+                    }
+                }
+            }
+            BOOST_FOREACH(const CCoinsViewCacheTest *test, stack) {
+                test->SelfTest();
+            }
             for (std::map<uint256, CCoins>::iterator it = result.begin(); it != result.end(); it++) {
                 const CCoins* coins = stack.back()->AccessCoins(it->first);
                 if (coins) {
@@ -724,6 +818,7 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     BOOST_CHECK(updated_an_entry);
     BOOST_CHECK(found_an_entry);
     BOOST_CHECK(missed_an_entry);
+    BOOST_CHECK(spent_an_output);
 }
 
 BOOST_AUTO_TEST_CASE(coins_coinbase_spends)
@@ -839,4 +934,193 @@ BOOST_AUTO_TEST_CASE(ccoins_serialization)
     }
 }
 
+BOOST_AUTO_TEST_CASE(coins_dirty_outputs)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest top(&base);
+    CTransaction tx = CreateManyOutputsTx(100);
+    uint256 txid = tx.GetHash();
+
+    {
+        CCoinsViewCacheTest child(&top);
+        child.ModifyCoins(txid)->FromTx(tx, 1);
+        BOOST_CHECK_EQUAL(child.DirtyOutputs(txid).size(), 100);
+        child.Flush();
+    }
+    BOOST_CHECK(top.Flush());
+
+    // Spending one output only touches that output
+    std::vector<uint32_t> expected;
+    {
+        CCoinsViewCacheTest child(&top);
+        child.ModifyCoins(txid)->Spend(42);
+        expected.push_back(42);
+        BOOST_CHECK(child.DirtyOutputs(txid) == expected);
+        child.ModifyCoins(txid)->Spend(7);
+        expected.insert(expected.begin(), 7);
+        BOOST_CHECK(child.DirtyOutputs(txid) == expected);
+        child.SelfTest();
+        child.Flush();
+    }
+    BOOST_CHECK(top.DirtyOutputs(txid) == expected);
+
+    // The parent keeps the union of what its children changed
+    {
+        CCoinsViewCacheTest child(&top);
+        child.ModifyCoins(txid)->Spend(99);
+        child.Flush();
+    }
+    expected.push_back(99);
+    BOOST_CHECK(top.DirtyOutputs(txid) == expected);
+    top.SelfTest();
+}
+
+BOOST_FIXTURE_TEST_CASE(coins_db_per_output, TestingSetup)
+{
+    CCoinsViewDBTest db;
+    CTransaction tx = CreateManyOutputsTx(20);
+    uint256 txid = tx.GetHash();
+
+    {
+        CCoinsViewCache cache(&db);
+        cache.ModifyCoins(txid)->FromTx(tx, 10);
+        BOOST_CHECK(cache.Flush());
+    }
+    CCoins coins;
+    BOOST_CHECK(db.HaveCoins(txid));
+    BOOST_CHECK(db.GetCoins(txid, coins));
+    BOOST_CHECK(coins == CCoins(tx, 10));
+
+    {
+        CCoinsViewCache cache(&db);
+        cache.ModifyCoins(txid)->Spend(3);
+        cache.ModifyCoins(txid)->Spend(19);
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK(db.GetCoins(txid, coins));
+    BOOST_CHECK_EQUAL(coins.vout.size(), 19);
+    BOOST_CHECK(!coins.IsAvailable(3));
+    BOOST_CHECK(coins.IsAvailable(4));
+    BOOST_CHECK_EQUAL(coins.vout[4].nValue, 1004);
+    BOOST_CHECK_EQUAL(coins.nHeight, 10);
+
+    {
+        CCoinsViewCache cache(&db);
+        {
+            CCoinsModifier modifier = cache.ModifyCoins(txid);
+            for (unsigned int i = 0; i < 20; i++)
+                modifier->Spend(i);
+        }
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK(!db.HaveCoins(txid));
+    BOOST_CHECK(!db.GetCoins(txid, coins));
+
+    // A small transaction is stored in its header record only
+    CTransaction small = CreateManyOutputsTx(3);
+    {
+        CCoinsViewCache cache(&db);
+        cache.ModifyCoins(small.GetHash())->FromTx(small, 11);
+        BOOST_CHECK(cache.Flush());
+    }
+    {
+        CCoinsViewCache cache(&db);
+        cache.ModifyCoins(small.GetHash())->Spend(1);
+        BOOST_CHECK(cache.Flush());
+    }
+    CCoins expected(small, 11);
+    expected.Spend(1);
+    BOOST_CHECK(db.GetCoins(small.GetHash(), coins));
+    BOOST_CHECK(coins == expected);
+}
+
+BOOST_FIXTURE_TEST_CASE(coins_db_partial_entries, TestingSetup)
+{
+    CCoinsViewDBTest db;
+    CTransaction tx = CreateManyOutputsTx(1000);
+    uint256 txid = tx.GetHash();
+    {
+        CCoinsViewCache cache(&db);
+        cache.ModifyCoins(txid)->FromTx(tx, 10);
+        BOOST_CHECK(cache.Flush());
+    }
+    CCoins expected(tx, 10);
+
+    size_t nFullUsage;
+    {
+        CCoinsViewCache cache(&db);
+        BOOST_CHECK(cache.AccessCoins(txid));
+        nFullUsage = cache.DynamicMemoryUsage();
+    }
+
+    // Spending from a large transaction only loads the spent outputs
+    {
+        CCoinsViewCacheTest cache(&db);
+        int nHeight = 0;
+        const CTxOut* txout = cache.AccessOutput(COutPoint(txid, 500), &nHeight);
+        BOOST_CHECK(txout && *txout == tx.vout[500]);
+        BOOST_CHECK_EQUAL(nHeight, 10);
+        BOOST_CHECK(cache.DynamicMemoryUsage() * 10 < nFullUsage);
+        CTxInUndo undo;
+        BOOST_CHECK(cache.SpendOutput(COutPoint(txid, 500), &undo));
+        BOOST_CHECK(undo.txout == tx.vout[500]);
+        BOOST_CHECK(!cache.SpendOutput(COutPoint(txid, 500)));
+        BOOST_CHECK(cache.SpendOutput(COutPoint(txid, 3)));
+        BOOST_CHECK(!cache.AccessOutput(COutPoint(txid, 3)));
+        BOOST_CHECK(cache.HaveCoins(txid));
+        cache.SelfTest();
+        BOOST_CHECK(cache.DynamicMemoryUsage() * 10 < nFullUsage);
+        BOOST_CHECK(cache.Flush());
+    }
+    expected.Spend(500);
+    expected.Spend(3);
+    CCoins coins;
+    BOOST_CHECK(db.GetCoins(txid, coins));
+    BOOST_CHECK(coins == expected);
+
+    // Spends flushed into a parent cache survive loading the whole transaction
+    {
+        CCoinsViewCacheTest base(&db);
+        {
+            CCoinsViewCacheTest cache(&base);
+            BOOST_CHECK(cache.SpendOutput(COutPoint(txid, 999)));
+            BOOST_CHECK(cache.Flush());
+        }
+        BOOST_CHECK(base.AccessOutput(COutPoint(txid, 998)));
+        BOOST_CHECK(!base.AccessOutput(COutPoint(txid, 999)));
+        base.SelfTest();
+        expected.Spend(999);
+        const CCoins* pcoins = base.AccessCoins(txid);
+        BOOST_CHECK(pcoins && *pcoins == expected);
+        base.SelfTest();
+        BOOST_CHECK(base.Flush());
+    }
+    BOOST_CHECK(db.GetCoins(txid, coins));
+    BOOST_CHECK(coins == expected);
+}
+
+BOOST_FIXTURE_TEST_CASE(coins_db_upgrade, TestingSetup)
+{
+    CCoinsViewDBTest db;
+    CTransaction tx = CreateManyOutputsTx(30);
+    CCoins legacy(tx, 5);
+    legacy.Spend(0);
+    legacy.Spend(17);
+    BOOST_CHECK(!db.NeedsUpgrade());
+    db.WriteLegacyCoins(tx.GetHash(), legacy);
+    BOOST_CHECK(!db.HaveCoins(tx.GetHash()));
+    BOOST_CHECK(db.NeedsUpgrade());
+
+    BOOST_CHECK(db.Upgrade());
+    BOOST_CHECK(!db.NeedsUpgrade());
+    CCoins coins;
+    BOOST_CHECK(db.GetCoins(tx.GetHash(), coins));
+    BOOST_CHECK(coins == legacy);
+
+    // Nothing is left to upgrade
+    BOOST_CHECK(db.Upgrade());
+    BOOST_CHECK(db.GetCoins(tx.GetHash(), coins));
+    BOOST_CHECK(coins == legacy);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
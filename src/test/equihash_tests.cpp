@@ -99,6 +99,13 @@ void TestEquihashValidator(unsigned int n, unsigned int k, const std::string &I,
     bool isValid;
     EhIsValidSolution(n, k, state, GetMinimalFromIndices(soln, cBitLen), isValid);
     BOOST_CHECK(isValid == expected);
+
+    // The multi-buffer path hashes I||V itself and must agree
+    std::vector<unsigned char> input(I.begin(), I.end());
+    input.insert(input.end(), V.begin(), V.end());
+    bool isValidForInput;
+    EhIsValidSolutionForInput(n, k, input.data(), input.size(), GetMinimalFromIndices(soln, cBitLen), isValidForInput);
+    BOOST_CHECK(isValidForInput == expected);
 }
 
 #ifdef ENABLE_MINING
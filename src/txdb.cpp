@@ -6,28 +6,39 @@
 #include "txdb.h"
 
 #include "chainparams.h"
+#include "checkqueue.h"
 #include "hash.h"
+#include "init.h"
 #include "main.h"
 #include "pow.h"
 #include "uint256.h"
 #include "core_io.h"
+#include "ui_interface.h"
 
+#include <deque>
 #include <stdint.h>
 
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/thread.hpp>
 
 using namespace std;
 
 static const char DB_ANCHOR = 'A';
 static const char DB_NULLIFIER = 's';
-static const char DB_COINS = 'c';
+static const char DB_COINS = 'c'; // per-transaction coin records, replaced by DB_COIN
+static const char DB_COIN = 'C';
 static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
 static const char DB_ADDRESSINDEX = 'd';
 static const char DB_ADDRESSUNSPENTINDEX = 'u';
+static const char DB_ADDRESSBALANCE = 'h';
+static const char DB_ADDRESSBALANCE_SORTED = 'H';
 static const char DB_TIMESTAMPINDEX = 'S';
 static const char DB_BLOCKHASHINDEX = 'z';
 static const char DB_SPENTINDEX = 'p';
+static const char DB_CCINDEX = 'e';
+static const char DB_CCINDEX_OUTPOINT = 'E';
 static const char DB_BLOCK_INDEX = 'b';
 
 static const char DB_BEST_BLOCK = 'B';
@@ -56,11 +67,148 @@ void static BatchWriteNullifier(CLevelDBBatch &batch, const uint256 &nf, const b
         batch.Write(make_pair(DB_NULLIFIER, nf), true);
 }
 
-void static BatchWriteCoins(CLevelDBBatch &batch, const uint256 &hash, const CCoins &coins) {
+namespace {
+
+/** Key of one unspent output in the coin database */
+struct CCoinKey
+{
+    uint256 txid;
+    uint32_t n;
+
+    CCoinKey(const uint256 &txidIn, uint32_t nIn) : txid(txidIn), n(nIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        char chType = DB_COIN;
+        READWRITE(chType);
+        READWRITE(txid);
+        READWRITE(VARINT(n));
+    }
+};
+
+/**
+ * Outputs below this index are stored in the header record of their
+ * transaction, the others in records of their own.  Most transactions are
+ * then read with a single point lookup, while spending from a large one
+ * rewrites a bounded header instead of all of its outputs.
+ */
+static const uint32_t MAX_INLINE_COIN_OUTPUTS = 16;
+
+/**
+ * The record stored under 'C' + txid, right before the records of the
+ * outputs at or above MAX_INLINE_COIN_OUTPUTS (CCoinKey(txid, n), in
+ * CTxOutCompressor format).  Reads into and writes from the given coins.
+ *
+ * Serialized format:
+ * - VARINT(nVersion)
+ * - VARINT(nHeight * 2 + fCoinBase)
+ * - bitmask of the unspent outputs, one bit per output, as a byte vector
+ * - the unspent outputs below MAX_INLINE_COIN_OUTPUTS, in CTxOutCompressor format
+ */
+struct CCoinsHeader
+{
+    CCoins &coins;
+    std::vector<unsigned char> vAvail;
+
+    CCoinsHeader(CCoins &coinsIn) : coins(coinsIn), vAvail((coinsIn.vout.size() + 7) / 8) {
+        for (unsigned int n = 0; n < coins.vout.size(); n++)
+            if (coins.IsAvailable(n))
+                vAvail[n / 8] |= 1 << (n % 8);
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        unsigned int nCode = coins.nHeight * 2 + (coins.fCoinBase ? 1 : 0);
+        READWRITE(VARINT(coins.nVersion));
+        READWRITE(VARINT(nCode));
+        READWRITE(vAvail);
+        if (ser_action.ForRead()) {
+            coins.nHeight = nCode / 2;
+            coins.fCoinBase = nCode & 1;
+            coins.vout.clear();
+            for (uint32_t n = 0; n < vAvail.size() * 8; n++)
+                if (IsAvailable(n))
+                    coins.vout.resize(n + 1);
+        }
+        for (uint32_t n = 0; n < coins.vout.size() && n < MAX_INLINE_COIN_OUTPUTS; n++)
+            if (IsAvailable(n))
+                READWRITE(REF(CTxOutCompressor(coins.vout[n])));
+    }
+
+    bool IsAvailable(uint32_t n) const {
+        return n / 8 < vAvail.size() && (vAvail[n / 8] & (1 << (n % 8)));
+    }
+
+    bool IsPruned() const {
+        BOOST_FOREACH(unsigned char ch, vAvail)
+            if (ch != 0)
+                return false;
+        return true;
+    }
+
+    void Spend(uint32_t n) {
+        if (n / 8 < vAvail.size())
+            vAvail[n / 8] &= ~(1 << (n % 8));
+        if (n < coins.vout.size())
+            coins.vout[n].SetNull();
+    }
+
+    //! Number of unspent outputs stored in records of their own
+    size_t CountSplitOutputs() const {
+        size_t nCount = 0;
+        for (uint32_t n = MAX_INLINE_COIN_OUTPUTS; n < vAvail.size() * 8; n++)
+            if (IsAvailable(n))
+                nCount++;
+        return nCount;
+    }
+};
+
+}
+
+/** Write the header and the outputs of coins listed in vOutputs, erasing the spent ones */
+void static BatchWriteCoins(CLevelDBBatch &batch, const uint256 &hash, const CCoins &coins, const std::vector<uint32_t> &vOutputs, size_t &nWritten, size_t &nErased) {
+    if (vOutputs.empty())
+        return;
+    BOOST_FOREACH(uint32_t n, vOutputs) {
+        if (coins.IsAvailable(n)) {
+            if (n >= MAX_INLINE_COIN_OUTPUTS)
+                batch.Write(CCoinKey(hash, n), CTxOutCompressor(REF(coins.vout[n])));
+            nWritten++;
+        } else {
+            if (n >= MAX_INLINE_COIN_OUTPUTS)
+                batch.Erase(CCoinKey(hash, n));
+            nErased++;
+        }
+    }
     if (coins.IsPruned())
-        batch.Erase(make_pair(DB_COINS, hash));
+        batch.Erase(make_pair(DB_COIN, hash));
     else
-        batch.Write(make_pair(DB_COINS, hash), coins);
+        batch.Write(make_pair(DB_COIN, hash), CCoinsHeader(REF(coins)));
+}
+
+/** Erase the outputs of a partially loaded transaction listed in vOutputs and update its header */
+bool static BatchWriteSpends(CLevelDBBatch &batch, const CLevelDBWrapper &db, const uint256 &hash, const std::vector<uint32_t> &vOutputs, size_t &nErased) {
+    if (vOutputs.empty())
+        return true;
+    CCoins coins;
+    CCoinsHeader header(coins);
+    if (!db.Read(make_pair(DB_COIN, hash), header))
+        return error("%s: coins of %s are missing from the coin database", __func__, hash.ToString());
+    BOOST_FOREACH(uint32_t n, vOutputs) {
+        header.Spend(n);
+        if (n >= MAX_INLINE_COIN_OUTPUTS)
+            batch.Erase(CCoinKey(hash, n));
+        nErased++;
+    }
+    if (header.IsPruned())
+        batch.Erase(make_pair(DB_COIN, hash));
+    else
+        batch.Write(make_pair(DB_COIN, hash), header);
+    return true;
 }
 
 void static BatchWriteHashBestChain(CLevelDBBatch &batch, const uint256 &hash) {
@@ -98,11 +246,77 @@ bool CCoinsViewDB::GetNullifier(const uint256 &nf) const {
 }
 
 bool CCoinsViewDB::GetCoins(const uint256 &txid, CCoins &coins) const {
-    return db.Read(make_pair(DB_COINS, txid), coins);
+    // One point lookup, which the bloom filter answers for most missing txids
+    coins.Clear();
+    CCoinsHeader header(coins);
+    if (!db.Read(make_pair(DB_COIN, txid), header))
+        return false;
+    size_t nSplit = header.CountSplitOutputs();
+    if (nSplit == 0)
+        return true;
+
+    // The other outputs follow the header, usually in the block that was just read
+    boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewCachedIterator());
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << make_pair(DB_COIN, txid);
+    CDataStream ssKeyFirst(SER_DISK, CLIENT_VERSION);
+    ssKeyFirst << CCoinKey(txid, MAX_INLINE_COIN_OUTPUTS);
+    pcursor->Seek(ssKeyFirst.str());
+
+    size_t nFound = 0;
+    for (; pcursor->Valid(); pcursor->Next()) {
+        leveldb::Slice slKey = pcursor->key();
+        if (slKey.size() <= ssKeySet.size() || memcmp(slKey.data(), &ssKeySet[0], ssKeySet.size()) != 0)
+            break;
+        try {
+            CDataStream ssKey(slKey.data() + ssKeySet.size(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            uint32_t n;
+            ssKey >> VARINT(n);
+            if (n < MAX_INLINE_COIN_OUTPUTS || !header.IsAvailable(n))
+                return error("%s: output %s:%u is not in its header", __func__, txid.ToString(), n);
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+            ssValue >> REF(CTxOutCompressor(coins.vout[n]));
+            nFound++;
+        } catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+    if (nFound != nSplit)
+        return error("%s: outputs of %s are missing from the coin database", __func__, txid.ToString());
+    return true;
+}
+
+bool CCoinsViewDB::GetCoinsOutput(const COutPoint &outpoint, CCoinsCacheEntry &entry) const {
+    CCoins &coins = entry.coins;
+    coins.Clear();
+    CCoinsHeader header(coins);
+    if (!db.Read(make_pair(DB_COIN, outpoint.hash), header))
+        return false;
+    if (header.CountSplitOutputs() == 0)
+        return true;
+
+    // Of a large transaction keep the metadata and the requested output only
+    entry.flags = CCoinsCacheEntry::PARTIAL;
+    entry.vAvail.resize(coins.vout.size());
+    for (uint32_t n = 0; n < coins.vout.size(); n++)
+        entry.vAvail[n] = header.IsAvailable(n);
+    if (header.IsAvailable(outpoint.n)) {
+        CTxOut &txout = entry.mapOutputs[outpoint.n];
+        if (outpoint.n < MAX_INLINE_COIN_OUTPUTS) {
+            txout = coins.vout[outpoint.n];
+        } else {
+            CTxOutCompressor compressor(txout);
+            if (!db.Read(CCoinKey(outpoint.hash, outpoint.n), compressor))
+                return error("%s: output %s:%u is missing from the coin database", __func__, outpoint.hash.ToString(), outpoint.n);
+        }
+    }
+    std::vector<CTxOut>().swap(coins.vout);
+    return true;
 }
 
 bool CCoinsViewDB::HaveCoins(const uint256 &txid) const {
-    return db.Exists(make_pair(DB_COINS, txid));
+    return db.Exists(make_pair(DB_COIN, txid));
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const {
@@ -127,9 +341,16 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins,
     CLevelDBBatch batch;
     size_t count = 0;
     size_t changed = 0;
+    size_t written = 0;
+    size_t erased = 0;
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
-            BatchWriteCoins(batch, it->first, it->second.coins);
+            if (it->second.flags & CCoinsCacheEntry::PARTIAL) {
+                if (!BatchWriteSpends(batch, db, it->first, it->second.vDirtyOutputs, erased))
+                    return false;
+            } else {
+                BatchWriteCoins(batch, it->first, it->second.coins, it->second.vDirtyOutputs, written, erased);
+            }
             changed++;
         }
         count++;
@@ -160,7 +381,8 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins,
     if (!hashAnchor.IsNull())
         BatchWriteHashBestAnchor(batch, hashAnchor);
 
-    LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
+    LogPrint("coindb", "Committing %u changed transactions (out of %u), %u outputs written and %u erased, to coin database...\n",
+             (unsigned int)changed, (unsigned int)count, (unsigned int)written, (unsigned int)erased);
     return db.WriteBatch(batch);
 }
 
@@ -187,17 +409,40 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
     return Read(DB_LAST_BLOCK, nFile);
 }
 
+void static ApplyStats(CCoinsStats &stats, CHashWriter &ss, const uint256 &txhash, const CCoins &coins, CAmount &nTotalAmount) {
+    ss << txhash;
+    ss << VARINT(coins.nVersion);
+    ss << (coins.fCoinBase ? 'c' : 'n');
+    ss << VARINT(coins.nHeight);
+    stats.nTransactions++;
+    for (unsigned int i=0; i<coins.vout.size(); i++) {
+        const CTxOut &out = coins.vout[i];
+        if (!out.IsNull()) {
+            stats.nTransactionOutputs++;
+            ss << VARINT(i+1);
+            ss << out;
+            nTotalAmount += out.nValue;
+        }
+    }
+    ss << VARINT(0);
+}
+
 bool CCoinsViewDB::GetStats(CCoinsStats &stats) const {
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
        that restriction.  */
     boost::scoped_ptr<leveldb::Iterator> pcursor(const_cast<CLevelDBWrapper*>(&db)->NewIterator());
-    pcursor->SeekToFirst();
+    pcursor->Seek(std::string(1, DB_COIN));
 
     CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
     stats.hashBlock = GetBestBlock();
     ss << stats.hashBlock;
     CAmount nTotalAmount = 0;
+    // Each header is followed by the outputs of its transaction; gather them
+    // back into one CCoins so the serialized hash matches the per-transaction
+    // format.
+    uint256 prevhash;
+    CCoins coins;
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         try {
@@ -205,35 +450,34 @@ bool CCoinsViewDB::GetStats(CCoinsStats &stats) const {
             CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
             char chType;
             ssKey >> chType;
-            if (chType == DB_COINS) {
-                leveldb::Slice slValue = pcursor->value();
-                CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
-                CCoins coins;
-                ssValue >> coins;
-                uint256 txhash;
-                ssKey >> txhash;
-                ss << txhash;
-                ss << VARINT(coins.nVersion);
-                ss << (coins.fCoinBase ? 'c' : 'n');
-                ss << VARINT(coins.nHeight);
-                stats.nTransactions++;
-                for (unsigned int i=0; i<coins.vout.size(); i++) {
-                    const CTxOut &out = coins.vout[i];
-                    if (!out.IsNull()) {
-                        stats.nTransactionOutputs++;
-                        ss << VARINT(i+1);
-                        ss << out;
-                        nTotalAmount += out.nValue;
-                    }
-                }
-                stats.nSerializedSize += 32 + slValue.size();
-                ss << VARINT(0);
+            if (chType != DB_COIN)
+                break;
+            uint256 txhash;
+            ssKey >> txhash;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+            if (ssKey.empty()) {
+                if (!coins.vout.empty())
+                    ApplyStats(stats, ss, prevhash, coins, nTotalAmount);
+                coins.Clear();
+                CCoinsHeader header(coins);
+                ssValue >> header;
+                prevhash = txhash;
+            } else {
+                uint32_t n;
+                ssKey >> VARINT(n);
+                if (txhash != prevhash || n >= coins.vout.size())
+                    return error("%s: output %s:%u has no header", __func__, txhash.ToString(), n);
+                ssValue >> REF(CTxOutCompressor(coins.vout[n]));
             }
+            stats.nSerializedSize += slKey.size() + slValue.size();
             pcursor->Next();
         } catch (const std::exception& e) {
             return error("%s: Deserialize or I/O error - %s", __func__, e.what());
         }
     }
+    if (!coins.vout.empty())
+        ApplyStats(stats, ss, prevhash, coins, nTotalAmount);
     {
         LOCK(cs_main);
         stats.nHeight = mapBlockIndex.find(stats.hashBlock)->second->nHeight;
@@ -243,6 +487,80 @@ bool CCoinsViewDB::GetStats(CCoinsStats &stats) const {
     return true;
 }
 
+bool CCoinsViewDB::NeedsUpgrade() const {
+    boost::scoped_ptr<leveldb::Iterator> pcursor(const_cast<CLevelDBWrapper*>(&db)->NewIterator());
+    pcursor->Seek(std::string(1, DB_COINS));
+    return pcursor->Valid() && pcursor->key().size() > 0 && pcursor->key().data()[0] == DB_COINS;
+}
+
+bool CCoinsViewDB::Upgrade() {
+    if (!NeedsUpgrade())
+        return true;
+
+    boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewIterator());
+    pcursor->Seek(std::string(1, DB_COINS));
+
+    LogPrintf("Upgrading the coin database to per-output records; going back to an older version will require -reindex\n");
+    uiInterface.ShowProgress(_("Upgrading coin database..."), 0);
+    int64_t nStart = GetTimeMillis();
+    size_t nTransactions = 0;
+    size_t nOutputs = 0;
+    size_t nBatchSize = 0;
+    bool fInterrupted = false;
+    CLevelDBBatch batch;
+    // Each transaction is converted and erased in the same batch, so an
+    // interrupted upgrade leaves a consistent database and resumes on restart.
+    for (; pcursor->Valid(); pcursor->Next()) {
+        leveldb::Slice slKey = pcursor->key();
+        if (slKey.size() == 0 || slKey.data()[0] != DB_COINS)
+            break;
+        uint256 txhash;
+        try {
+            CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            ssKey >> chType;
+            ssKey >> txhash;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+            CCoins coins;
+            ssValue >> coins;
+            for (unsigned int n = 0; n < coins.vout.size(); n++) {
+                if (coins.IsAvailable(n)) {
+                    if (n >= MAX_INLINE_COIN_OUTPUTS)
+                        batch.Write(CCoinKey(txhash, n), CTxOutCompressor(coins.vout[n]));
+                    nOutputs++;
+                }
+            }
+            batch.Write(make_pair(DB_COIN, txhash), CCoinsHeader(coins));
+            batch.Erase(make_pair(DB_COINS, txhash));
+            nTransactions++;
+            nBatchSize += slKey.size() + slValue.size();
+        } catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+        }
+        if (nBatchSize > (16 << 20)) {
+            if (!db.WriteBatch(batch))
+                return false;
+            batch.Clear();
+            nBatchSize = 0;
+            // Records are ordered by txid, so its first bytes tell how far we are
+            uint32_t nHigh = 0x100 * *txhash.begin() + *(txhash.begin() + 1);
+            uiInterface.ShowProgress(_("Upgrading coin database..."), (int)(nHigh * 100.0 / 65536.0 + 0.5));
+            LogPrintf("Upgraded %u transactions into %u outputs...\n", (unsigned int)nTransactions, (unsigned int)nOutputs);
+            if (ShutdownRequested()) {
+                fInterrupted = true;
+                break;
+            }
+        }
+    }
+    if (!db.WriteBatch(batch))
+        return false;
+    uiInterface.ShowProgress("", 100);
+    LogPrintf("Upgraded %u transactions into %u outputs in %dms%s\n", (unsigned int)nTransactions, (unsigned int)nOutputs, GetTimeMillis() - nStart,
+              fInterrupted ? ", interrupted; the upgrade resumes on the next start" : "");
+    return true;
+}
+
 bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo) {
     CLevelDBBatch batch;
     for (std::vector<std::pair<int, const CBlockFileInfo*> >::const_iterator it=fileInfo.begin(); it != fileInfo.end(); it++) {
@@ -250,11 +568,23 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
     }
     batch.Write(DB_LAST_BLOCK, nLastFile);
     for (std::vector<const CBlockIndex*>::const_iterator it=blockinfo.begin(); it != blockinfo.end(); it++) {
-        batch.Write(make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()), CDiskBlockIndex(*it));
+        CDiskBlockIndex diskindex(*it);
+        if (!(*it)->HasSolution()) {
+            // trimmed entries are always on disk already, keep the solution that is stored there
+            CDiskBlockIndex dbindex;
+            if (!ReadDiskBlockIndex((*it)->GetBlockHash(), dbindex))
+                return error("%s: missing index entry of trimmed block %s", __func__, (*it)->GetBlockHash().ToString());
+            diskindex.nSolution = dbindex.nSolution;
+        }
+        batch.Write(make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()), diskindex);
     }
     return WriteBatch(batch, true);
 }
 
+bool CBlockTreeDB::ReadDiskBlockIndex(const uint256 &blockhash, CDiskBlockIndex &dbindex) {
+    return Read(make_pair(DB_BLOCK_INDEX, blockhash), dbindex);
+}
+
 bool CBlockTreeDB::ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) {
     return Read(make_pair(DB_TXINDEX, txid), pos);
 }
@@ -294,6 +624,197 @@ bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddres
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::ReadAddressBalance(const CAddressIndexIteratorKey &key, CAddressBalanceValue &value) {
+    if (!Read(make_pair(DB_ADDRESSBALANCE, key), value))
+        value.SetNull();
+    return true;
+}
+
+static void BatchWriteAddressBalance(CLevelDBBatch &batch, const CAddressIndexIteratorKey &key,
+                                     const CAddressBalanceValue &oldValue, const CAddressBalanceValue &newValue)
+{
+    if (!oldValue.IsNull())
+        batch.Erase(make_pair(DB_ADDRESSBALANCE_SORTED, CAddressBalanceSortedKey(oldValue.balance, key.type, key.hashBytes)));
+    if (newValue.IsNull()) {
+        batch.Erase(make_pair(DB_ADDRESSBALANCE, key));
+    } else {
+        batch.Write(make_pair(DB_ADDRESSBALANCE, key), newValue);
+        batch.Write(make_pair(DB_ADDRESSBALANCE_SORTED, CAddressBalanceSortedKey(newValue.balance, key.type, key.hashBytes)), 0);
+    }
+}
+
+bool CBlockTreeDB::UpdateAddressBalances(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect, bool fConnect) {
+    std::map<std::pair<unsigned int, uint160>, CAddressBalanceValue> deltas;
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
+        CAddressBalanceValue &delta = deltas[make_pair(it->first.type, it->first.hashBytes)];
+        int sign = fConnect ? 1 : -1;
+        delta.balance += sign * it->second;
+        delta.utxos += sign * (it->first.spending ? -1 : 1);
+    }
+    CLevelDBBatch batch;
+    for (std::map<std::pair<unsigned int, uint160>, CAddressBalanceValue>::const_iterator it=deltas.begin(); it!=deltas.end(); it++) {
+        if (it->second.IsNull())
+            continue;
+        CAddressIndexIteratorKey key(it->first.first, it->first.second);
+        CAddressBalanceValue oldValue;
+        ReadAddressBalance(key, oldValue);
+        CAddressBalanceValue newValue(oldValue.balance + it->second.balance, oldValue.utxos + it->second.utxos);
+        BatchWriteAddressBalance(batch, key, oldValue, newValue);
+    }
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::RebuildAddressBalances() {
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+    CLevelDBBatch batch;
+    int64_t nAddresses = 0;
+
+    // drop whatever a previous partial build left behind
+    CDataStream ssSortedSet(SER_DISK, CLIENT_VERSION);
+    ssSortedSet << DB_ADDRESSBALANCE_SORTED;
+    for (pcursor->Seek(ssSortedSet.str()); pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        char chType;
+        CAddressBalanceSortedKey sortedKey;
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+            ssKey >> chType;
+            if (chType != DB_ADDRESSBALANCE_SORTED)
+                break;
+            ssKey >> sortedKey;
+        } catch (const std::exception& e) {
+            break;
+        }
+        batch.Erase(make_pair(DB_ADDRESSBALANCE_SORTED, sortedKey));
+        batch.Erase(make_pair(DB_ADDRESSBALANCE, CAddressIndexIteratorKey(sortedKey.type, sortedKey.hashBytes)));
+    }
+    if (!WriteBatch(batch))
+        return error("%s: failed to erase address balances", __func__);
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << DB_ADDRESSUNSPENTINDEX;
+    pcursor->Seek(ssKeySet.str());
+
+    CLevelDBBatch balances;
+    CAddressIndexIteratorKey current;
+    CAddressBalanceValue value;
+    bool fHaveCurrent = false;
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        char chType;
+        CAddressUnspentKey indexKey;
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+            ssKey >> chType;
+            if (chType != DB_ADDRESSUNSPENTINDEX)
+                break;
+            ssKey >> indexKey;
+        } catch (const std::exception& e) {
+            break;
+        }
+        if (fHaveCurrent && (indexKey.type != current.type || indexKey.hashBytes != current.hashBytes)) {
+            BatchWriteAddressBalance(balances, current, CAddressBalanceValue(), value);
+            value.SetNull();
+            if (++nAddresses % 100000 == 0) {
+                if (!WriteBatch(balances))
+                    return error("%s: failed to write address balances", __func__);
+                balances.Clear();
+            }
+        }
+        current = CAddressIndexIteratorKey(indexKey.type, indexKey.hashBytes);
+        fHaveCurrent = true;
+        try {
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+            CAddressUnspentValue unspent;
+            ssValue >> unspent;
+            value.balance += unspent.satoshis;
+            value.utxos++;
+        } catch (const std::exception& e) {
+            return error("%s: failed to read address unspent value", __func__);
+        }
+        pcursor->Next();
+    }
+    if (fHaveCurrent)
+        BatchWriteAddressBalance(balances, current, CAddressBalanceValue(), value), nAddresses++;
+    LogPrintf("%s: indexed balances of %d addresses\n", __func__, nAddresses);
+    return WriteBatch(balances, true);
+}
+
+bool CBlockTreeDB::UpdateCCIndex(const std::vector<std::pair<CCCIndexKey, CCCIndexValue> >&unspent,
+                                 const std::vector<std::pair<CCCIndexKey, CCCIndexValue> >&outpoints) {
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<CCCIndexKey, CCCIndexValue> >::const_iterator it=outpoints.begin(); it!=outpoints.end(); it++) {
+        CSpentIndexKey outpoint(it->first.txhash, it->first.index);
+        if (it->second.IsNull()) {
+            batch.Erase(make_pair(DB_CCINDEX_OUTPOINT, outpoint));
+        } else {
+            batch.Write(make_pair(DB_CCINDEX_OUTPOINT, outpoint), *it);
+        }
+    }
+    for (std::vector<std::pair<CCCIndexKey, CCCIndexValue> >::const_iterator it=unspent.begin(); it!=unspent.end(); it++) {
+        if (it->second.IsNull()) {
+            batch.Erase(make_pair(DB_CCINDEX, it->first));
+        } else {
+            batch.Write(make_pair(DB_CCINDEX, it->first), it->second);
+        }
+    }
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadCCIndexOutpoint(const uint256 &txid, unsigned int n, CCCIndexKey &key, CCCIndexValue &value) {
+    std::pair<CCCIndexKey, CCCIndexValue> entry;
+    if (!Read(make_pair(DB_CCINDEX_OUTPOINT, CSpentIndexKey(txid, n)), entry))
+        return false;
+    key = entry.first;
+    value = entry.second;
+    return true;
+}
+
+bool CBlockTreeDB::ReadCCIndex(uint8_t evalcode, uint256 reftxid, uint8_t funcid,
+                               std::vector<std::pair<CCCIndexKey, CCCIndexValue> > &unspentOutputs) {
+
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << make_pair(DB_CCINDEX, CCCIndexIteratorKey(evalcode, reftxid));
+    pcursor->Seek(ssKeySet.str());
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            CCCIndexKey indexKey;
+            ssKey >> chType;
+            ssKey >> indexKey;
+            if (chType == DB_CCINDEX && indexKey.evalcode == evalcode && indexKey.reftxid == reftxid) {
+                if (funcid == 0 || indexKey.funcid == funcid) {
+                    try {
+                        leveldb::Slice slValue = pcursor->value();
+                        CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+                        CCCIndexValue nValue;
+                        ssValue >> nValue;
+                        unspentOutputs.push_back(make_pair(indexKey, nValue));
+                    } catch (const std::exception& e) {
+                        return error("failed to get cc index value");
+                    }
+                }
+                pcursor->Next();
+            } else {
+                break;
+            }
+        } catch (const std::exception& e) {
+            break;
+        }
+    }
+
+    return true;
+}
+
 bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
                                            std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs) {
 
@@ -334,6 +855,123 @@ bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
     return true;
 }
 
+static int AddressKeyHeight(const CAddressIndexKey &key) { return key.blockHeight; }
+static int AddressKeyHeight(const CAddressUnspentKey &key) { return 0; }
+
+/**
+ * Pages through the address index (or unspent index) of several addresses at once, merging them
+ * in key order. Positions are compared on the key bytes that follow (type, hashBytes), i.e.
+ * (height, txindex, txid, index, spending) for 'd' and (txid, index) for 'u', with the address as
+ * tie breaker. The position of the last entry returned is handed back in next, empty when done.
+ */
+template <typename K, typename V>
+static bool ReadAddressPage(CBlockTreeDB &db, char prefix, const std::vector<std::pair<uint160, int> > &addresses,
+                            const std::string &after, int start, int end, unsigned int limit,
+                            std::vector<std::pair<K, V> > &vect, std::string &next)
+{
+    const size_t nAddressBytes = 21;
+    std::vector<boost::shared_ptr<leveldb::Iterator> > cursors;
+    std::vector<std::string> heads(addresses.size());
+    std::vector<std::pair<K, V> > entries(addresses.size());
+
+    next.clear();
+    if (!after.empty() && after.size() <= nAddressBytes)
+        return error("%s: invalid cursor", __func__);
+    for (size_t i = 0; i < addresses.size(); i++) {
+        CDataStream ssAddress(SER_DISK, CLIENT_VERSION);
+        ssAddress << CAddressIndexIteratorKey(addresses[i].second, addresses[i].first);
+        std::string addressBytes = ssAddress.str();
+
+        CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+        ssKeySet << prefix;
+        if (!after.empty())
+            ssKeySet.write(addressBytes.data(), addressBytes.size()), ssKeySet.write(after.data(), after.size() - nAddressBytes);
+        else if (start > 0)
+            ssKeySet << CAddressIndexIteratorHeightKey(addresses[i].second, addresses[i].first, start);
+        else
+            ssKeySet.write(addressBytes.data(), addressBytes.size());
+        cursors.push_back(boost::shared_ptr<leveldb::Iterator>(db.NewIterator()));
+        leveldb::Iterator *pcursor = cursors.back().get();
+        pcursor->Seek(ssKeySet.str());
+
+        // position each cursor on its first entry past the continuation point
+        for (; pcursor->Valid(); pcursor->Next()) {
+            boost::this_thread::interruption_point();
+            leveldb::Slice slKey = pcursor->key();
+            if (slKey.size() <= 1 + nAddressBytes || slKey[0] != prefix || memcmp(slKey.data() + 1, addressBytes.data(), nAddressBytes) != 0)
+                break;
+            std::string position = std::string(slKey.data() + 1 + nAddressBytes, slKey.size() - 1 - nAddressBytes) + addressBytes;
+            if (!after.empty() && position <= after)
+                continue;
+            try {
+                CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+                leveldb::Slice slValue = pcursor->value();
+                CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+                char chType;
+                ssKey >> chType >> entries[i].first;
+                ssValue >> entries[i].second;
+            } catch (const std::exception& e) {
+                return error("%s: failed to read address index entry", __func__);
+            }
+            if (end > 0 && AddressKeyHeight(entries[i].first) > end)
+                break;
+            heads[i] = position;
+            break;
+        }
+    }
+
+    while (true) {
+        int best = -1;
+        for (size_t i = 0; i < heads.size(); i++)
+            if (!heads[i].empty() && (best < 0 || heads[i] < heads[best]))
+                best = i;
+        if (best < 0) {
+            next.clear();
+            break;
+        }
+        if (vect.size() >= limit)
+            break;
+        vect.push_back(entries[best]);
+        next = heads[best];
+        heads[best].clear();
+
+        leveldb::Iterator *pcursor = cursors[best].get();
+        for (pcursor->Next(); pcursor->Valid(); ) {
+            leveldb::Slice slKey = pcursor->key();
+            std::string addressBytes = next.substr(next.size() - nAddressBytes);
+            if (slKey.size() <= 1 + nAddressBytes || slKey[0] != prefix || memcmp(slKey.data() + 1, addressBytes.data(), nAddressBytes) != 0)
+                break;
+            try {
+                CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+                leveldb::Slice slValue = pcursor->value();
+                CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+                char chType;
+                ssKey >> chType >> entries[best].first;
+                ssValue >> entries[best].second;
+            } catch (const std::exception& e) {
+                return error("%s: failed to read address index entry", __func__);
+            }
+            if (end > 0 && AddressKeyHeight(entries[best].first) > end)
+                break;
+            heads[best] = std::string(slKey.data() + 1 + nAddressBytes, slKey.size() - 1 - nAddressBytes) + addressBytes;
+            break;
+        }
+    }
+    return true;
+}
+
+bool CBlockTreeDB::ReadAddressIndexPage(const std::vector<std::pair<uint160, int> > &addresses, const std::string &after,
+                                        int start, int end, unsigned int limit,
+                                        std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, std::string &next) {
+    return ReadAddressPage(*this, DB_ADDRESSINDEX, addresses, after, start, end, limit, addressIndex, next);
+}
+
+bool CBlockTreeDB::ReadAddressUnspentIndexPage(const std::vector<std::pair<uint160, int> > &addresses, const std::string &after,
+                                               unsigned int limit,
+                                               std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs, std::string &next) {
+    return ReadAddressPage(*this, DB_ADDRESSUNSPENTINDEX, addresses, after, 0, 0, limit, unspentOutputs, next);
+}
+
 bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
     CLevelDBBatch batch;
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
@@ -399,121 +1037,78 @@ bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
 
 bool getAddressFromIndex(const int &type, const uint160 &hash, std::string &address);
 
-extern UniValue CBlockTreeDB::Snapshot(int top)
+UniValue CBlockTreeDB::Snapshot(int top)
 {
     char chType; int64_t total = 0; int64_t totalAddresses = 0; std::string address;
-    int64_t utxos = 0; int64_t ignoredAddresses;
+    int64_t utxos = 0; int64_t ignoredAddresses = 0;
     boost::scoped_ptr<leveldb::Iterator> iter(NewIterator());
-    std::map <std::string, CAmount> addressAmounts;
-    std::vector <std::pair<CAmount, std::string>> vaddr;
     UniValue result(UniValue::VOBJ);
     result.push_back(Pair("start_time", (int) time(NULL)));
 
-    std::map <std::string,int> ignoredMap = {
-	{"RReUxSs5hGE39ELU23DfydX8riUuzdrHAE", 1},
-	{"RMUF3UDmzWFLSKV82iFbMaqzJpUnrWjcT4", 1},
-	{"RA5imhVyJa7yHhggmBytWuDr923j2P1bxx", 1},
-	{"RBM5LofZFodMeewUzoMWcxedm3L3hYRaWg", 1},
-	{"RAdcko2d94TQUcJhtFHZZjMyWBKEVfgn4J", 1},
-	{"RLzUaZ934k2EFCsAiVjrJqM8uU1vmMRFzk", 1},
-	{"RMSZMWZXv4FhUgWhEo4R3AQXmRDJ6rsGyt", 1},
-	{"RUDrX1v5toCsJMUgtvBmScKjwCB5NaR8py", 1},
-	{"RMSZMWZXv4FhUgWhEo4R3AQXmRDJ6rsGyt", 1},
-	{"RRvwmbkxR5YRzPGL5kMFHMe1AH33MeD8rN", 1},
-	{"RQLQvSgpPAJNPgnpc8MrYsbBhep95nCS8L", 1},
-	{"RK8JtBV78HdvEPvtV5ckeMPSTojZPzHUTe", 1},
-	{"RHVs2KaCTGUMNv3cyWiG1jkEvZjigbCnD2", 1},
-	{"RE3SVaDgdjkRPYA6TRobbthsfCmxQedVgF", 1},
-	{"RW6S5Lw5ZCCvDyq4QV9vVy7jDHfnynr5mn", 1},
-	{"RTkJwAYtdXXhVsS3JXBAJPnKaBfMDEswF8", 1},
-	{"RD6GgnrMpPaTSMn8vai6yiGA7mN4QGPVMY", 1} //Burnaddress for null privkey
+    static const std::set<std::string> ignoredMap = {
+	"RReUxSs5hGE39ELU23DfydX8riUuzdrHAE",
+	"RMUF3UDmzWFLSKV82iFbMaqzJpUnrWjcT4",
+	"RA5imhVyJa7yHhggmBytWuDr923j2P1bxx",
+	"RBM5LofZFodMeewUzoMWcxedm3L3hYRaWg",
+	"RAdcko2d94TQUcJhtFHZZjMyWBKEVfgn4J",
+	"RLzUaZ934k2EFCsAiVjrJqM8uU1vmMRFzk",
+	"RMSZMWZXv4FhUgWhEo4R3AQXmRDJ6rsGyt",
+	"RUDrX1v5toCsJMUgtvBmScKjwCB5NaR8py",
+	"RRvwmbkxR5YRzPGL5kMFHMe1AH33MeD8rN",
+	"RQLQvSgpPAJNPgnpc8MrYsbBhep95nCS8L",
+	"RK8JtBV78HdvEPvtV5ckeMPSTojZPzHUTe",
+	"RHVs2KaCTGUMNv3cyWiG1jkEvZjigbCnD2",
+	"RE3SVaDgdjkRPYA6TRobbthsfCmxQedVgF",
+	"RW6S5Lw5ZCCvDyq4QV9vVy7jDHfnynr5mn",
+	"RTkJwAYtdXXhVsS3JXBAJPnKaBfMDEswF8",
+	"RD6GgnrMpPaTSMn8vai6yiGA7mN4QGPVMY" //Burnaddress for null privkey
     };
 
     int64_t startingHeight = chainActive.Height();
-    //fprintf(stderr, "Starting snapshot at height %lli\n", startingHeight);
-    for (iter->SeekToLast(); iter->Valid(); iter->Prev())
+    // the balance table is ordered by descending balance, so the richlist is emitted as it is read
+    UniValue addressesSorted(UniValue::VARR);
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << DB_ADDRESSBALANCE_SORTED;
+    for (iter->Seek(ssKeySet.str()); iter->Valid(); iter->Next())
     {
         boost::this_thread::interruption_point();
+        CAddressBalanceSortedKey indexKey;
         try
         {
             leveldb::Slice slKey = iter->key();
             CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
-	    CAddressIndexIteratorKey indexKey;
-
-	    ssKey >> chType;
-	    ssKey >> indexKey;
-
-	    //fprintf(stderr, "chType=%d\n", chType);
-            if (chType == DB_ADDRESSUNSPENTINDEX)
-            {
-                try {
-                    leveldb::Slice slValue = iter->value();
-                    CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
-                    CAmount nValue;
-                    ssValue >> nValue;
-
-		    getAddressFromIndex(indexKey.type, indexKey.hashBytes, address);
-
-		    std::map <std::string, int>::iterator ignored = ignoredMap.find(address);
-		    if (ignored != ignoredMap.end()) {
-			fprintf(stderr,"ignoring %s\n", address.c_str());
-			ignoredAddresses++;
-			continue;
-		    }
-
-		    std::map <std::string, CAmount>::iterator pos = addressAmounts.find(address);
-		    if (pos == addressAmounts.end()) {
-			// insert new address + utxo amount
-			//fprintf(stderr, "inserting new address %s with amount %li\n", address.c_str(), nValue);
-			addressAmounts[address] = nValue;
-			totalAddresses++;
-		    } else {
-			// update unspent tally for this address
-			//fprintf(stderr, "updating address %s with new utxo amount %li\n", address.c_str(), nValue);
-			addressAmounts[address] += nValue;
-		    }
-		    //fprintf(stderr,"{\"%s\", %.8f},\n",address.c_str(),(double)nValue/COIN);
-		    // total += nValue;
-		    utxos++;
-                } catch (const std::exception& e) {
-		    fprintf(stderr, "DONE %s: LevelDB addressindex exception! - %s\n", __func__, e.what());
-		    break;
-                }
-	    }
+            ssKey >> chType;
+            if (chType != DB_ADDRESSBALANCE_SORTED)
+                break;
+            ssKey >> indexKey;
         } catch (const std::exception& e) {
-	    fprintf(stderr, "DONE reading index entries\n");
+            fprintf(stderr, "DONE reading balance entries\n");
             break;
         }
+        if (!getAddressFromIndex(indexKey.type, indexKey.hashBytes, address))
+            continue;
+        if (ignoredMap.count(address) != 0) {
+            fprintf(stderr,"ignoring %s\n", address.c_str());
+            ignoredAddresses++;
+            continue;
+        }
+        CAddressBalanceValue value;
+        ReadAddressBalance(CAddressIndexIteratorKey(indexKey.type, indexKey.hashBytes), value);
+
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back( make_pair("addr", address.c_str() ) );
+        char amount[32];
+        sprintf(amount, "%.8f", (double) indexKey.balance / COIN);
+        obj.push_back( make_pair("amount", amount) );
+        total += indexKey.balance;
+        utxos += value.utxos;
+        addressesSorted.push_back(obj);
+        totalAddresses++;
+        // If requested, only show top N addresses in output JSON
+        if (top == totalAddresses)
+            break;
     }
 
-    UniValue addresses(UniValue::VARR);
-    //fprintf(stderr, "total=%f, totalAddresses=%li, utxos=%li, ignored=%li\n", (double) total / COIN, totalAddresses, utxos, ignoredAddresses);
-
-    for (std::pair<std::string, CAmount> element : addressAmounts) {
-	vaddr.push_back( make_pair(element.second, element.first) );
-    }
-    std::sort(vaddr.rbegin(), vaddr.rend());
-
-    UniValue obj(UniValue::VOBJ);
-    UniValue addressesSorted(UniValue::VARR);
-    int topN = 0;
-    for (std::vector<std::pair<CAmount, std::string>>::iterator it = vaddr.begin(); it!=vaddr.end(); ++it) {
-	UniValue obj(UniValue::VOBJ);
-	obj.push_back( make_pair("addr", it->second.c_str() ) );
-	char amount[32];
-	sprintf(amount, "%.8f", (double) it->first / COIN);
-	obj.push_back( make_pair("amount", amount) );
-	total += it->first;
-	addressesSorted.push_back(obj);
-	topN++;
-	// If requested, only show top N addresses in output JSON
- 	if (top == topN)
-	    break;
-    }
-
-    if (top)
-	totalAddresses = top;
-
     if (totalAddresses > 0) {
 	// Array of all addreses with balances
         result.push_back(make_pair("addresses", addressesSorted));
@@ -522,7 +1117,7 @@ extern UniValue CBlockTreeDB::Snapshot(int top)
 	// Average amount in each address of this snapshot
         result.push_back(make_pair("average",(double) (total/COIN) / totalAddresses ));
     }
-    // Total number of utxos processed in this snaphot
+    // Total number of utxos held by the addresses in this snaphot
     result.push_back(make_pair("utxos", utxos));
     // Total number of addresses in this snaphot
     result.push_back(make_pair("total_addresses", totalAddresses));
@@ -607,8 +1202,6 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
-void komodo_index2pubkey33(uint8_t *pubkey33,CBlockIndex *pindex,int32_t height);
-
 bool CBlockTreeDB::blockOnchainActive(const uint256 &hash) {
     CBlockIndex* pblockindex = mapBlockIndex[hash];
 
@@ -619,69 +1212,176 @@ bool CBlockTreeDB::blockOnchainActive(const uint256 &hash) {
     return true;
 }
 
+/** Where a load worker leaves a deserialized entry for the linking pass */
+struct CBlockIndexLoadEntry
+{
+    uint256 hash;
+    uint256 hashPrev;
+    CBlockIndex *pindex;
+
+    CBlockIndexLoadEntry() : pindex(NULL) {}
+};
+
+/** Deserializes one raw block index entry and checks that its header hashes to the key it is stored under */
+class CBlockIndexLoadCheck
+{
+private:
+    uint256 hash;
+    std::string strValue;
+    CBlockIndexLoadEntry *pentry;
+
+public:
+    CBlockIndexLoadCheck() : pentry(NULL) {}
+    CBlockIndexLoadCheck(const uint256 &hashIn, const leveldb::Slice &slValue, CBlockIndexLoadEntry *pentryIn) :
+        hash(hashIn), strValue(slValue.data(), slValue.size()), pentry(pentryIn) {}
+
+    bool operator()()
+    {
+        try {
+            CDataStream ssValue(strValue.data(), strValue.data()+strValue.size(), SER_DISK, CLIENT_VERSION);
+            CDiskBlockIndex diskindex;
+            ssValue >> diskindex;
+
+            // Consistency checks
+            if (diskindex.GetBlockHash() != hash)
+                return error("LoadBlockIndex(): block header inconsistency detected: key = %s, on-disk = %s",
+                             hash.ToString(), diskindex.ToString());
+
+            CBlockIndex* pindexNew = new CBlockIndex();
+            pindexNew->nHeight        = diskindex.nHeight;
+            pindexNew->nFile          = diskindex.nFile;
+            pindexNew->nDataPos       = diskindex.nDataPos;
+            pindexNew->nUndoPos       = diskindex.nUndoPos;
+            pindexNew->hashAnchor     = diskindex.hashAnchor;
+            pindexNew->nVersion       = diskindex.nVersion;
+            pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+            pindexNew->hashReserved   = diskindex.hashReserved;
+            pindexNew->nTime          = diskindex.nTime;
+            pindexNew->nBits          = diskindex.nBits;
+            pindexNew->nNonce         = diskindex.nNonce;
+            if (!fCompactBlockIndex)
+                pindexNew->nSolution.swap(diskindex.nSolution);
+            pindexNew->nStatus        = diskindex.nStatus;
+            pindexNew->nCachedBranchId = diskindex.nCachedBranchId;
+            pindexNew->nTx            = diskindex.nTx;
+            pindexNew->nSproutValue   = diskindex.nSproutValue;
+            memcpy(pindexNew->pubkey33,diskindex.pubkey33,sizeof(pindexNew->pubkey33));
+            pindexNew->notaryid       = diskindex.notaryid;
+            pindexNew->stakesegid     = diskindex.stakesegid;
+
+            pentry->hash = hash;
+            pentry->hashPrev = diskindex.hashPrev;
+            pentry->pindex = pindexNew;
+            return true;
+        } catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+
+    void swap(CBlockIndexLoadCheck &check)
+    {
+        std::swap(hash, check.hash);
+        strValue.swap(check.strValue);
+        std::swap(pentry, check.pentry);
+    }
+};
+
+//! Entries handed to the load workers before the scan waits for them, bounds the raw entries held in memory
+static const unsigned int BLOCKINDEX_LOAD_CHUNK = 50000;
+
+static bool AddBlockIndexLoadChecks(CCheckQueueControl<CBlockIndexLoadCheck> &control, bool fParallel, std::vector<CBlockIndexLoadCheck> &vChecks)
+{
+    bool fOk = true;
+    if (fParallel) {
+        control.Add(vChecks);
+    } else {
+        BOOST_FOREACH(CBlockIndexLoadCheck &check, vChecks) {
+            if (!(fOk = check()))
+                break;
+        }
+    }
+    vChecks.clear();
+    return fOk;
+}
+
 bool CBlockTreeDB::LoadBlockIndexGuts()
 {
+    int64_t nTimeStart = GetTimeMicros();
     boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
 
     CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
     ssKeySet << make_pair(DB_BLOCK_INDEX, uint256());
     pcursor->Seek(ssKeySet.str());
 
-    // Load mapBlockIndex
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        try {
-            leveldb::Slice slKey = pcursor->key();
-            CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
-            char chType;
-            ssKey >> chType;
-            if (chType == DB_BLOCK_INDEX) {
-                leveldb::Slice slValue = pcursor->value();
-                CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
-                CDiskBlockIndex diskindex;
-                ssValue >> diskindex;
-
-                // Construct block index object
-                CBlockIndex* pindexNew = InsertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev          = InsertBlockIndex(diskindex.hashPrev);
-                pindexNew->nHeight        = diskindex.nHeight;
-                pindexNew->nFile          = diskindex.nFile;
-                pindexNew->nDataPos       = diskindex.nDataPos;
-                pindexNew->nUndoPos       = diskindex.nUndoPos;
-                pindexNew->hashAnchor     = diskindex.hashAnchor;
-                pindexNew->nVersion       = diskindex.nVersion;
-                pindexNew->hashReserved   = diskindex.hashReserved;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->hashReserved   = diskindex.hashReserved;
-                pindexNew->nTime          = diskindex.nTime;
-                pindexNew->nBits          = diskindex.nBits;
-                pindexNew->nNonce         = diskindex.nNonce;
-                pindexNew->nSolution      = diskindex.nSolution;
-                pindexNew->nStatus        = diskindex.nStatus;
-                pindexNew->nCachedBranchId = diskindex.nCachedBranchId;
-                pindexNew->nTx            = diskindex.nTx;
-                pindexNew->nSproutValue   = diskindex.nSproutValue;
-                
-                // Consistency checks
-                auto header = pindexNew->GetBlockHeader();
-                if (header.GetHash() != pindexNew->GetBlockHash())
-                    return error("LoadBlockIndex(): block header inconsistency detected: on-disk = %s, in-memory = %s",
-                                 diskindex.ToString(),  pindexNew->ToString());
-                if ( 0 ) // POW will be checked before any block is connected
-                {
-                    uint8_t pubkey33[33];
-                    komodo_index2pubkey33(pubkey33,pindexNew,pindexNew->nHeight);
-                    if (!CheckProofOfWork(pindexNew->nHeight,pubkey33,pindexNew->GetBlockHash(), pindexNew->nBits, Params().GetConsensus(),pindexNew->nTime))
-                        return error("LoadBlockIndex(): CheckProofOfWork failed: %s", pindexNew->ToString());
+    // This thread streams the scan while the workers deserialize and hash, the
+    // entries are only linked into mapBlockIndex once all of them are loaded
+    int nThreads = std::max(nScriptCheckThreads, 1);
+    CCheckQueue<CBlockIndexLoadCheck> queue(128);
+    boost::thread_group workers;
+    for (int i=0; i<nThreads-1; i++)
+        workers.create_thread(boost::bind(&CCheckQueue<CBlockIndexLoadCheck>::Thread, &queue));
+
+    std::deque<CBlockIndexLoadEntry> entries;
+    std::vector<CBlockIndexLoadCheck> vChecks;
+    bool fOk = true, fDone = false;
+    try {
+        while (fOk && !fDone && pcursor->Valid()) {
+            boost::this_thread::interruption_point();
+            CCheckQueueControl<CBlockIndexLoadCheck> control(nThreads > 1 ? &queue : NULL);
+            for (unsigned int n = 0; n < BLOCKINDEX_LOAD_CHUNK && pcursor->Valid(); n++) {
+                leveldb::Slice slKey = pcursor->key();
+                CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+                char chType;
+                uint256 hash;
+                ssKey >> chType;
+                if (chType != DB_BLOCK_INDEX) {
+                    fDone = true; // finished loading block index
+                    break;
                 }
+                ssKey >> hash;
+                entries.push_back(CBlockIndexLoadEntry());
+                vChecks.push_back(CBlockIndexLoadCheck(hash, pcursor->value(), &entries.back()));
+                if (vChecks.size() >= 1000)
+                    fOk &= AddBlockIndexLoadChecks(control, nThreads > 1, vChecks);
                 pcursor->Next();
-            } else {
-                break; // if shutdown requested or finished loading block index
             }
-        } catch (const std::exception& e) {
-            return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+            fOk &= AddBlockIndexLoadChecks(control, nThreads > 1, vChecks);
+            fOk &= control.Wait();
+        }
+    } catch (const std::exception& e) {
+        fOk = error("%s: Deserialize or I/O error - %s", __func__, e.what());
+    } catch (...) {
+        queue.Quit();
+        workers.join_all();
+        throw;
+    }
+    queue.Quit();
+    workers.join_all();
+    int64_t nTimeLoad = GetTimeMicros();
+    if (!fOk) {
+        BOOST_FOREACH(CBlockIndexLoadEntry &entry, entries)
+            delete entry.pindex;
+        return false;
+    }
+
+    // Link the entries, which only touches mapBlockIndex from this thread
+    mapBlockIndex.reserve(mapBlockIndex.size() + entries.size());
+    BOOST_FOREACH(CBlockIndexLoadEntry &entry, entries) {
+        std::pair<BlockMap::iterator, bool> ret = mapBlockIndex.insert(make_pair(entry.hash, entry.pindex));
+        if (!ret.second) {
+            // already known, keep the existing object so pointers to it stay valid
+            CBlockIndex *pindex = ret.first->second;
+            *pindex = *entry.pindex;
+            delete entry.pindex;
+            entry.pindex = pindex;
         }
+        entry.pindex->phashBlock = &ret.first->first;
     }
+    BOOST_FOREACH(CBlockIndexLoadEntry &entry, entries)
+        entry.pindex->pprev = InsertBlockIndex(entry.hashPrev);
+    int64_t nTimeLink = GetTimeMicros();
 
+    LogPrintf("%s: %u entries, scanned, deserialized and hashed in %.2fs on %d threads, linked in %.2fs\n", __func__,
+              entries.size(), (nTimeLoad - nTimeStart) * 0.000001, nThreads, (nTimeLink - nTimeLoad) * 0.000001);
     return true;
 }
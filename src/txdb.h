@@ -17,18 +17,22 @@
 
 class CBlockFileInfo;
 class CBlockIndex;
+class CDiskBlockIndex;
 struct CDiskTxPos;
 struct CAddressUnspentKey;
 struct CAddressUnspentValue;
 struct CAddressIndexKey;
 struct CAddressIndexIteratorKey;
 struct CAddressIndexIteratorHeightKey;
+struct CAddressBalanceValue;
 struct CTimestampIndexKey;
 struct CTimestampIndexIteratorKey;
 struct CTimestampBlockIndexKey;
 struct CTimestampBlockIndexValue;
 struct CSpentIndexKey;
 struct CSpentIndexValue;
+struct CCCIndexKey;
+struct CCCIndexValue;
 class uint256;
 
 //! -dbcache default (MiB)
@@ -50,6 +54,7 @@ public:
     bool GetAnchorAt(const uint256 &rt, ZCIncrementalMerkleTree &tree) const;
     bool GetNullifier(const uint256 &nf) const;
     bool GetCoins(const uint256 &txid, CCoins &coins) const;
+    bool GetCoinsOutput(const COutPoint &outpoint, CCoinsCacheEntry &entry) const;
     bool HaveCoins(const uint256 &txid) const;
     uint256 GetBestBlock() const;
     uint256 GetBestAnchor() const;
@@ -59,6 +64,11 @@ public:
                     CAnchorsMap &mapAnchors,
                     CNullifiersMap &mapNullifiers);
     bool GetStats(CCoinsStats &stats) const;
+    //! Whether the database still holds per-transaction coin records of older versions
+    bool NeedsUpgrade() const;
+    //! Convert per-transaction coin records of older versions to per-output ones.
+    //! Stops early, leaving the rest for the next start, if a shutdown is requested.
+    bool Upgrade();
 };
 
 /** Access to the block database (blocks/index/) */
@@ -71,6 +81,7 @@ private:
     void operator=(const CBlockTreeDB&);
 public:
     bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo);
+    bool ReadDiskBlockIndex(const uint256 &blockhash, CDiskBlockIndex &dbindex);
     bool ReadBlockFileInfo(int nFile, CBlockFileInfo &fileinfo);
     bool ReadLastBlockFile(int &nFile);
     bool WriteReindexing(bool fReindex);
@@ -82,11 +93,25 @@ public:
     bool UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect);
     bool ReadAddressUnspentIndex(uint160 addressHash, int type,
                                  std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
+    bool UpdateCCIndex(const std::vector<std::pair<CCCIndexKey, CCCIndexValue> >&unspent,
+                       const std::vector<std::pair<CCCIndexKey, CCCIndexValue> >&outpoints);
+    bool ReadCCIndexOutpoint(const uint256 &txid, unsigned int n, CCCIndexKey &key, CCCIndexValue &value);
+    bool ReadCCIndex(uint8_t evalcode, uint256 reftxid, uint8_t funcid,
+                     std::vector<std::pair<CCCIndexKey, CCCIndexValue> > &unspentOutputs);
+    bool ReadAddressUnspentIndexPage(const std::vector<std::pair<uint160, int> > &addresses, const std::string &after,
+                                     unsigned int limit,
+                                     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs, std::string &next);
     bool WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
     bool EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
     bool ReadAddressIndex(uint160 addressHash, int type,
                           std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                           int start = 0, int end = 0);
+    bool ReadAddressIndexPage(const std::vector<std::pair<uint160, int> > &addresses, const std::string &after,
+                              int start, int end, unsigned int limit,
+                              std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, std::string &next);
+    bool ReadAddressBalance(const CAddressIndexIteratorKey &key, CAddressBalanceValue &value);
+    bool UpdateAddressBalances(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect, bool fConnect);
+    bool RebuildAddressBalances();
     bool WriteTimestampIndex(const CTimestampIndexKey &timestampIndex);
     bool ReadTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &vect);
     bool WriteTimestampBlockIndex(const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts);
@@ -762,6 +762,16 @@ bool CCoinsViewMemPool::GetCoins(const uint256 &txid, CCoins &coins) const {
     return (base->GetCoins(txid, coins) && !coins.IsPruned());
 }
 
+bool CCoinsViewMemPool::GetCoinsOutput(const COutPoint &outpoint, CCoinsCacheEntry &entry) const {
+    // As in GetCoins, a transaction in the mempool takes precedence
+    CTransaction tx;
+    if (mempool.lookup(outpoint.hash, tx)) {
+        entry.coins = CCoins(tx, MEMPOOL_HEIGHT);
+        return true;
+    }
+    return (base->GetCoinsOutput(outpoint, entry) && !entry.IsPruned());
+}
+
 bool CCoinsViewMemPool::HaveCoins(const uint256 &txid) const {
     return mempool.exists(txid) || base->HaveCoins(txid);
 }
@@ -259,6 +259,7 @@ public:
     CCoinsViewMemPool(CCoinsView *baseIn, CTxMemPool &mempoolIn);
     bool GetNullifier(const uint256 &txid) const;
     bool GetCoins(const uint256 &txid, CCoins &coins) const;
+    bool GetCoinsOutput(const COutPoint &outpoint, CCoinsCacheEntry &entry) const;
     bool HaveCoins(const uint256 &txid) const;
 };
 
@@ -59,6 +59,26 @@ std::string static EncodeDumpString(const std::string &str) {
     return ret.str();
 }
 
+/**
+ * Rescans from pindexStart with the caller's cs_main and cs_wallet released,
+ * so that ScanForWalletTransactions can take them batch by batch and the
+ * node stays responsive meanwhile.
+ */
+void static RescanWithLocksReleased(CBlockIndex* pindexStart, bool fUpdate)
+{
+    LEAVE_CRITICAL_SECTION(pwalletMain->cs_wallet);
+    LEAVE_CRITICAL_SECTION(cs_main);
+    try {
+        pwalletMain->ScanForWalletTransactions(pindexStart, fUpdate);
+    } catch (...) {
+        ENTER_CRITICAL_SECTION(cs_main);
+        ENTER_CRITICAL_SECTION(pwalletMain->cs_wallet);
+        throw;
+    }
+    ENTER_CRITICAL_SECTION(cs_main);
+    ENTER_CRITICAL_SECTION(pwalletMain->cs_wallet);
+}
+
 std::string DecodeDumpString(const std::string &str) {
     std::stringstream ret;
     for (unsigned int pos = 0; pos < str.length(); pos++) {
@@ -141,7 +161,7 @@ UniValue importprivkey(const UniValue& params, bool fHelp)
         pwalletMain->nTimeFirstKey = 1; // 0 would be considered 'no value'
 
         if (fRescan) {
-            pwalletMain->ScanForWalletTransactions(chainActive.Genesis(), true);
+            RescanWithLocksReleased(chainActive.Genesis(), true);
         }
     }
 
@@ -213,7 +233,7 @@ UniValue importaddress(const UniValue& params, bool fHelp)
 
         if (fRescan)
         {
-            pwalletMain->ScanForWalletTransactions(chainActive.Genesis(), true);
+            RescanWithLocksReleased(chainActive.Genesis(), true);
             pwalletMain->ReacceptWalletTransactions();
         }
     }
@@ -372,7 +392,7 @@ UniValue importwallet_impl(const UniValue& params, bool fHelp, bool fImportZKeys
         pwalletMain->nTimeFirstKey = nTimeBegin;
 
     LogPrintf("Rescanning last %i blocks\n", chainActive.Height() - pindex->nHeight + 1);
-    pwalletMain->ScanForWalletTransactions(pindex);
+    RescanWithLocksReleased(pindex, false);
     pwalletMain->MarkDirty();
 
     if (!fGood)
@@ -641,7 +661,7 @@ UniValue z_importkey(const UniValue& params, bool fHelp)
 
         // We want to scan for transactions and notes
         if (fRescan) {
-            pwalletMain->ScanForWalletTransactions(chainActive[nRescanHeight], true);
+            RescanWithLocksReleased(chainActive[nRescanHeight], true);
         }
     }
 
@@ -730,7 +750,7 @@ UniValue z_importviewingkey(const UniValue& params, bool fHelp)
 
         // We want to scan for transactions and notes
         if (fRescan) {
-            pwalletMain->ScanForWalletTransactions(chainActive[nRescanHeight], true);
+            RescanWithLocksReleased(chainActive[nRescanHeight], true);
         }
     }
 
@@ -52,7 +52,7 @@ int32_t komodo_isnotaryvout(char *coinaddr); // from ac_private chains only
 
 int64_t nWalletUnlockTime;
 static CCriticalSection cs_nWalletUnlockTime;
-std::string CCerror;
+thread_local std::string CCerror;
 
 // Private method:
 UniValue z_getoperationstatus_IMPL(const UniValue&, bool);
@@ -2562,6 +2562,13 @@ UniValue getwalletinfo(const UniValue& params, bool fHelp)
             "  \"keypoolsize\": xxxx,        (numeric) how many new keys are pre-generated\n"
             "  \"unlocked_until\": ttt,      (numeric) the timestamp in seconds since epoch (midnight Jan 1 1970 GMT) that the wallet is unlocked for transfers, or 0 if the wallet is locked\n"
             "  \"paytxfee\": x.xxxx,         (numeric) the transaction fee configuration, set in KMD/KB\n"
+            "  \"rescan\": {                 (object, only while a rescan is running)\n"
+            "    \"startheight\": n,         (numeric) the height the rescan started from\n"
+            "    \"height\": n,              (numeric) the last block the rescan has committed\n"
+            "    \"progress\": x.xxx,        (numeric) the estimated fraction of the rescan that is done\n"
+            "    \"duration\": n,            (numeric) the seconds the rescan has been running\n"
+            "    \"eta\": n                  (numeric) the estimated seconds left, once progress is known\n"
+            "  }\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getwalletinfo", "")
@@ -2581,6 +2588,18 @@ UniValue getwalletinfo(const UniValue& params, bool fHelp)
     if (pwalletMain->IsCrypted())
         obj.push_back(Pair("unlocked_until", nWalletUnlockTime));
     obj.push_back(Pair("paytxfee",      ValueFromAmount(payTxFee.GetFeePerK())));
+    if (pwalletMain->fRescanning) {
+        UniValue rescan(UniValue::VOBJ);
+        int64_t nDuration = GetTime() - pwalletMain->nRescanStartTime;
+        double dProgress = pwalletMain->dRescanProgress;
+        rescan.push_back(Pair("startheight", pwalletMain->nRescanStartHeight));
+        rescan.push_back(Pair("height", pwalletMain->pindexRescanned ? pwalletMain->pindexRescanned->nHeight : pwalletMain->nRescanStartHeight - 1));
+        rescan.push_back(Pair("progress", dProgress));
+        rescan.push_back(Pair("duration", nDuration));
+        if (dProgress > 0.0)
+            rescan.push_back(Pair("eta", (int64_t)(nDuration * (1.0 - dProgress) / dProgress)));
+        obj.push_back(Pair("rescan", rescan));
+    }
     return obj;
 }
 
@@ -2865,6 +2884,23 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp)
             "Runs a benchmark of the selected type samplecount times,\n"
             "returning the running times of each sample.\n"
             "\n"
+            "verifyjoinsplitblock takes a sample joinsplit, the number of joinsplits\n"
+            "in the block (default 100) and the maximum thread count (default -par),\n"
+            "and returns one running time per thread count for each sample.\n"
+            "verifyccblock takes a block height and the maximum thread count and\n"
+            "times the crypto-condition inputs of that block the same way.\n"
+            "notarizedlookups takes a lookup count (default 100000) and returns the\n"
+            "time of the linear notarization scans followed by the indexed lookups.\n"
+            "verifyequihash takes a verification count (default 1) and also returns\n"
+            "the verifications per second of each sample.\n"
+            "verifyheaders takes a header count (default 2000) and the maximum thread\n"
+            "count (default -par), replays that many active chain headers as headers\n"
+            "messages and returns one running time per thread count; headers per\n"
+            "second is the header count divided by the running time.\n"
+            "trydecryptnotes takes an address count, and optionally a transaction\n"
+            "count and the maximum thread count (default one per core), in which case\n"
+            "the batch is decrypted once per thread count.\n"
+            "\n"
             "Output: [\n"
             "  {\n"
             "    \"runningtime\": runningtime\n"
@@ -2890,11 +2926,12 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp)
 
     JSDescription samplejoinsplit;
 
-    if (benchmarktype == "verifyjoinsplit") {
+    if (benchmarktype == "verifyjoinsplit" || benchmarktype == "verifyjoinsplitblock") {
         CDataStream ss(ParseHexV(params[2].get_str(), "js"), SER_NETWORK, PROTOCOL_VERSION);
         ss >> samplejoinsplit;
     }
 
+    int nVerifications = 1;
     for (int i = 0; i < samplecount; i++) {
         if (benchmarktype == "sleep") {
             sample_times.push_back(benchmark_sleep());
@@ -2912,6 +2949,41 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp)
             }
         } else if (benchmarktype == "verifyjoinsplit") {
             sample_times.push_back(benchmark_verify_joinsplit(samplejoinsplit));
+        } else if (benchmarktype == "verifyjoinsplitblock") {
+            int nJoinSplits = 100;
+            int nMaxThreads = std::max(nScriptCheckThreads, 1);
+            if (params.size() >= 4) {
+                nJoinSplits = params[3].get_int();
+            }
+            if (params.size() >= 5) {
+                nMaxThreads = params[4].get_int();
+            }
+            if (nJoinSplits <= 0 || nMaxThreads <= 0) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid joinsplit or thread count");
+            }
+            std::vector<double> vals = benchmark_verify_joinsplit_block(samplejoinsplit, nJoinSplits, nMaxThreads);
+            sample_times.insert(sample_times.end(), vals.begin(), vals.end());
+        } else if (benchmarktype == "verifyccblock") {
+            int nHeight = params[2].get_int();
+            int nMaxThreads = std::max(nScriptCheckThreads, 1);
+            if (params.size() >= 4) {
+                nMaxThreads = params[3].get_int();
+            }
+            if (nHeight < 0 || nHeight > chainActive.Height() || nMaxThreads <= 0) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid height or thread count");
+            }
+            std::vector<double> vals = benchmark_verify_ccblock(nHeight, nMaxThreads);
+            sample_times.insert(sample_times.end(), vals.begin(), vals.end());
+        } else if (benchmarktype == "notarizedlookups") {
+            int nLookups = 100000;
+            if (params.size() >= 3) {
+                nLookups = params[2].get_int();
+            }
+            if (nLookups <= 0) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid lookup count");
+            }
+            std::vector<double> vals = benchmark_notarized_lookups(nLookups);
+            sample_times.insert(sample_times.end(), vals.begin(), vals.end());
 #ifdef ENABLE_MINING
         } else if (benchmarktype == "solveequihash") {
             if (params.size() < 3) {
@@ -2923,7 +2995,27 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp)
             }
 #endif
         } else if (benchmarktype == "verifyequihash") {
-            sample_times.push_back(benchmark_verify_equihash());
+            if (params.size() >= 3) {
+                nVerifications = params[2].get_int();
+            }
+            if (nVerifications <= 0) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid verification count");
+            }
+            sample_times.push_back(benchmark_verify_equihash(nVerifications));
+        } else if (benchmarktype == "verifyheaders") {
+            int nHeaders = 2000;
+            int nMaxThreads = std::max(nScriptCheckThreads, 1);
+            if (params.size() >= 3) {
+                nHeaders = params[2].get_int();
+            }
+            if (params.size() >= 4) {
+                nMaxThreads = params[3].get_int();
+            }
+            if (nHeaders <= 0 || nMaxThreads <= 0) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid header or thread count");
+            }
+            std::vector<double> vals = benchmark_verify_headers(nHeaders, nMaxThreads);
+            sample_times.insert(sample_times.end(), vals.begin(), vals.end());
         } else if (benchmarktype == "validatelargetx") {
             // Number of inputs in the spending transaction that we will simulate
             int nInputs = 555;
@@ -2933,7 +3025,20 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp)
             sample_times.push_back(benchmark_large_tx(nInputs));
         } else if (benchmarktype == "trydecryptnotes") {
             int nAddrs = params[2].get_int();
-            sample_times.push_back(benchmark_try_decrypt_notes(nAddrs));
+            if (params.size() < 4) {
+                sample_times.push_back(benchmark_try_decrypt_notes(nAddrs));
+            } else {
+                int nTxs = params[3].get_int();
+                int nMaxThreads = GetNumCores();
+                if (params.size() >= 5) {
+                    nMaxThreads = params[4].get_int();
+                }
+                if (nTxs <= 0 || nMaxThreads <= 0) {
+                    throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid transaction or thread count");
+                }
+                std::vector<double> vals = benchmark_try_decrypt_notes_threaded(nAddrs, nTxs, nMaxThreads);
+                sample_times.insert(sample_times.end(), vals.begin(), vals.end());
+            }
         } else if (benchmarktype == "incnotewitnesses") {
             int nTxs = params[2].get_int();
             sample_times.push_back(benchmark_increment_note_witnesses(nTxs));
@@ -2964,6 +3069,9 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp)
     for (auto time : sample_times) {
         UniValue result(UniValue::VOBJ);
         result.push_back(Pair("runningtime", time));
+        if (benchmarktype == "verifyequihash") {
+            result.push_back(Pair("verificationspersec", time > 0 ? nVerifications / time : 0.0));
+        }
         results.push_back(result);
     }
 
@@ -4518,10 +4626,13 @@ UniValue z_listoperationids(const UniValue& params, bool fHelp)
 
 
 #include "script/sign.h"
+#include "crypto/sha256.h"
 int32_t decode_hex(uint8_t *bytes,int32_t n,char *hex);
 extern std::string NOTARY_PUBKEY;
 uint32_t komodo_stake(int32_t validateflag,arith_uint256 bnTarget,int32_t nHeight,uint256 hash,int32_t n,uint32_t blocktime,uint32_t prevtime,char *destaddr);
 int8_t komodo_stakehash(uint256 *hashp,char *address,uint8_t *hashbuf,uint256 txid,int32_t vout);
+uint32_t komodo_stakehash2(uint256 *hashp,uint256 addrhash,uint8_t *hashbuf,uint256 txid,int32_t vout);
+extern uint64_t ASSETCHAINS_STAKED;
 int32_t komodo_segids(uint8_t *hashbuf,int32_t height,int32_t n);
 
 int32_t komodo_notaryvin(CMutableTransaction &txNew,uint8_t *notarypub33)
@@ -4603,83 +4714,138 @@ int32_t komodo_notaryvin(CMutableTransaction &txNew,uint8_t *notarypub33)
 struct komodo_staking
 {
     char address[64];
-    uint256 txid;
+    uint256 txid,addrhash;
     arith_uint256 hashval;
     uint64_t nValue;
     uint32_t segid32,txtime;
-    int32_t vout;
+    int32_t vout,height;
+    bool fCoinBase;
     CScript scriptPubKey;
 };
 
-struct komodo_staking *komodo_addutxo(struct komodo_staking *array,int32_t *numkp,int32_t *maxkp,uint32_t txtime,uint64_t nValue,uint256 txid,int32_t vout,char *address,uint8_t *hashbuf,CScript pk)
+/*
+ The staking candidates are maintained from CWallet::SyncTransaction: spendable outputs of at least 1 coin to our addresses are added when their tx is connected and removed when they are spent in a block, so a staking round no longer walks AvailableCoins and GetTransaction for every utxo. The sha256 of the address (and with it segid32) and the txtime are computed once when the output is added.
+ A disconnected or erased wallet tx and a rescan mark the set dirty and it is rebuilt from the wallet on the next staking round. Outputs spent by wallet txs in the mempool stay in the set and are skipped with IsSpent.
+ */
+static std::map<COutPoint,struct komodo_staking> KOMODO_STAKECANDIDATES;
+static bool KOMODO_STAKECACHE_DIRTY = true;
+
+void komodo_addutxo(uint32_t txtime,int32_t height,bool fCoinBase,uint64_t nValue,uint256 txid,int32_t vout,const CTxDestination &address,const CScript &pk)
+{
+    struct komodo_staking kp; std::string addrstr = CBitcoinAddress(address).ToString();
+    if ( addrstr.size() >= sizeof(kp.address) )
+        return;
+    strcpy(kp.address,addrstr.c_str());
+    CSHA256().Write((const uint8_t *)kp.address,strlen(kp.address)).Finalize((uint8_t *)&kp.addrhash);
+    kp.segid32 = ((uint32_t *)&kp.addrhash)[0];
+    kp.txid = txid;
+    kp.vout = vout;
+    kp.txtime = txtime;
+    kp.height = height;
+    kp.fCoinBase = fCoinBase;
+    kp.nValue = nValue;
+    kp.scriptPubKey = pk;
+    KOMODO_STAKECANDIDATES[COutPoint(txid,vout)] = kp;
+}
+
+// called with cs_wallet held
+void komodo_stakingcache_dirty()
+{
+    KOMODO_STAKECACHE_DIRTY = true;
+}
+
+void komodo_stakingcache_sync(const CTransaction &tx,const CBlock *pblock)
+{
+    CTxDestination address; BlockMap::iterator mi; std::map<uint256,CWalletTx>::iterator wi; uint256 txid; int32_t i,height;
+    if ( ASSETCHAINS_STAKED == 0 || KOMODO_STAKECACHE_DIRTY != 0 || pwalletMain == 0 )
+        return;
+    AssertLockHeld(cs_main);
+    AssertLockHeld(pwalletMain->cs_wallet);
+    txid = tx.GetHash();
+    if ( pblock == 0 )
+    {
+        // a new mempool tx needs nothing, a tx of a disconnected block still has its old hashBlock
+        if ( (wi= pwalletMain->mapWallet.find(txid)) != pwalletMain->mapWallet.end() && wi->second.hashBlock.IsNull() == 0 && ((mi= mapBlockIndex.find(wi->second.hashBlock)) == mapBlockIndex.end() || chainActive.Contains(mi->second) == 0) )
+            KOMODO_STAKECACHE_DIRTY = true;
+        return;
+    }
+    if ( (mi= mapBlockIndex.find(pblock->GetHash())) == mapBlockIndex.end() || mi->second == 0 )
+    {
+        KOMODO_STAKECACHE_DIRTY = true;
+        return;
+    }
+    height = mi->second->nHeight;
+    if ( tx.IsCoinBase() == 0 )
+    {
+        BOOST_FOREACH(const CTxIn &txin,tx.vin)
+            KOMODO_STAKECANDIDATES.erase(txin.prevout);
+    }
+    for (i=0; i<tx.vout.size(); i++)
+    {
+        const CTxOut &out = tx.vout[i];
+        if ( out.nValue < COIN || (IsMine(*pwalletMain,out.scriptPubKey) & ISMINE_SPENDABLE) == 0 || ExtractDestination(out.scriptPubKey,address) == 0 )
+            continue;
+        komodo_addutxo(pblock->nTime,height,tx.IsCoinBase(),(uint64_t)out.nValue,txid,i,address,out.scriptPubKey);
+    }
+}
+
+static void komodo_stakingcache_rebuild()
 {
-    uint256 hash; uint32_t segid32; struct komodo_staking *kp;
-    segid32 = komodo_stakehash(&hash,address,hashbuf,txid,vout);
-    if ( *numkp >= *maxkp )
+    vector<COutput> vecOutputs; CTxDestination address; BlockMap::iterator mi; int64_t nStart = GetTimeMicros();
+    KOMODO_STAKECANDIDATES.clear();
+    pwalletMain->AvailableCoins(vecOutputs, false, NULL, true);
+    BOOST_FOREACH(const COutput& out, vecOutputs)
     {
-        *maxkp += 1000;
-        array = (struct komodo_staking *)realloc(array,sizeof(*array) * (*maxkp));
-    }
-    kp = &array[(*numkp)++];
-    memset(kp,0,sizeof(*kp));
-    strcpy(kp->address,address);
-    kp->txid = txid;
-    kp->vout = vout;
-    kp->hashval = UintToArith256(hash);
-    kp->txtime = txtime;
-    kp->segid32 = segid32;
-    kp->nValue = nValue;
-    kp->scriptPubKey = pk;
-    return(array);
-}
-
-arith_uint256 _komodo_eligible(struct komodo_staking *kp,arith_uint256 ratio,uint32_t blocktime,int32_t iter,int32_t minage,int32_t segid,int32_t nHeight,uint32_t prevtime)
-{
-    int32_t diff; uint64_t coinage; arith_uint256 coinage256,hashval;
-    diff = (iter + blocktime - kp->txtime - minage);
-    if ( diff < 0 )
-        diff = 60;
-    else if ( diff > 3600*24*30 )
-        diff = 3600*24*30;
-    if ( iter > 0 )
-        diff += segid*2;
-    coinage = ((uint64_t)kp->nValue/COIN * diff);
-    if ( blocktime+iter+segid*2 > prevtime+480 )
-        coinage *= ((blocktime+iter+segid*2) - (prevtime+400));
-    //if ( nHeight >= 2500 && blocktime+iter+segid*2 > prevtime+180 )
-    //    coinage *= ((blocktime+iter+segid*2) - (prevtime+60));
-    coinage256 = arith_uint256(coinage+1);
-    hashval = ratio * (kp->hashval / coinage256);
-    //if ( nHeight >= 900 && nHeight < 916 )
-    //    hashval = (hashval / coinage256);
-    return(hashval);
-}
-
-uint32_t komodo_eligible(arith_uint256 bnTarget,arith_uint256 ratio,struct komodo_staking *kp,int32_t nHeight,uint32_t blocktime,uint32_t prevtime,int32_t minage,uint8_t *hashbuf)
-{
-    int32_t maxiters = 600; uint256 hash;
-    int32_t segid,iter,diff; uint64_t coinage; arith_uint256 hashval,coinage256;
-    komodo_stakehash(&hash,kp->address,hashbuf,kp->txid,kp->vout);
+        CAmount nValue = out.tx->vout[out.i].nValue;
+        if ( out.nDepth < 1 || nValue < COIN || !out.fSpendable )
+            continue;
+        const CScript& pk = out.tx->vout[out.i].scriptPubKey;
+        if ( ExtractDestination(pk,address) == 0 || IsMine(*pwalletMain,address) == 0 )
+            continue;
+        if ( (mi= mapBlockIndex.find(out.tx->hashBlock)) != mapBlockIndex.end() && mi->second != 0 && chainActive.Contains(mi->second) != 0 )
+            komodo_addutxo((uint32_t)mi->second->nTime,mi->second->nHeight,out.tx->IsCoinBase(),(uint64_t)nValue,out.tx->GetHash(),out.i,address,pk);
+    }
+    KOMODO_STAKECACHE_DIRTY = false;
+    LogPrint("bench","staking candidates rebuilt: %d of %d utxos in %.2fms\n",(int32_t)KOMODO_STAKECANDIDATES.size(),(int32_t)vecOutputs.size(),0.001 * (GetTimeMicros() - nStart));
+}
+
+/*
+ komodo_eligible finds the first of the 600 blocktime iterations at which kp wins. hashval = ratio * (hash / coinage256) only gets smaller as coinage grows, so instead of one 256 bit division per iteration the smallest winning coinage is computed once:
+   ratio * (hash / c) <= bnTarget  <=>  hash / c <= maxq  <=>  c > hash / (maxq + 1)
+ with maxq = bnTarget / ratio, and the iterations are then checked with 64 bit coinage arithmetic only. maxq and the iteration independent terms are per round and computed by the caller. A product that would overflow 256 bits is not treated as a winner here, komodo_stake still validates the chosen blocktime.
+ */
+uint32_t komodo_eligible(const arith_uint256 &maxq,struct komodo_staking *kp,int32_t nHeight,uint32_t blocktime,uint32_t prevtime,int32_t minage,uint8_t *hashbuf)
+{
+    int32_t maxiters = 600,segid,iter,diff; uint32_t t; uint64_t value,coinage,mincoinage; uint256 hash; arith_uint256 minc;
+    komodo_stakehash2(&hash,kp->addrhash,hashbuf,kp->txid,kp->vout);
     kp->hashval = UintToArith256(hash);
     segid = ((nHeight + kp->segid32) & 0x3f);
-    hashval = _komodo_eligible(kp,ratio,blocktime,maxiters,minage,segid,nHeight,prevtime);
-    //for (int i=32; i>=0; i--)
-    //    fprintf(stderr,"%02x",((uint8_t *)&hashval)[i]);
-    //fprintf(stderr," b.%u minage.%d segid.%d ht.%d prev.%u\n",blocktime,minage,segid,nHeight,prevtime);
-    if ( hashval <= bnTarget )
+    if ( maxq == ~arith_uint256(0) )
+        minc = arith_uint256(1);
+    else minc = (kp->hashval / (maxq + 1)) + 1;
+    if ( minc > arith_uint256(UINT64_MAX) )
+        return(0);
+    mincoinage = minc.GetLow64(); // coinage256 = coinage+1 must reach it
+    value = kp->nValue/COIN;
+    for (iter=0; iter<maxiters; iter++)
     {
-        for (iter=0; iter<maxiters; iter++)
+        t = blocktime + iter + segid*2;
+        if ( t < kp->txtime+minage )
+            continue;
+        diff = (iter + blocktime - kp->txtime - minage);
+        if ( diff < 0 )
+            diff = 60;
+        else if ( diff > 3600*24*30 )
+            diff = 3600*24*30;
+        if ( iter > 0 )
+            diff += segid*2;
+        coinage = (value * diff);
+        if ( t > prevtime+480 )
+            coinage *= (t - (prevtime+400));
+        if ( coinage+1 >= mincoinage )
         {
-            if ( blocktime+iter+segid*2 < kp->txtime+minage )
-                continue;
-            hashval = _komodo_eligible(kp,ratio,blocktime,iter,minage,segid,nHeight,prevtime);
-            if ( hashval <= bnTarget )
-            {
-                //fprintf(stderr,"winner %.8f blocktime.%u iter.%d segid.%d\n",(double)kp->nValue/COIN,blocktime,iter,segid);
-                blocktime += iter;
-                blocktime += segid * 2;
-                return(blocktime);
-            }
+            //fprintf(stderr,"winner %.8f blocktime.%u iter.%d segid.%d\n",(double)kp->nValue/COIN,blocktime,iter,segid);
+            return(blocktime + iter + segid*2);
         }
     }
     return(0);
@@ -4687,18 +4853,17 @@ uint32_t komodo_eligible(arith_uint256 bnTarget,arith_uint256 ratio,struct komod
 
 int32_t komodo_staked(CMutableTransaction &txNew,uint32_t nBits,uint32_t *blocktimep,uint32_t *txtimep,uint256 *utxotxidp,int32_t *utxovoutp,uint64_t *utxovaluep,uint8_t *utxosig)
 {
-    static struct komodo_staking *array; static int32_t numkp,maxkp; static uint32_t lasttime;
-    set<CBitcoinAddress> setAddress; struct komodo_staking *kp; int32_t winners,segid,minage,nHeight,counter=0,i,m,siglen=0,nMinDepth = 1,nMaxDepth = 99999999; vector<COutput> vecOutputs; uint32_t block_from_future_rejecttime,besttime,eligible,eligible2,earliest = 0; CScript best_scriptPubKey; arith_uint256 mindiff,ratio,bnTarget; CBlockIndex *tipindex,*pindex; CTxDestination address; bool fNegative,fOverflow; uint8_t hashbuf[256]; CTransaction tx; uint256 hashBlock;
+    struct komodo_staking *kp; int32_t winners,segid,minage,nHeight,counter=0,i,m,siglen=0; uint32_t block_from_future_rejecttime,besttime,eligible,eligible2,earliest = 0; CScript best_scriptPubKey; arith_uint256 mindiff,ratio,bnTarget,maxq; CBlockIndex *tipindex; bool fNegative,fOverflow; uint8_t hashbuf[256]; std::map<uint256,CWalletTx>::const_iterator wi;
     bnTarget.SetCompact(nBits, &fNegative, &fOverflow);
     mindiff.SetCompact(KOMODO_MINDIFF_NBITS,&fNegative,&fOverflow);
     ratio = (mindiff / bnTarget);
+    maxq = (ratio == 0) ? ~arith_uint256(0) : (bnTarget / ratio);
     assert(pwalletMain != NULL);
     LOCK2(cs_main, pwalletMain->cs_wallet);
     *utxovaluep = 0;
     memset(utxotxidp,0,sizeof(*utxotxidp));
     memset(utxovoutp,0,sizeof(*utxovoutp));
     memset(utxosig,0,72);
-    pwalletMain->AvailableCoins(vecOutputs, false, NULL, true);
     if ( (tipindex= chainActive.Tip()) == 0 )
         return(0);
     nHeight = tipindex->nHeight + 1;
@@ -4707,56 +4872,19 @@ int32_t komodo_staked(CMutableTransaction &txNew,uint32_t nBits,uint32_t *blockt
     komodo_segids(hashbuf,nHeight-101,100);
     if ( *blocktimep > tipindex->nTime+60 )
         *blocktimep = tipindex->nTime+60;
-    //fprintf(stderr,"Start scan of utxo for staking %u ht.%d\n",(uint32_t)time(NULL),nHeight);
-    if ( time(NULL) > lasttime+600 )
-    {
-        if ( array != 0 )
-        {
-            free(array);
-            array = 0;
-            maxkp = numkp = 0;
-            lasttime = 0;
-        }
-        BOOST_FOREACH(const COutput& out, vecOutputs)
-        {
-            if ( (tipindex= chainActive.Tip()) == 0 || tipindex->nHeight+1 > nHeight )
-            {
-                fprintf(stderr,"chain tip changed during staking loop t.%u counter.%d\n",(uint32_t)time(NULL),counter);
-                return(0);
-            }
-            counter++;
-            if ( out.nDepth < nMinDepth || out.nDepth > nMaxDepth )
-            {
-                //fprintf(stderr,"komodo_staked invalid depth %d\n",(int32_t)out.nDepth);
-                continue;
-            }
-            CAmount nValue = out.tx->vout[out.i].nValue;
-            if ( nValue < COIN  || !out.fSpendable )
-                continue;
-            const CScript& pk = out.tx->vout[out.i].scriptPubKey;
-            if ( ExtractDestination(pk,address) != 0 )
-            {
-                if ( IsMine(*pwalletMain,address) == 0 )
-                    continue;
-                if ( GetTransaction(out.tx->GetHash(),tx,hashBlock,true) != 0 && (pindex= mapBlockIndex[hashBlock]) != 0 )
-                {
-                    array = komodo_addutxo(array,&numkp,&maxkp,(uint32_t)pindex->nTime,(uint64_t)nValue,out.tx->GetHash(),out.i,(char *)CBitcoinAddress(address).ToString().c_str(),hashbuf,(CScript)pk);
-                }
-            }
-        }
-        lasttime = (uint32_t)time(NULL);
-        //fprintf(stderr,"finished kp data of utxo for staking %u ht.%d numkp.%d maxkp.%d\n",(uint32_t)time(NULL),nHeight,numkp,maxkp);
-    }
+    if ( KOMODO_STAKECACHE_DIRTY != 0 )
+        komodo_stakingcache_rebuild();
     block_from_future_rejecttime = (uint32_t)GetAdjustedTime() + 57;
-    for (i=winners=0; i<numkp; i++)
+    winners = 0;
+    for (std::map<COutPoint,struct komodo_staking>::iterator it=KOMODO_STAKECANDIDATES.begin(); it!=KOMODO_STAKECANDIDATES.end(); it++)
     {
-        if ( (tipindex= chainActive.Tip()) == 0 || tipindex->nHeight+1 > nHeight )
-        {
-            fprintf(stderr,"chain tip changed during staking loop t.%u counter.%d\n",(uint32_t)time(NULL),counter);
-            return(0);
-        }
-        kp = &array[i];
-        if ( (eligible2= komodo_eligible(bnTarget,ratio,kp,nHeight,*blocktimep,(uint32_t)tipindex->nTime+27,minage,hashbuf)) == 0 )
+        kp = &it->second;
+        counter++;
+        if ( kp->fCoinBase != 0 && nHeight - kp->height <= COINBASE_MATURITY )
+            continue;
+        if ( (eligible2= komodo_eligible(maxq,kp,nHeight,*blocktimep,(uint32_t)tipindex->nTime+27,minage,hashbuf)) == 0 )
+            continue;
+        if ( pwalletMain->IsSpent(kp->txid,kp->vout) != 0 || pwalletMain->IsLockedCoin(kp->txid,kp->vout) != 0 )
             continue;
         eligible = komodo_stake(0,bnTarget,nHeight,kp->txid,kp->vout,0,(uint32_t)tipindex->nTime+27,kp->address);
         //fprintf(stderr,"i.%d %u vs %u\n",i,eligible2,eligible);
@@ -4795,13 +4923,6 @@ int32_t komodo_staked(CMutableTransaction &txNew,uint32_t nBits,uint32_t *blockt
                 fprintf(stderr,"ht.%d earliest.%u [%d].%d (%s) nValue %.8f locktime.%u counter.%d winners.%d\n",nHeight,earliest,(int32_t)(earliest - tipindex->nTime),m,kp->address,(double)kp->nValue/COIN,*txtimep,counter,winners);
             }
         } //else fprintf(stderr,"utxo not eligible\n");
-    } //else fprintf(stderr,"no tipindex\n");
-    if ( numkp < 10000 && array != 0 )
-    {
-        free(array);
-        array = 0;
-        maxkp = numkp = 0;
-        lasttime = 0;
     }
     if ( earliest != 0 )
     {
@@ -6198,6 +6319,44 @@ UniValue tokenorders(const UniValue& params, bool fHelp)
     return(AssetOrders(tokenid));
 }
 
+UniValue tokenbook(const UniValue& params, bool fHelp)
+{
+    uint256 tokenid; int32_t side = 0,start = 0,count = 100; std::string sidestr;
+    if ( fHelp || params.size() < 1 || params.size() > 4 )
+        throw runtime_error("tokenbook tokenid [bids|asks|both] [start] [count]\n");
+    if ( ensure_CCrequirements() < 0 )
+        throw runtime_error("to use CC contracts, you need to launch daemon with valid -pubkey= for an address in your wallet\n");
+    tokenid = Parseuint256((char *)params[0].get_str().c_str());
+    if ( params.size() > 1 )
+    {
+        sidestr = params[1].get_str();
+        if ( sidestr == "bids" )
+            side = 1;
+        else if ( sidestr == "asks" )
+            side = -1;
+        else if ( sidestr != "both" )
+            throw runtime_error("side must be bids, asks or both\n");
+    }
+    if ( params.size() > 2 )
+        start = atoi(params[2].get_str().c_str());
+    if ( params.size() > 3 )
+        count = atoi(params[3].get_str().c_str());
+    if ( tokenid == zeroid || start < 0 || count <= 0 || count > 1000 )
+        throw runtime_error("invalid parameter\n");
+    return(AssetBookDepth(tokenid,side,start,count));
+}
+
+UniValue tokenbestprice(const UniValue& params, bool fHelp)
+{
+    uint256 tokenid;
+    if ( fHelp || params.size() != 1 )
+        throw runtime_error("tokenbestprice tokenid\n");
+    if ( ensure_CCrequirements() < 0 )
+        throw runtime_error("to use CC contracts, you need to launch daemon with valid -pubkey= for an address in your wallet\n");
+    tokenid = Parseuint256((char *)params[0].get_str().c_str());
+    return(AssetBestPrice(tokenid));
+}
+
 UniValue tokenbalance(const UniValue& params, bool fHelp)
 {
     UniValue result(UniValue::VOBJ); char destaddr[64]; uint256 tokenid; uint64_t balance; std::vector<unsigned char> pubkey; struct CCcontract_info *cp,C;
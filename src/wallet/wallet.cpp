@@ -24,6 +24,7 @@
 #include <assert.h>
 
 #include <boost/algorithm/string/replace.hpp>
+#include <boost/bind.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/thread.hpp>
 
@@ -44,6 +45,8 @@ bool fPayAtLeastCustomFee = true;
 extern int32_t KOMODO_EXCHANGEWALLET;
 extern char ASSETCHAINS_SYMBOL[KOMODO_ASSETCHAIN_MAXLEN];
 extern std::string DONATION_PUBKEY;
+void komodo_stakingcache_sync(const CTransaction &tx,const CBlock *pblock);
+void komodo_stakingcache_dirty();
 
 /**
  * Fees smaller than this (in satoshi) are considered zero fee (for transaction creation)
@@ -413,6 +416,14 @@ bool CWallet::ChangeWalletPassphrase(const SecureString& strOldWalletPassphrase,
 void CWallet::ChainTip(const CBlockIndex *pindex, const CBlock *pblock,
                        ZCIncrementalMerkleTree tree, bool added)
 {
+    LOCK(cs_wallet);
+    if (fRescanning) {
+        // The rescan connects new blocks itself once it reaches them, and
+        // DecrementNoteWitnesses only rolls back what is already there.
+        if (!added)
+            DecrementNoteWitnesses(pindex);
+        return;
+    }
     if (added) {
         IncrementNoteWitnesses(pindex, pblock, tree);
     } else if ( nWitnessCacheSize > 1 ){ //ASSETCHAINS_SYMBOL[0] == 0 ||
@@ -422,6 +433,10 @@ void CWallet::ChainTip(const CBlockIndex *pindex, const CBlock *pblock,
 
 void CWallet::SetBestChain(const CBlockLocator& loc)
 {
+    LOCK(cs_wallet);
+    // Witnesses only match a single tip again once the rescan has finished
+    if (fRescanning)
+        return;
     CWalletDB walletdb(strWalletFile);
     SetBestChainINTERNAL(walletdb, loc);
 }
@@ -670,8 +685,11 @@ void CWallet::AddToSpends(const uint256& wtxid)
 void CWallet::ClearNoteWitnessCache()
 {
     LOCK(cs_wallet);
-    for (std::pair<const uint256, CWalletTx>& wtxItem : mapWallet) {
-        for (mapNoteData_t::value_type& item : wtxItem.second.mapNoteData) {
+    for (const uint256& hash : setNoteTxs) {
+        std::map<uint256, CWalletTx>::iterator mi = mapWallet.find(hash);
+        if (mi == mapWallet.end())
+            continue;
+        for (mapNoteData_t::value_type& item : mi->second.mapNoteData) {
             item.second.witnesses.clear();
             item.second.witnessHeight = -1;
         }
@@ -680,6 +698,35 @@ void CWallet::ClearNoteWitnessCache()
     //fprintf(stderr,"Clear witness cache\n");
 }
 
+void CWallet::GetNoteDataAtOrBelow(int nHeight, std::vector<CNoteData*>& vNotes)
+{
+    AssertLockHeld(cs_wallet);
+    vNotes.clear();
+    for (const uint256& hash : setNoteTxs) {
+        std::map<uint256, CWalletTx>::iterator mi = mapWallet.find(hash);
+        if (mi == mapWallet.end())
+            continue;
+        for (mapNoteData_t::value_type& item : mi->second.mapNoteData) {
+            if (item.second.witnessHeight <= nHeight)
+                vNotes.push_back(&item.second);
+        }
+    }
+}
+
+/**
+ * Appends vCommitments[start..] to the front witness of each note in vWork.
+ */
+static void AppendNoteCommitments(const std::vector<std::pair<CNoteData*, size_t> >& vWork,
+                                  const std::vector<uint256>& vCommitments,
+                                  size_t nFirst, size_t nStride)
+{
+    for (size_t i = nFirst; i < vWork.size(); i += nStride) {
+        ZCIncrementalWitness& witness = vWork[i].first->witnesses.front();
+        for (size_t k = vWork[i].second; k < vCommitments.size(); k++)
+            witness.append(vCommitments[k]);
+    }
+}
+
 void CWallet::IncrementNoteWitnesses(const CBlockIndex* pindex,
                                      const CBlock* pblockIn,
                                      ZCIncrementalMerkleTree& tree)
@@ -687,29 +734,26 @@ void CWallet::IncrementNoteWitnesses(const CBlockIndex* pindex,
     //fprintf(stderr,"A increment witness cache -> %d\n",(int32_t)nWitnessCacheSize);
     {
         LOCK(cs_wallet);
-        for (std::pair<const uint256, CWalletTx>& wtxItem : mapWallet) {
-            for (mapNoteData_t::value_type& item : wtxItem.second.mapNoteData) {
-                CNoteData* nd = &(item.second);
-                // Only increment witnesses that are behind the current height
-                if (nd->witnessHeight < pindex->nHeight) {
-                    // Check the validity of the cache
-                    // The only time a note witnessed above the current height
-                    // would be invalid here is during a reindex when blocks
-                    // have been decremented, and we are incrementing the blocks
-                    // immediately after.
-                    assert(nWitnessCacheSize >= nd->witnesses.size());
-                    // Witnesses being incremented should always be either -1
-                    // (never incremented or decremented) or one below pindex
-                    assert((nd->witnessHeight == -1) ||
-                           (nd->witnessHeight == pindex->nHeight - 1));
-                    // Copy the witness for the previous block if we have one
-                    if (nd->witnesses.size() > 0) {
-                        nd->witnesses.push_front(nd->witnesses.front());
-                    }
-                    if (nd->witnesses.size() > WITNESS_CACHE_SIZE) {
-                        nd->witnesses.pop_back();
-                    }
-                }
+        // Only increment witnesses that are behind the current height
+        std::vector<CNoteData*> vNotes;
+        GetNoteDataAtOrBelow(pindex->nHeight - 1, vNotes);
+        for (CNoteData* nd : vNotes) {
+            // Check the validity of the cache
+            // The only time a note witnessed above the current height
+            // would be invalid here is during a reindex when blocks
+            // have been decremented, and we are incrementing the blocks
+            // immediately after.
+            assert(nWitnessCacheSize >= nd->witnesses.size());
+            // Witnesses being incremented should always be either -1
+            // (never incremented or decremented) or one below pindex
+            assert((nd->witnessHeight == -1) ||
+                   (nd->witnessHeight == pindex->nHeight - 1));
+            // Copy the witness for the previous block if we have one
+            if (nd->witnesses.size() > 0) {
+                nd->witnesses.push_front(nd->witnesses.front());
+            }
+            if (nd->witnesses.size() > WITNESS_CACHE_SIZE) {
+                nd->witnesses.pop_back();
             }
         }
         if (nWitnessCacheSize < WITNESS_CACHE_SIZE) {
@@ -724,35 +768,27 @@ void CWallet::IncrementNoteWitnesses(const CBlockIndex* pindex,
             pblock = &block;
         }
 
+        // Advance the tree once per block, witnessing our own notes as they
+        // go by and remembering where each new witness starts.
+        std::vector<uint256> vCommitments;
+        std::map<CNoteData*, size_t> mapNewWitnesses;
         for (const CTransaction& tx : pblock->vtx) {
             auto hash = tx.GetHash();
-            bool txIsOurs = mapWallet.count(hash);
+            std::map<uint256, CWalletTx>::iterator mi = mapWallet.find(hash);
             for (size_t i = 0; i < tx.vjoinsplit.size(); i++) {
                 const JSDescription& jsdesc = tx.vjoinsplit[i];
                 for (uint8_t j = 0; j < jsdesc.commitments.size(); j++) {
                     const uint256& note_commitment = jsdesc.commitments[j];
                     tree.append(note_commitment);
-
-                    // Increment existing witnesses
-                    for (std::pair<const uint256, CWalletTx>& wtxItem : mapWallet) {
-                        for (mapNoteData_t::value_type& item : wtxItem.second.mapNoteData) {
-                            CNoteData* nd = &(item.second);
-                            if (nd->witnessHeight < pindex->nHeight &&
-                                    nd->witnesses.size() > 0) {
-                                // Check the validity of the cache
-                                // See earlier comment about validity.
-                                assert(nWitnessCacheSize >= nd->witnesses.size());
-                                nd->witnesses.front().append(note_commitment);
-                            }
-                        }
-                    }
+                    vCommitments.push_back(note_commitment);
 
                     // If this is our note, witness it
-                    if (txIsOurs) {
+                    if (mi != mapWallet.end()) {
                         JSOutPoint jsoutpt {hash, i, j};
-                        if (mapWallet[hash].mapNoteData.count(jsoutpt) &&
-                                mapWallet[hash].mapNoteData[jsoutpt].witnessHeight < pindex->nHeight) {
-                            CNoteData* nd = &(mapWallet[hash].mapNoteData[jsoutpt]);
+                        mapNoteData_t::iterator ni = mi->second.mapNoteData.find(jsoutpt);
+                        if (ni != mi->second.mapNoteData.end() &&
+                                ni->second.witnessHeight < pindex->nHeight) {
+                            CNoteData* nd = &(ni->second);
                             if (nd->witnesses.size() > 0) {
                                 // We think this can happen because we write out the
                                 // witness cache state after every block increment or
@@ -762,10 +798,14 @@ void CWallet::IncrementNoteWitnesses(const CBlockIndex* pindex,
                                 // to be called again on previously-cached blocks. This
                                 // doesn't affect existing cached notes because of the
                                 // CNoteData::witnessHeight checks. See #1378 for details.
+                                ZCIncrementalWitness witness = nd->witnesses.front();
+                                size_t k = mapNewWitnesses.count(nd) ? mapNewWitnesses[nd] : 0;
+                                for (; k < vCommitments.size(); k++)
+                                    witness.append(vCommitments[k]);
                                 LogPrintf("Inconsistent witness cache state found for %s\n- Cache size: %d\n- Top (height %d): %s\n- New (height %d): %s\n",
                                           jsoutpt.ToString(), nd->witnesses.size(),
                                           nd->witnessHeight,
-                                          nd->witnesses.front().root().GetHex(),
+                                          witness.root().GetHex(),
                                           pindex->nHeight,
                                           tree.witness().root().GetHex());
                                 nd->witnesses.clear();
@@ -773,6 +813,7 @@ void CWallet::IncrementNoteWitnesses(const CBlockIndex* pindex,
                             nd->witnesses.push_front(tree.witness());
                             // Set height to one less than pindex so it gets incremented
                             nd->witnessHeight = pindex->nHeight - 1;
+                            mapNewWitnesses[nd] = vCommitments.size();
                             // Check the validity of the cache
                             assert(nWitnessCacheSize >= nd->witnesses.size());
                         }
@@ -781,16 +822,41 @@ void CWallet::IncrementNoteWitnesses(const CBlockIndex* pindex,
             }
         }
 
+        // Increment existing witnesses with the block's commitments, each
+        // starting after the commitment it was created from.
+        std::vector<std::pair<CNoteData*, size_t> > vWork;
+        for (CNoteData* nd : vNotes) {
+            if (nd->witnesses.size() > 0 && !mapNewWitnesses.count(nd)) {
+                // Check the validity of the cache
+                // See earlier comment about validity.
+                assert(nWitnessCacheSize >= nd->witnesses.size());
+                vWork.push_back(std::make_pair(nd, (size_t)0));
+            }
+        }
+        for (const std::pair<CNoteData* const, size_t>& item : mapNewWitnesses) {
+            if (item.second < vCommitments.size())
+                vWork.push_back(item);
+        }
+        size_t nAppends = vWork.size() * vCommitments.size();
+        size_t nThreads = std::min((size_t)std::max(boost::thread::hardware_concurrency(), 1U), (size_t)MAX_WITNESS_THREADS);
+        nThreads = std::min(nThreads, vWork.size());
+        if (nAppends >= WITNESS_PARALLEL_THRESHOLD && nThreads > 1) {
+            boost::thread_group threadGroup;
+            for (size_t t = 1; t < nThreads; t++)
+                threadGroup.create_thread(boost::bind(&AppendNoteCommitments, boost::cref(vWork), boost::cref(vCommitments), t, nThreads));
+            AppendNoteCommitments(vWork, vCommitments, 0, nThreads);
+            threadGroup.join_all();
+        } else {
+            AppendNoteCommitments(vWork, vCommitments, 0, 1);
+        }
+
         // Update witness heights
-        for (std::pair<const uint256, CWalletTx>& wtxItem : mapWallet) {
-            for (mapNoteData_t::value_type& item : wtxItem.second.mapNoteData) {
-                CNoteData* nd = &(item.second);
-                if (nd->witnessHeight < pindex->nHeight) {
-                    nd->witnessHeight = pindex->nHeight;
-                    // Check the validity of the cache
-                    // See earlier comment about validity.
-                    assert(nWitnessCacheSize >= nd->witnesses.size());
-                }
+        for (CNoteData* nd : vNotes) {
+            if (nd->witnessHeight < pindex->nHeight) {
+                nd->witnessHeight = pindex->nHeight;
+                // Check the validity of the cache
+                // See earlier comment about validity.
+                assert(nWitnessCacheSize >= nd->witnesses.size());
             }
         }
 
@@ -805,52 +871,58 @@ void CWallet::DecrementNoteWitnesses(const CBlockIndex* pindex)
     extern int32_t KOMODO_REWIND;
     {
         LOCK(cs_wallet);
-        for (std::pair<const uint256, CWalletTx>& wtxItem : mapWallet) {
-            for (mapNoteData_t::value_type& item : wtxItem.second.mapNoteData) {
-                CNoteData* nd = &(item.second);
-                // Only increment witnesses that are not above the current height
-                if (nd->witnessHeight <= pindex->nHeight) {
-                    // Check the validity of the cache
-                    // See comment below (this would be invalid if there was a
-                    // prior decrement).
-                    assert(nWitnessCacheSize >= nd->witnesses.size());
-                    // Witnesses being decremented should always be either -1
-                    // (never incremented or decremented) or equal to pindex
-                    assert((nd->witnessHeight == -1) ||
-                           (nd->witnessHeight == pindex->nHeight));
-                    if (nd->witnesses.size() > 0) {
-                        nd->witnesses.pop_front();
-                    }
-                    // pindex is the block being removed, so the new witness cache
-                    // height is one below it.
-                    nd->witnessHeight = pindex->nHeight - 1;
-                }
+        // Only decrement witnesses that are not above the current height
+        std::vector<CNoteData*> vNotes;
+        GetNoteDataAtOrBelow(pindex->nHeight, vNotes);
+        if (fRescanning) {
+            // Notes the rescan hasn't brought up to pindex yet are left for
+            // it to continue on the new chain.
+            std::vector<CNoteData*> vAtHeight;
+            for (CNoteData* nd : vNotes) {
+                if (nd->witnessHeight == pindex->nHeight)
+                    vAtHeight.push_back(nd);
+            }
+            vNotes.swap(vAtHeight);
+            if (pindexRescanned == pindex)
+                pindexRescanned = pindex->pprev;
+        }
+        for (CNoteData* nd : vNotes) {
+            // Check the validity of the cache
+            // See comment below (this would be invalid if there was a
+            // prior decrement).
+            assert(nWitnessCacheSize >= nd->witnesses.size());
+            // Witnesses being decremented should always be either -1
+            // (never incremented or decremented) or equal to pindex
+            assert((nd->witnessHeight == -1) ||
+                   (nd->witnessHeight == pindex->nHeight));
+            if (nd->witnesses.size() > 0) {
+                nd->witnesses.pop_front();
             }
+            // pindex is the block being removed, so the new witness cache
+            // height is one below it.
+            nd->witnessHeight = pindex->nHeight - 1;
         }
         //fprintf(stderr,"decrement witness cache -> %d\n",(int32_t)nWitnessCacheSize);
-        if ( nWitnessCacheSize > 1 )
+        if ( fRescanning )
+            ; // the rescan is still growing the cache for the notes below pindex
+        else if ( nWitnessCacheSize > 1 )
             nWitnessCacheSize -= 1;
         else
         {
             fprintf(stderr,"%s nWitnessCacheSize.%d\n",ASSETCHAINS_SYMBOL,(int32_t)nWitnessCacheSize);
         }
-        for (std::pair<const uint256, CWalletTx>& wtxItem : mapWallet) {
-            for (mapNoteData_t::value_type& item : wtxItem.second.mapNoteData) {
-                CNoteData* nd = &(item.second);
-                // Check the validity of the cache
-                // Technically if there are notes witnessed above the current
-                // height, their cache will now be invalid (relative to the new
-                // value of nWitnessCacheSize). However, this would only occur
-                // during a reindex, and by the time the reindex reaches the tip
-                // of the chain again, the existing witness caches will be valid
-                // again.
-                // We don't set nWitnessCacheSize to zero at the start of the
-                // reindex because the on-disk blocks had already resulted in a
-                // chain that didn't trigger the assertion below.
-                if (nd->witnessHeight < pindex->nHeight) {
-                    assert(nWitnessCacheSize >= nd->witnesses.size());
-                }
-            }
+        for (CNoteData* nd : vNotes) {
+            // Check the validity of the cache
+            // Technically if there are notes witnessed above the current
+            // height, their cache will now be invalid (relative to the new
+            // value of nWitnessCacheSize). However, this would only occur
+            // during a reindex, and by the time the reindex reaches the tip
+            // of the chain again, the existing witness caches will be valid
+            // again.
+            // We don't set nWitnessCacheSize to zero at the start of the
+            // reindex because the on-disk blocks had already resulted in a
+            // chain that didn't trigger the assertion below.
+            assert(nWitnessCacheSize >= nd->witnesses.size());
         }
         if ( KOMODO_REWIND == 0 )
             assert(nWitnessCacheSize > 0);
@@ -1060,6 +1132,8 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletD
         mapWallet[hash] = wtxIn;
         mapWallet[hash].BindWallet(this);
         UpdateNullifierNoteMapWithTx(mapWallet[hash]);
+        if (!mapWallet[hash].mapNoteData.empty())
+            setNoteTxs.insert(hash);
         AddToSpends(hash);
     }
     else
@@ -1149,6 +1223,9 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletD
             }
         }
 
+        if (!wtx.mapNoteData.empty())
+            setNoteTxs.insert(hash);
+
         //// debug print
         LogPrintf("AddToWallet %s  %s%s\n", wtxIn.GetHash().ToString(), (fInsertedNew ? "new" : ""), (fUpdated ? "update" : ""));
 
@@ -1199,14 +1276,15 @@ bool CWallet::UpdatedNoteData(const CWalletTx& wtxIn, CWalletTx& wtx)
  * Add a transaction to the wallet, or update it.
  * pblock is optional, but should be provided if the transaction is known to be in a block.
  * If fUpdate is true, existing transactions will be updated.
+ * pnoteData is optional, and holds the result of FindMyNotes(tx) if the caller has it.
  */
-bool CWallet::AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate)
+bool CWallet::AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate, const mapNoteData_t* pnoteData)
 {
     {
         AssertLockHeld(cs_wallet);
         bool fExisted = mapWallet.count(tx.GetHash()) != 0;
         if (fExisted && !fUpdate) return false;
-        auto noteData = FindMyNotes(tx);
+        mapNoteData_t noteData = pnoteData ? *pnoteData : FindMyNotes(tx);
         if (fExisted || IsMine(tx) || IsFromMe(tx) || noteData.size() > 0)
         {
             CWalletTx wtx(this,tx);
@@ -1236,6 +1314,7 @@ void CWallet::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
         return; // Not one of ours
 
     MarkAffectedTransactionsDirty(tx);
+    komodo_stakingcache_sync(tx, pblock);
 }
 
 void CWallet::MarkAffectedTransactionsDirty(const CTransaction& tx)
@@ -1266,6 +1345,8 @@ void CWallet::EraseFromWallet(const uint256 &hash)
         LOCK(cs_wallet);
         if (mapWallet.erase(hash))
             CWalletDB(strWalletFile).EraseTx(hash);
+        setNoteTxs.erase(hash);
+        komodo_stakingcache_dirty();
     }
     return;
 }
@@ -1308,42 +1389,113 @@ boost::optional<uint256> CWallet::GetNoteNullifier(const JSDescription& jsdesc,
  * already have been cached in CWalletTx.mapNoteData.
  */
 mapNoteData_t CWallet::FindMyNotes(const CTransaction& tx) const
+{
+    std::vector<const CTransaction*> vtx(1, &tx);
+    std::vector<mapNoteData_t> vNoteData;
+    FindMyNotes(vtx, vNoteData);
+    return vNoteData[0];
+}
+
+namespace {
+
+/** One JoinSplit ciphertext to try against every note decryptor. */
+struct CNoteDecryptionJob
+{
+    size_t nTx;
+    size_t js;
+    uint8_t n;
+    uint256 hSig;
+    const NoteDecryptorMap::value_type* pmatch;
+};
+
+void TrialDecryptNotes(std::vector<CNoteDecryptionJob>& vJobs,
+                       const std::vector<const CTransaction*>& vtx,
+                       const NoteDecryptorMap& decryptors,
+                       size_t nFirst, size_t nStride)
+{
+    for (size_t i = nFirst; i < vJobs.size(); i += nStride) {
+        CNoteDecryptionJob& job = vJobs[i];
+        const JSDescription& jsdesc = vtx[job.nTx]->vjoinsplit[job.js];
+        for (const NoteDecryptorMap::value_type& item : decryptors) {
+            if (item.second.check(jsdesc.ciphertexts[job.n], jsdesc.ephemeralKey, job.hSig, job.n)) {
+                job.pmatch = &item;
+                break;
+            }
+        }
+    }
+}
+
+}
+
+/**
+ * Batch form of FindMyNotes: vNoteData[i] receives the notes of vtx[i].
+ * Every ciphertext is first checked against every decryptor, which only
+ * verifies the authentication tag, spread over nThreads threads (0 picks
+ * one per core). Only the matches are decrypted to build the note data.
+ */
+void CWallet::FindMyNotes(const std::vector<const CTransaction*>& vtx,
+                          std::vector<mapNoteData_t>& vNoteData,
+                          int nThreads) const
 {
     LOCK(cs_SpendingKeyStore);
-    uint256 hash = tx.GetHash();
-
-    mapNoteData_t noteData;
-    for (size_t i = 0; i < tx.vjoinsplit.size(); i++) {
-        auto hSig = tx.vjoinsplit[i].h_sig(*pzcashParams, tx.joinSplitPubKey);
-        for (uint8_t j = 0; j < tx.vjoinsplit[i].ciphertexts.size(); j++) {
-            for (const NoteDecryptorMap::value_type& item : mapNoteDecryptors) {
-                try {
-                    auto address = item.first;
-                    JSOutPoint jsoutpt {hash, i, j};
-                    auto nullifier = GetNoteNullifier(
-                        tx.vjoinsplit[i],
-                        address,
-                        item.second,
-                        hSig, j);
-                    if (nullifier) {
-                        CNoteData nd {address, *nullifier};
-                        noteData.insert(std::make_pair(jsoutpt, nd));
-                    } else {
-                        CNoteData nd {address};
-                        noteData.insert(std::make_pair(jsoutpt, nd));
-                    }
-                    break;
-                } catch (const note_decryption_failed &err) {
-                    // Couldn't decrypt with this decryptor
-                } catch (const std::exception &exc) {
-                    // Unexpected failure
-                    LogPrintf("FindMyNotes(): Unexpected error while testing decrypt:\n");
-                    LogPrintf("%s\n", exc.what());
+    vNoteData.assign(vtx.size(), mapNoteData_t());
+
+    std::vector<CNoteDecryptionJob> vJobs;
+    if (!mapNoteDecryptors.empty()) {
+        for (size_t t = 0; t < vtx.size(); t++) {
+            const CTransaction& tx = *vtx[t];
+            for (size_t i = 0; i < tx.vjoinsplit.size(); i++) {
+                auto hSig = tx.vjoinsplit[i].h_sig(*pzcashParams, tx.joinSplitPubKey);
+                for (uint8_t j = 0; j < tx.vjoinsplit[i].ciphertexts.size(); j++) {
+                    CNoteDecryptionJob job {t, i, j, hSig, NULL};
+                    vJobs.push_back(job);
                 }
             }
         }
     }
-    return noteData;
+    if (vJobs.empty())
+        return;
+
+    if (nThreads <= 0)
+        nThreads = std::max(boost::thread::hardware_concurrency(), 1U);
+    size_t nWorkers = std::min(std::min((size_t)nThreads, (size_t)MAX_NOTE_DECRYPT_THREADS), vJobs.size());
+    if (vJobs.size() * mapNoteDecryptors.size() >= NOTE_DECRYPT_PARALLEL_THRESHOLD && nWorkers > 1) {
+        boost::thread_group threadGroup;
+        for (size_t w = 1; w < nWorkers; w++)
+            threadGroup.create_thread(boost::bind(&TrialDecryptNotes, boost::ref(vJobs), boost::cref(vtx), boost::cref(mapNoteDecryptors), w, nWorkers));
+        TrialDecryptNotes(vJobs, vtx, mapNoteDecryptors, 0, nWorkers);
+        threadGroup.join_all();
+    } else {
+        TrialDecryptNotes(vJobs, vtx, mapNoteDecryptors, 0, 1);
+    }
+
+    for (const CNoteDecryptionJob& job : vJobs) {
+        if (!job.pmatch)
+            continue;
+        const CTransaction& tx = *vtx[job.nTx];
+        try {
+            auto address = job.pmatch->first;
+            JSOutPoint jsoutpt {tx.GetHash(), job.js, job.n};
+            auto nullifier = GetNoteNullifier(
+                tx.vjoinsplit[job.js],
+                address,
+                job.pmatch->second,
+                job.hSig, job.n);
+            if (nullifier) {
+                CNoteData nd {address, *nullifier};
+                vNoteData[job.nTx].insert(std::make_pair(jsoutpt, nd));
+            } else {
+                CNoteData nd {address};
+                vNoteData[job.nTx].insert(std::make_pair(jsoutpt, nd));
+            }
+        } catch (const note_decryption_failed &err) {
+            // Couldn't decrypt with this decryptor
+        } catch (const std::exception &exc) {
+            // Unexpected failure
+            LogPrintf("FindMyNotes(): Unexpected error while testing decrypt:\n");
+            LogPrintf("%s\n", exc.what());
+        }
+    }
 }
 
 bool CWallet::IsFromMe(const uint256& nullifier) const
@@ -1797,18 +1949,111 @@ void CWallet::WitnessNoteCommitment(std::vector<uint256> commitments,
     }
 }
 
+/**
+ * Collects up to RESCAN_BATCH_SIZE blocks of the active chain from pindex on.
+ */
+//! Serializes rescans, which release cs_main and cs_wallet between batches
+static CCriticalSection cs_rescan;
+
+static void GetRescanBatch(CBlockIndex* pindex, std::vector<CRescanBlock>& vBatch)
+{
+    AssertLockHeld(cs_main);
+    std::vector<CBlockIndex*> vIndex;
+    for (; pindex && vIndex.size() < RESCAN_BATCH_SIZE; pindex = chainActive.Next(pindex))
+        vIndex.push_back(pindex);
+    vBatch.clear();
+    vBatch.resize(vIndex.size());
+    for (size_t i = 0; i < vIndex.size(); i++) {
+        vBatch[i].pindex = vIndex[i];
+        vBatch[i].pos = vIndex[i]->GetBlockPos();
+        vBatch[i].fRead = false;
+    }
+}
+
+/**
+ * Reads the blocks of a rescan batch and matches their transactions against
+ * our scripts and note decryptors. Needs neither cs_main nor cs_wallet.
+ */
+static void ReadRescanBlocks(const CWallet* pwallet, std::vector<CRescanBlock>& vBatch,
+                             size_t nFirst, size_t nStride)
+{
+    for (size_t i = nFirst; i < vBatch.size(); i += nStride) {
+        CRescanBlock& rb = vBatch[i];
+        rb.fRead = ReadBlockFromDisk(rb.pindex->nHeight, rb.block, rb.pos, 0) &&
+                   rb.block.GetHash() == rb.pindex->GetBlockHash();
+        if (!rb.fRead)
+            continue;
+        std::vector<const CTransaction*> vtx;
+        rb.vIsMine.resize(rb.block.vtx.size());
+        for (size_t j = 0; j < rb.block.vtx.size(); j++) {
+            vtx.push_back(&rb.block.vtx[j]);
+            rb.vIsMine[j] = pwallet->IsMine(rb.block.vtx[j]);
+        }
+        pwallet->FindMyNotes(vtx, rb.vNoteData, 1);
+    }
+}
+
+static void StartReadRescanBlocks(const CWallet* pwallet, std::vector<CRescanBlock>& vBatch,
+                                  boost::thread_group& threadGroup, size_t nThreads)
+{
+    for (size_t t = 0; t < nThreads; t++)
+        threadGroup.create_thread(boost::bind(&ReadRescanBlocks, pwallet, boost::ref(vBatch), t, nThreads));
+}
+
+void CWallet::CommitRescanBatch(std::vector<CRescanBlock>& vBatch, bool fUpdate, int& nAdded)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+    for (CRescanBlock& rb : vBatch) {
+        // After a reorg the rest of the batch is no longer on our path
+        if (rb.pindex->pprev != pindexRescanned || !chainActive.Contains(rb.pindex))
+            break;
+        if (!rb.fRead) {
+            // Let AddToWalletIfInvolvingMe match every transaction itself
+            ReadBlockFromDisk(rb.block, rb.pindex, 1);
+            rb.vIsMine.assign(rb.block.vtx.size(), true);
+            rb.vNoteData.clear();
+        }
+        for (size_t i = 0; i < rb.block.vtx.size(); i++) {
+            const CTransaction& tx = rb.block.vtx[i];
+            const mapNoteData_t* pnoteData = rb.vNoteData.empty() ? NULL : &rb.vNoteData[i];
+            // IsFromMe depends on what earlier blocks added, so only it is left to check here
+            if (!rb.vIsMine[i] && pnoteData && pnoteData->empty() &&
+                    !mapWallet.count(tx.GetHash()) && !IsFromMe(tx))
+                continue;
+            if (AddToWalletIfInvolvingMe(tx, &rb.block, fUpdate, pnoteData))
+                nAdded++;
+        }
+
+        ZCIncrementalMerkleTree tree;
+        // This should never fail: we should always be able to get the tree
+        // state on the path to the tip of our chain
+        assert(pcoinsTip->GetAnchorAt(rb.pindex->hashAnchor, tree));
+        // Increment note witness caches
+        IncrementNoteWitnesses(rb.pindex, &rb.block, tree);
+        pindexRescanned = rb.pindex;
+    }
+}
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
  * exist in the wallet will be updated.
+ *
+ * Blocks are read and matched in batches on worker threads without holding
+ * cs_main or cs_wallet, which are only taken to commit each batch in order.
  */
 int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
 {
+    LOCK(cs_rescan);
     int ret = 0;
     int64_t nNow = GetTime();
     const CChainParams& chainParams = Params();
+    size_t nThreads = std::max(1, std::min(GetNumCores(), (int)MAX_RESCAN_THREADS));
 
     CBlockIndex* pindex = pindexStart;
+    double dProgressStart;
+    std::vector<CRescanBlock> vBatch, vNext;
     {
         LOCK2(cs_main, cs_wallet);
 
@@ -1818,36 +2063,75 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
             pindex = chainActive.Next(pindex);
 
         ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
-        double dProgressStart = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex, false);
-        double dProgressTip = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), chainActive.LastTip(), false);
-        while (pindex)
+        if (pindex == NULL) {
+            ShowProgress(_("Rescanning..."), 100);
+            return ret;
+        }
+        dProgressStart = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex, false);
+        fRescanning = true;
+        pindexRescanned = pindex->pprev;
+        nRescanStartHeight = pindex->nHeight;
+        nRescanStartTime = GetTime();
+        dRescanProgress = 0.0;
+        GetRescanBatch(pindex, vBatch);
+    }
+    {
+        boost::thread_group threadGroup;
+        StartReadRescanBlocks(this, vBatch, threadGroup, nThreads);
+        threadGroup.join_all();
+    }
+
+    while (true)
+    {
+        // Read the following batch while this one is committed
+        boost::thread_group threadGroup;
         {
-            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
-                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+            LOCK(cs_main);
+            GetRescanBatch(vBatch.empty() ? NULL : chainActive.Next(vBatch.back().pindex), vNext);
+        }
+        StartReadRescanBlocks(this, vNext, threadGroup, nThreads);
 
-            CBlock block;
-            ReadBlockFromDisk(block, pindex,1);
-            BOOST_FOREACH(CTransaction& tx, block.vtx)
-            {
-                if (AddToWalletIfInvolvingMe(tx, &block, fUpdate))
-                    ret++;
+        CBlockIndex* pindexNext;
+        {
+            LOCK2(cs_main, cs_wallet);
+            CommitRescanBatch(vBatch, fUpdate, ret);
+            pindexNext = pindexRescanned ? chainActive.Next(pindexRescanned) : chainActive.Genesis();
+            if (pindexNext == NULL) {
+                fRescanning = false;
+                pindexRescanned = NULL;
+            } else {
+                double dProgressTip = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), chainActive.LastTip(), false);
+                double dProgress = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindexNext, false);
+                if (dProgressTip - dProgressStart > 0.0)
+                    dRescanProgress = std::max(0.0, std::min(1.0, (dProgress - dProgressStart) / (dProgressTip - dProgressStart)));
+                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)(dRescanProgress * 100))));
+                if (GetTime() >= nNow + 60) {
+                    nNow = GetTime();
+                    LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindexNext->nHeight, dProgress);
+                }
             }
+        }
+        threadGroup.join_all();
+        if (pindexNext == NULL)
+            break;
 
-            ZCIncrementalMerkleTree tree;
-            // This should never fail: we should always be able to get the tree
-            // state on the path to the tip of our chain
-            assert(pcoinsTip->GetAnchorAt(pindex->hashAnchor, tree));
-            // Increment note witness caches
-            IncrementNoteWitnesses(pindex, &block, tree);
-
-            pindex = chainActive.Next(pindex);
-            if (GetTime() >= nNow + 60) {
-                nNow = GetTime();
-                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex));
+        if (vNext.empty() || vNext[0].pindex != pindexNext) {
+            // A reorg cut this batch short: start again from where the rescan stands
+            {
+                LOCK2(cs_main, cs_wallet);
+                GetRescanBatch(pindexRescanned ? chainActive.Next(pindexRescanned) : chainActive.Genesis(), vNext);
             }
+            boost::thread_group threadGroupRetry;
+            StartReadRescanBlocks(this, vNext, threadGroupRetry, nThreads);
+            threadGroupRetry.join_all();
         }
-        ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
+        vBatch.swap(vNext);
+    }
+    {
+        LOCK(cs_wallet);
+        komodo_stakingcache_dirty();
     }
+    ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
     return ret;
 }
 
@@ -60,6 +60,18 @@ static const unsigned int MAX_FREE_TRANSACTION_CREATE_SIZE = 1000;
 //  unless there is some exceptional network disruption.
 #define _COINBASE_MATURITY 100
 static const unsigned int WITNESS_CACHE_SIZE = _COINBASE_MATURITY+10;
+//! Witness appends per block above which they are spread over several threads
+static const unsigned int WITNESS_PARALLEL_THRESHOLD = 1024;
+//! Maximum number of threads used to append commitments to note witnesses
+static const unsigned int MAX_WITNESS_THREADS = 8;
+//! Ciphertext trial decryptions per batch above which they are spread over several threads
+static const unsigned int NOTE_DECRYPT_PARALLEL_THRESHOLD = 64;
+//! Maximum number of threads used to trial-decrypt notes
+static const unsigned int MAX_NOTE_DECRYPT_THREADS = 16;
+//! Number of blocks a rescan reads and matches between taking the locks
+static const unsigned int RESCAN_BATCH_SIZE = 64;
+//! Maximum number of threads a rescan uses to read and match blocks
+static const unsigned int MAX_RESCAN_THREADS = 8;
 
 class CBlockIndex;
 class CCoinControl;
@@ -661,6 +673,19 @@ private:
  * A CWallet is an extension of a keystore, which also maintains a set of transactions and balances,
  * and provides the ability to create new transactions.
  */
+/** A block that a rescan reads and matches ahead of committing it */
+struct CRescanBlock
+{
+    CBlockIndex* pindex;
+    CDiskBlockPos pos;
+    CBlock block;
+    bool fRead;
+    //! Per transaction: whether it pays to one of our scripts
+    std::vector<bool> vIsMine;
+    //! Per transaction: the notes FindMyNotes found in it
+    std::vector<mapNoteData_t> vNoteData;
+};
+
 class CWallet : public CCryptoKeyStore, public CValidationInterface
 {
 private:
@@ -706,9 +731,31 @@ public:
      */
     int64_t nWitnessCacheSize;
 
+    /*
+     * State of the ScanForWalletTransactions in progress, if any, reported
+     * by getwalletinfo. pindexRescanned is the last block the rescan has
+     * committed. While fRescanning is set ChainTip leaves newly connected
+     * blocks to the rescan, which reaches them in order.
+     */
+    bool fRescanning;
+    const CBlockIndex* pindexRescanned;
+    int nRescanStartHeight;
+    int64_t nRescanStartTime;
+    double dRescanProgress;
+
     void ClearNoteWitnessCache();
 
 protected:
+    /*
+     * Hashes of the transactions in mapWallet that carry note data, so that
+     * the witness cache can be updated without walking the whole wallet.
+     */
+    std::set<uint256> setNoteTxs;
+
+    /**
+     * Collects the note data entries witnessed at or below nHeight.
+     */
+    void GetNoteDataAtOrBelow(int nHeight, std::vector<CNoteData*>& vNotes);
     /**
      * pindex is the new tip being connected.
      */
@@ -719,6 +766,10 @@ protected:
      * pindex is the old tip being disconnected.
      */
     void DecrementNoteWitnesses(const CBlockIndex* pindex);
+    /**
+     * Commits prefetched rescan blocks that extend pindexRescanned, in order.
+     */
+    void CommitRescanBatch(std::vector<CRescanBlock>& vBatch, bool fUpdate, int& nAdded);
 
     template <typename WalletDB>
     void SetBestChainINTERNAL(WalletDB& walletdb, const CBlockLocator& loc) {
@@ -820,6 +871,11 @@ public:
         nTimeFirstKey = 0;
         fBroadcastTransactions = false;
         nWitnessCacheSize = 0;
+        fRescanning = false;
+        pindexRescanned = NULL;
+        nRescanStartHeight = 0;
+        nRescanStartTime = 0;
+        dRescanProgress = 0.0;
     }
 
     /**
@@ -997,7 +1053,7 @@ public:
     bool AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletDB* pwalletdb);
     void EraseFromWallet(const uint256 &hash);
     void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
-    bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate);
+    bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate, const mapNoteData_t* pnoteData = NULL);
     void WitnessNoteCommitment(
          std::vector<uint256> commitments,
          std::vector<boost::optional<ZCIncrementalWitness>>& witnesses,
@@ -1041,6 +1097,9 @@ public:
         const uint256& hSig,
         uint8_t n) const;
     mapNoteData_t FindMyNotes(const CTransaction& tx) const;
+    void FindMyNotes(const std::vector<const CTransaction*>& vtx,
+                     std::vector<mapNoteData_t>& vNoteData,
+                     int nThreads = 0) const;
     bool IsFromMe(const uint256& nullifier) const;
     void GetNoteWitnesses(
          std::vector<JSOutPoint> notes,
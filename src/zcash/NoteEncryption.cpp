@@ -135,6 +135,36 @@ typename NoteDecryption<MLEN>::Plaintext NoteDecryption<MLEN>::decrypt
     return plaintext;
 }
 
+template<size_t MLEN>
+bool NoteDecryption<MLEN>::check(const NoteDecryption<MLEN>::Ciphertext &ciphertext,
+                                 const uint256 &epk,
+                                 const uint256 &hSig,
+                                 unsigned char nonce
+                                ) const
+{
+    uint256 dhsecret;
+
+    if (crypto_scalarmult(dhsecret.begin(), sk_enc.begin(), epk.begin()) != 0) {
+        return false;
+    }
+
+    unsigned char K[NOTEENCRYPTION_CIPHER_KEYSIZE];
+    KDF(K, dhsecret, epk, pk_enc, hSig, nonce);
+
+    // The nonce is zero because we never reuse keys
+    unsigned char cipher_nonce[crypto_aead_chacha20poly1305_IETF_NPUBBYTES] = {};
+
+    // With no message buffer only the tag that follows the MLEN bytes of
+    // ciphertext is verified.
+    return crypto_aead_chacha20poly1305_ietf_decrypt_detached(NULL,
+                                             NULL,
+                                             ciphertext.begin(), MLEN,
+                                             ciphertext.begin() + MLEN,
+                                             NULL,
+                                             0,
+                                             cipher_nonce, K) == 0;
+}
+
 //
 // Payment disclosure - decrypt with esk
 //
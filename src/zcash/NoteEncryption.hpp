@@ -75,6 +75,15 @@ public:
                       unsigned char nonce
                      ) const;
 
+    // Returns true if `ciphertext` authenticates under this key. Only the
+    // tag is checked, so this is a cheap and non-throwing way to reject
+    // ciphertexts that were not sent to us before calling decrypt().
+    bool check(const Ciphertext &ciphertext,
+               const uint256 &epk,
+               const uint256 &hSig,
+               unsigned char nonce
+              ) const;
+
     friend inline bool operator==(const NoteDecryption& a, const NoteDecryption& b) {
         return a.sk_enc == b.sk_enc && a.pk_enc == b.pk_enc;
     }
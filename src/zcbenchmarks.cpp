@@ -13,6 +13,7 @@
 #include "crypto/equihash.h"
 #include "chain.h"
 #include "chainparams.h"
+#include "checkqueue.h"
 #include "consensus/upgrades.h"
 #include "consensus/validation.h"
 #include "main.h"
@@ -27,6 +28,7 @@
 #include "wallet/wallet.h"
 
 #include "zcbenchmarks.h"
+#include "komodo_defs.h"
 
 #include "zcash/Zcash.h"
 #include "zcash/IncrementalMerkleTree.hpp"
@@ -161,6 +163,221 @@ double benchmark_verify_joinsplit(const JSDescription &joinsplit)
     return timer_stop(tv_start);
 }
 
+// Verify the proofs of a block holding nJoinSplits copies of joinsplit through
+// the CheckBlock check queue, once for every thread count from 1 to nMaxThreads
+std::vector<double> benchmark_verify_joinsplit_block(const JSDescription &joinsplit, size_t nJoinSplits, int nMaxThreads)
+{
+    std::vector<double> ret;
+    CMutableTransaction mtx;
+    mtx.nVersion = 2;
+    mtx.vjoinsplit.assign(nJoinSplits, joinsplit);
+    CTransaction tx(mtx);
+    auto verifier = libzcash::ProofVerifier::Strict();
+
+    for (int nThreads = 1; nThreads <= nMaxThreads; nThreads++) {
+        CCheckQueue<CJoinSplitCheck> queue(1);
+        std::vector<std::thread> threads;
+        for (int i = 0; i < nThreads-1; i++) {
+            threads.emplace_back(&CCheckQueue<CJoinSplitCheck>::Thread, &queue);
+        }
+        struct timeval tv_start;
+        timer_start(tv_start);
+        {
+            CCheckQueueControl<CJoinSplitCheck> control(&queue);
+            std::vector<CJoinSplitCheck> vChecks;
+            for (unsigned int i = 0; i < tx.vjoinsplit.size(); i++) {
+                vChecks.push_back(CJoinSplitCheck(tx, i, verifier));
+            }
+            control.Add(vChecks);
+            control.Wait();
+        }
+        ret.push_back(timer_stop(tv_start));
+        queue.Quit();
+        for (auto it = threads.begin(); it != threads.end(); it++) {
+            it->join();
+        }
+    }
+    return ret;
+}
+
+// Record the last nHeaders headers of the active chain as a stream of headers
+// messages, then replay it once for every thread count from 1 to nMaxThreads,
+// checking the Equihash solutions through a check queue as ProcessMessage does
+std::vector<double> benchmark_verify_headers(int nHeaders, int nMaxThreads)
+{
+    std::vector<double> ret;
+    std::vector<CBlockHeader> vRecorded;
+    {
+        LOCK(cs_main);
+        for (CBlockIndex *pindex = chainActive.Tip(); pindex != NULL && (int)vRecorded.size() < nHeaders; pindex = pindex->pprev)
+            vRecorded.push_back(pindex->GetBlockHeader());
+    }
+    std::reverse(vRecorded.begin(), vRecorded.end());
+
+    CDataStream ssStream(SER_NETWORK, PROTOCOL_VERSION);
+    for (size_t nStart = 0; nStart < vRecorded.size(); nStart += MAX_HEADERS_RESULTS) {
+        size_t nCount = std::min(vRecorded.size() - nStart, (size_t)MAX_HEADERS_RESULTS);
+        WriteCompactSize(ssStream, nCount);
+        for (size_t i = nStart; i < nStart + nCount; i++) {
+            ssStream << vRecorded[i];
+            WriteCompactSize(ssStream, 0);
+        }
+    }
+
+    for (int nThreads = 1; nThreads <= nMaxThreads; nThreads++) {
+        CCheckQueue<CEquihashCheck> queue(4);
+        std::vector<std::thread> threads;
+        for (int i = 0; i < nThreads-1; i++) {
+            threads.emplace_back(&CCheckQueue<CEquihashCheck>::Thread, &queue);
+        }
+        CDataStream ss(ssStream);
+        bool fValid = true;
+        struct timeval tv_start;
+        timer_start(tv_start);
+        while (fValid && !ss.empty()) {
+            std::vector<CBlockHeader> headers(ReadCompactSize(ss));
+            for (size_t i = 0; i < headers.size(); i++) {
+                ss >> headers[i];
+                ReadCompactSize(ss);
+            }
+            CCheckQueueControl<CEquihashCheck> control(&queue);
+            std::vector<CEquihashCheck> vChecks;
+            for (size_t i = 0; i < headers.size(); i++) {
+                vChecks.push_back(CEquihashCheck(headers[i]));
+            }
+            control.Add(vChecks);
+            fValid = control.Wait();
+        }
+        ret.push_back(timer_stop(tv_start));
+        queue.Quit();
+        for (auto it = threads.begin(); it != threads.end(); it++) {
+            it->join();
+        }
+        if (!fValid)
+            throw JSONRPCError(RPC_VERIFY_ERROR, "Recorded header failed verification");
+    }
+    return ret;
+}
+
+extern int32_t KOMODO_CONNECTING;
+bool myGetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock);
+
+// Re-run the crypto-condition input scripts of the block at nHeight through a
+// script check queue, once for every thread count from 1 to nMaxThreads
+std::vector<double> benchmark_verify_ccblock(int nHeight, int nMaxThreads)
+{
+    std::vector<double> ret;
+    CBlock block;
+    CBlockIndex *pindex = chainActive[nHeight];
+    if (pindex == NULL || !ReadBlockFromDisk(block, pindex, false))
+        throw new std::runtime_error("Failed to read block");
+
+    // The spent outputs are gone from the UTXO set, so rebuild them from their transactions
+    auto consensusBranchId = CurrentEpochBranchId(nHeight, Params().GetConsensus());
+    std::vector<PrecomputedTransactionData> txdata;
+    txdata.reserve(block.vtx.size());
+    std::vector<std::pair<unsigned int, unsigned int> > vInputs;
+    std::map<uint256, CCoins> mapPrevCoins;
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction &tx = block.vtx[i];
+        txdata.emplace_back(tx);
+        if (tx.IsCoinBase())
+            continue;
+        for (unsigned int j = 0; j < tx.vin.size(); j++) {
+            const COutPoint &prevout = tx.vin[j].prevout;
+            if (mapPrevCoins.count(prevout.hash) == 0) {
+                CTransaction prevTx; uint256 hashBlock;
+                if (!myGetTransaction(prevout.hash, prevTx, hashBlock))
+                    throw new std::runtime_error("Failed to find input transaction, is -txindex enabled?");
+                mapPrevCoins[prevout.hash] = CCoins(prevTx, nHeight);
+            }
+            if (mapPrevCoins[prevout.hash].vout[prevout.n].scriptPubKey.IsPayToCryptoCondition())
+                vInputs.push_back(std::make_pair(i, j));
+        }
+    }
+
+    // ProcessCC only runs the contract validators while a block is being connected.
+    // Hold cs_main like ConnectBlock does so live block and mempool evals never see our flag.
+    LOCK(cs_main);
+    int32_t savedConnecting = KOMODO_CONNECTING;
+    KOMODO_CONNECTING = nHeight;
+    for (int nThreads = 1; nThreads <= nMaxThreads; nThreads++) {
+        CCheckQueue<CScriptCheck> queue(128);
+        std::vector<std::thread> threads;
+        for (int i = 0; i < nThreads-1; i++) {
+            threads.emplace_back(&CCheckQueue<CScriptCheck>::Thread, &queue);
+        }
+        struct timeval tv_start;
+        timer_start(tv_start);
+        {
+            CCheckQueueControl<CScriptCheck> control(&queue);
+            std::vector<CScriptCheck> vChecks;
+            for (auto it = vInputs.begin(); it != vInputs.end(); it++) {
+                const CTransaction &tx = block.vtx[it->first];
+                vChecks.push_back(CScriptCheck(mapPrevCoins[tx.vin[it->second].prevout.hash], tx, it->second,
+                                               SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY, false,
+                                               consensusBranchId, &txdata[it->first]));
+            }
+            control.Add(vChecks);
+            control.Wait();
+        }
+        ret.push_back(timer_stop(tv_start));
+        queue.Quit();
+        for (auto it = threads.begin(); it != threads.end(); it++) {
+            it->join();
+        }
+    }
+    KOMODO_CONNECTING = savedConnecting;
+    return ret;
+}
+
+struct komodo_state;
+struct komodo_state *komodo_stateptr(char *symbol,char *dest);
+struct notarized_checkpoint *komodo_npptr_for_height_scan(struct komodo_state *sp,int32_t height,int *idx);
+struct notarized_checkpoint *komodo_npptr_for_height_search(struct komodo_state *sp,int32_t height,int *idx);
+int32_t komodo_notarizeddata_scan(struct komodo_state *sp,int32_t nHeight);
+int32_t komodo_notarizeddata_search(struct komodo_state *sp,int32_t nHeight);
+
+// Look up the notarized checkpoint and the MoM covering nLookups random
+// heights with the linear scans and with the sorted index, returns both times
+std::vector<double> benchmark_notarized_lookups(size_t nLookups)
+{
+    char symbol[KOMODO_ASSETCHAIN_MAXLEN],dest[KOMODO_ASSETCHAIN_MAXLEN];
+    struct komodo_state *sp = komodo_stateptr(symbol,dest);
+    int nTip = chainActive.Height();
+    if (sp == NULL || nTip <= 0)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "No notarization data");
+
+    std::vector<int32_t> heights;
+    for (size_t i = 0; i < nLookups; i++)
+        heights.push_back(1 + GetRand(nTip));
+
+    std::vector<int32_t> scanned, searched;
+    int idx;
+    struct timeval tv_start;
+    std::vector<double> ret;
+
+    timer_start(tv_start);
+    for (size_t i = 0; i < heights.size(); i++) {
+        scanned.push_back(komodo_notarizeddata_scan(sp, heights[i]));
+        komodo_npptr_for_height_scan(sp, heights[i], &idx);
+        scanned.push_back(idx);
+    }
+    ret.push_back(timer_stop(tv_start));
+
+    timer_start(tv_start);
+    for (size_t i = 0; i < heights.size(); i++) {
+        searched.push_back(komodo_notarizeddata_search(sp, heights[i]));
+        komodo_npptr_for_height_search(sp, heights[i], &idx);
+        searched.push_back(idx);
+    }
+    ret.push_back(timer_stop(tv_start));
+
+    if (scanned != searched)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Indexed notarization lookups differ from the linear scans");
+    return ret;
+}
+
 #ifdef ENABLE_MINING
 double benchmark_solve_equihash()
 {
@@ -211,14 +428,15 @@ std::vector<double> benchmark_solve_equihash_threaded(int nThreads)
 }
 #endif // ENABLE_MINING
 
-double benchmark_verify_equihash()
+double benchmark_verify_equihash(size_t nVerifications)
 {
     CChainParams params = Params(CBaseChainParams::MAIN);
     CBlock genesis = Params(CBaseChainParams::MAIN).GenesisBlock();
     CBlockHeader genesis_header = genesis.GetBlockHeader();
     struct timeval tv_start;
     timer_start(tv_start);
-    CheckEquihashSolution(&genesis_header, params);
+    for (size_t i = 0; i < nVerifications; i++)
+        CheckEquihashSolution(&genesis_header, params);
     return timer_stop(tv_start);
 }
 
@@ -294,6 +512,33 @@ double benchmark_try_decrypt_notes(size_t nAddrs)
     return timer_stop(tv_start);
 }
 
+// Trial-decrypt a batch of nTxs received transactions against nAddrs keys,
+// once for every thread count from 1 to nMaxThreads
+std::vector<double> benchmark_try_decrypt_notes_threaded(size_t nAddrs, size_t nTxs, int nMaxThreads)
+{
+    std::vector<double> ret;
+    CWallet wallet;
+    for (int i = 0; i < nAddrs; i++) {
+        auto sk = libzcash::SpendingKey::random();
+        wallet.AddSpendingKey(sk);
+    }
+
+    // Decryption cost doesn't depend on the ciphertext, so one transaction
+    // stands in for the whole batch.
+    auto sk = libzcash::SpendingKey::random();
+    auto tx = GetValidReceive(*pzcashParams, sk, 10, true);
+    std::vector<const CTransaction*> vtx(nTxs, &tx);
+
+    for (int nThreads = 1; nThreads <= nMaxThreads; nThreads++) {
+        std::vector<mapNoteData_t> vNoteData;
+        struct timeval tv_start;
+        timer_start(tv_start);
+        wallet.FindMyNotes(vtx, vNoteData, nThreads);
+        ret.push_back(timer_stop(tv_start));
+    }
+    return ret;
+}
+
 double benchmark_increment_note_witnesses(size_t nTxs)
 {
     CWallet wallet;
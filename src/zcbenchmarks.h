@@ -11,9 +11,14 @@ extern std::vector<double> benchmark_create_joinsplit_threaded(int nThreads);
 extern double benchmark_solve_equihash();
 extern std::vector<double> benchmark_solve_equihash_threaded(int nThreads);
 extern double benchmark_verify_joinsplit(const JSDescription &joinsplit);
-extern double benchmark_verify_equihash();
+extern std::vector<double> benchmark_verify_joinsplit_block(const JSDescription &joinsplit, size_t nJoinSplits, int nMaxThreads);
+extern std::vector<double> benchmark_verify_ccblock(int nHeight, int nMaxThreads);
+extern std::vector<double> benchmark_notarized_lookups(size_t nLookups);
+extern double benchmark_verify_equihash(size_t nVerifications);
+extern std::vector<double> benchmark_verify_headers(int nHeaders, int nMaxThreads);
 extern double benchmark_large_tx(size_t nInputs);
 extern double benchmark_try_decrypt_notes(size_t nAddrs);
+extern std::vector<double> benchmark_try_decrypt_notes_threaded(size_t nAddrs, size_t nTxs, int nMaxThreads);
 extern double benchmark_increment_note_witnesses(size_t nTxs);
 extern double benchmark_connectblock_slow();
 extern double benchmark_sendtoaddress(CAmount amount);